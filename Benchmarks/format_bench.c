@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../Helpers/Format_helpers.h"
+
+// Microbenchmark of the pixel format conversion kernels. Converts a 1080p frame with every
+// kernel on every instruction set the CPU supports and reports the throughput in GB/s,
+// counting the bytes read plus the bytes written.
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MIN_SECONDS 0.25
+
+enum kernel {
+	XRGB_TO_RGB565,
+	RGB565_TO_XRGB,
+	RGBA_TO_BGRA,
+	YUYV_TO_XRGB,
+	NV12_TO_XRGB,
+	KERNEL_COUNT
+};
+
+static const char *kernel_names[KERNEL_COUNT] = {
+	"xrgb8888 -> rgb565",
+	"rgb565 -> xrgb8888",
+	"rgba <-> bgra",
+	"yuyv -> xrgb8888",
+	"nv12 -> xrgb8888",
+};
+
+static uint8_t *src, *dst, *reference;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Converts one frame, returns the number of bytes touched
+static size_t run_kernel(enum kernel k, uint8_t *out) {
+	switch (k) {
+	case XRGB_TO_RGB565:
+		convert_xrgb8888_to_rgb565(out, WIDTH * 2, src, WIDTH * 4, WIDTH, HEIGHT);
+		return (size_t)WIDTH * HEIGHT * (4 + 2);
+	case RGB565_TO_XRGB:
+		convert_rgb565_to_xrgb8888(out, WIDTH * 4, src, WIDTH * 2, WIDTH, HEIGHT);
+		return (size_t)WIDTH * HEIGHT * (2 + 4);
+	case RGBA_TO_BGRA:
+		convert_rgba_bgra(out, WIDTH * 4, src, WIDTH * 4, WIDTH, HEIGHT);
+		return (size_t)WIDTH * HEIGHT * (4 + 4);
+	case YUYV_TO_XRGB:
+		convert_yuyv_to_xrgb8888(out, WIDTH * 4, src, WIDTH * 2, WIDTH, HEIGHT);
+		return (size_t)WIDTH * HEIGHT * (2 + 4);
+	case NV12_TO_XRGB:
+		convert_nv12_to_xrgb8888(out, WIDTH * 4, src, WIDTH, src + WIDTH * HEIGHT, WIDTH, WIDTH, HEIGHT);
+		return (size_t)WIDTH * HEIGHT * 3 / 2 + (size_t)WIDTH * HEIGHT * 4;
+	default:
+		return 0;
+	}
+}
+
+int main() {
+	const size_t frame_size = (size_t)WIDTH * HEIGHT * 4;
+	src = malloc(frame_size);
+	dst = malloc(frame_size);
+	reference = malloc(frame_size);
+	if (!src || !dst || !reference) {
+		printf("Benchmark Error: Malloc failed\n");
+		return 1;
+	}
+
+	srand(1);
+	for (size_t i = 0; i < frame_size; i++)
+		src[i] = rand() & 0xFF;
+
+	const enum format_isa isas[] = { FORMAT_ISA_SCALAR, FORMAT_ISA_SSE4, FORMAT_ISA_AVX2, FORMAT_ISA_NEON };
+
+	printf("%-20s %-8s %10s\n", "kernel", "isa", "GB/s");
+	for (int k = 0; k < KERNEL_COUNT; k++) {
+		format_select_isa(FORMAT_ISA_SCALAR);
+		memset(reference, 0, frame_size);
+		run_kernel(k, reference);
+
+		for (unsigned long i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+			if (format_select_isa(isas[i]))
+				continue;
+
+			// Warm up, and check the output against the scalar kernel
+			memset(dst, 0, frame_size);
+			run_kernel(k, dst);
+			int matches = memcmp(dst, reference, frame_size) == 0;
+
+			size_t bytes = 0;
+			double start = now(), elapsed;
+			do {
+				bytes += run_kernel(k, dst);
+				elapsed = now() - start;
+			} while (elapsed < MIN_SECONDS);
+
+			printf("%-20s %-8s %10.2f%s\n", kernel_names[k], format_isa_name(), bytes / elapsed / 1e9,
+					matches ? "" : "  (output differs from scalar!)");
+		}
+	}
+
+	free(src);
+	free(dst);
+	free(reference);
+	return 0;
+}
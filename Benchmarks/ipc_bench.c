@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <GLES2/gl2.h>
+
+#include "../Helpers/Renderer_helpers.h"
+#include "../Helpers/Ipc_helpers.h"
+
+// Throughput of the IPC server. A headless renderer (llvmpipe or whatever Mesa's surfaceless
+// platform picks) serves ipc_client processes started next to this binary, renders frames as
+// fast as it can and reports the frames per second each client got on screen as JSON.
+//
+// usage: ipc_bench [clients] [seconds] [output.json]
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define LAYER_SIZE 256
+#define CONNECT_TIMEOUT 5.0
+
+static double seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void init() {
+}
+
+static void draw() {
+	glViewport(0, 0, renderer_get_width(), renderer_get_height());
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+// Clients that have put at least one frame on screen
+static unsigned int presenting_clients() {
+	unsigned int count = 0;
+	struct ipc_client_stats stats;
+	for (unsigned int i = 0; i < MAX_IPC_CLIENTS; i++) {
+		if (!ipc_client_stats(i, &stats) && stats.presented)
+			count++;
+	}
+	return count;
+}
+
+int main(int argc, char **argv) {
+	unsigned int clients = argc > 1 ? (unsigned int)atoi(argv[1]) : 4;
+	double duration = argc > 2 ? atof(argv[2]) : 5.0;
+	FILE *out = stdout;
+
+	if (!clients || clients > MAX_IPC_CLIENTS || duration <= 0) {
+		printf("usage: %s [clients, up to %d] [seconds] [output.json]\n", argv[0], MAX_IPC_CLIENTS);
+		return 1;
+	}
+
+	// ipc_client is built next to this binary
+	char client_path[4096];
+	ssize_t length = readlink("/proc/self/exe", client_path, sizeof(client_path) - sizeof("ipc_client"));
+	if (length <= 0) {
+		perror("readlink");
+		return 1;
+	}
+	client_path[length] = '\0';
+	strcpy(strrchr(client_path, '/') + 1, "ipc_client");
+
+	char directory[] = "/tmp/ipc_bench.XXXXXX";
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	char socket_path[64];
+	snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+
+	renderer_set_overlay(0);
+	if (init_renderer_offscreen(init, draw, NULL, WIDTH, HEIGHT, NULL) || ipc_server_start(socket_path)) {
+		rmdir(directory);
+		return 1;
+	}
+
+	// The clients run longer than the measurement and stop when the server goes away
+	pid_t pids[MAX_IPC_CLIENTS];
+	unsigned int columns = WIDTH / LAYER_SIZE;
+	for (unsigned int i = 0; i < clients; i++) {
+		char x[16], y[16], size[16];
+		snprintf(x, sizeof(x), "%u", i % columns * LAYER_SIZE);
+		snprintf(y, sizeof(y), "%u", i / columns * LAYER_SIZE);
+		snprintf(size, sizeof(size), "%d", LAYER_SIZE);
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			execl(client_path, "ipc_client", socket_path, "0", x, y, size, (char *)NULL);
+			perror("execl");
+			_exit(1);
+		}
+	}
+
+	int ret = 0;
+	double start = seconds();
+	while (presenting_clients() < clients && !ret) {
+		if (seconds() - start > CONNECT_TIMEOUT) {
+			printf("ipc_bench: Only %u of %u clients connected\n", presenting_clients(), clients);
+			ret = 1;
+		}
+		ret |= render_frames(1);
+	}
+
+	struct ipc_client_stats before[MAX_IPC_CLIENTS], after[MAX_IPC_CLIENTS];
+	for (unsigned int i = 0; i < MAX_IPC_CLIENTS; i++)
+		ipc_client_stats(i, &before[i]);
+
+	unsigned long frames = 0;
+	double elapsed = 0;
+	start = seconds();
+	while (!ret && elapsed < duration) {
+		ret = render_frames(1);
+		frames++;
+		elapsed = seconds() - start;
+	}
+
+	int have[MAX_IPC_CLIENTS];
+	for (unsigned int i = 0; i < MAX_IPC_CLIENTS; i++)
+		have[i] = !ipc_client_stats(i, &after[i]) && after[i].pid == before[i].pid;
+
+	if (!ret) {
+		if (argc > 3) {
+			out = fopen(argv[3], "w");
+			if (!out) {
+				perror("fopen");
+				out = stdout;
+			}
+		}
+
+		fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"clients\": %u,\n  \"seconds\": %.2f,\n"
+				"  \"compositor_fps\": %.1f,\n  \"per_client\": [\n",
+				(const char *)glGetString(GL_RENDERER), clients, elapsed, frames / elapsed);
+		unsigned int written = 0;
+		for (unsigned int i = 0; i < MAX_IPC_CLIENTS; i++) {
+			if (!have[i])
+				continue;
+			fprintf(out, "    { \"pid\": %d, \"zero_copy\": %s, \"presented_fps\": %.1f, \"submitted_fps\": %.1f, "
+					"\"dropped\": %lu, \"upload_mb_per_s\": %.2f }%s\n",
+					after[i].pid, after[i].zero_copy ? "true" : "false",
+					(after[i].presented - before[i].presented) / elapsed,
+					(after[i].submitted - before[i].submitted) / elapsed,
+					after[i].dropped - before[i].dropped,
+					(after[i].uploaded_bytes - before[i].uploaded_bytes) / (elapsed * 1024.0 * 1024.0),
+					++written < clients ? "," : "");
+		}
+		fprintf(out, "  ]\n}\n");
+		if (out != stdout)
+			fclose(out);
+	}
+
+	// Disconnected clients exit on their own
+	ipc_server_stop();
+	for (unsigned int i = 0; i < clients; i++) {
+		if (pids[i] > 0)
+			waitpid(pids[i], NULL, 0);
+	}
+	free_renderer();
+	rmdir(directory);
+	return ret;
+}
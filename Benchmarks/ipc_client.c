@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <drm/drm_fourcc.h>
+
+#include "../Helpers/Ipc_client_helpers.h"
+#include "../Helpers/Software_helpers.h"
+
+// Test client for the IPC server in Helpers/Ipc_helpers.h. Draws a square bouncing across a
+// layer of its own into double buffered memfds, damaging only the two rectangles that change
+// per frame, and prints how many frames per second it submitted. ipc_bench runs several of
+// them against a headless server.
+//
+// usage: ipc_client <socket> [seconds, 0 until the server quits] [x] [y] [size]
+
+#define BUFFERS 2
+#define SQUARE 32
+#define STEP 4
+
+static double now_seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		printf("usage: %s <socket> [seconds] [x] [y] [size]\n", argv[0]);
+		return 1;
+	}
+	double seconds = argc > 2 ? atof(argv[2]) : 0;
+	int x = argc > 3 ? atoi(argv[3]) : 0;
+	int y = argc > 4 ? atoi(argv[4]) : 0;
+	int size = argc > 5 ? atoi(argv[5]) : 256;
+	if (size < SQUARE * 2)
+		size = SQUARE * 2;
+
+	if (ipc_connect(argv[1]) || ipc_set_layer(x, y, getpid() % 16))
+		return 1;
+
+	// A color per process, so the layers can be told apart
+	uint32_t background = 0xFF000000 | ((getpid() * 0x9E3779B1u) & 0x7F7F7F);
+	int square_x[BUFFERS]; // Where each buffer has its square drawn
+	for (int i = 0; i < BUFFERS; i++) {
+		unsigned int stride;
+		if (ipc_create_buffer(size, size, DRM_FORMAT_XRGB8888) != i)
+			return 1;
+		struct sw_canvas canvas = { ipc_buffer_pixels(i, &stride), size, size, 0 };
+		canvas.stride = stride;
+		sw_fill_rect(&canvas, 0, 0, size, size, background);
+		square_x[i] = -1;
+	}
+
+	int position = 0, direction = STEP, previous = -1;
+	unsigned long frames = 0;
+	double start = now_seconds(), elapsed = 0;
+	while (!seconds || elapsed < seconds) {
+		int buffer = ipc_acquire_buffer(1000);
+		if (buffer < 0)
+			break;
+
+		unsigned int stride;
+		struct sw_canvas canvas = { ipc_buffer_pixels(buffer, &stride), size, size, 0 };
+		canvas.stride = stride;
+
+		// The buffer still shows the square of two frames ago
+		int top = (size - SQUARE) / 2;
+		if (square_x[buffer] >= 0)
+			sw_fill_rect(&canvas, square_x[buffer], top, SQUARE, SQUARE, background);
+		sw_fill_rect(&canvas, position, top, SQUARE, SQUARE, 0xFFFFFFFF);
+		square_x[buffer] = position;
+
+		// Relative to the previous submit: its square goes, the new one appears
+		struct ipc_rect damage[2] = {
+			{ position, top, SQUARE, SQUARE },
+			{ previous, top, SQUARE, SQUARE },
+		};
+		if (ipc_submit(buffer, damage, previous < 0 ? 0 : 2))
+			break;
+		previous = position;
+		frames++;
+
+		position += direction;
+		if (position < 0 || position > size - SQUARE) {
+			direction = -direction;
+			position += 2 * direction;
+		}
+		elapsed = now_seconds() - start;
+	}
+
+	printf("ipc_client %d: %lu frames in %.2f s, %.1f frames/s\n", getpid(), frames, elapsed,
+			elapsed > 0 ? frames / elapsed : 0.0);
+	ipc_disconnect();
+	return 0;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <GLES2/gl2.h>
+
+#include "../Helpers/Renderer_helpers.h"
+#include "../Helpers/GL_helpers.h"
+#include "../Helpers/Arena_helpers.h"
+#include "../Helpers/Job_helpers.h"
+
+// Particle system on the job system. Every frame one job integrates the particles and a
+// second one, depending on it, writes their positions straight into frame arena memory that
+// is then uploaded as the frame's vertex buffer. The update runs with 1, 2, 4, ... threads up
+// to the core count and the throughput of each run is reported as JSON.
+//
+// usage: particles_bench [particles] [frames per run] [output.json]
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define WARMUP_FRAMES 10
+#define GRAIN 4096
+#define DT (1.0f / 60.0f)
+#define GRAVITY 1.5f
+
+static unsigned int particle_count;
+static float *pos_x, *pos_y, *vel_x, *vel_y, *life;
+static unsigned int frame_index;
+static double update_seconds;
+
+static GLuint program, vbo;
+static GLint pos_attrib;
+
+static const char *vs =
+	"attribute vec2 a_Position;"
+	"void main() { gl_Position = vec4(a_Position, 0.0, 1.0); gl_PointSize = 1.0; }";
+
+static const char *fs =
+	"precision mediump float;"
+	"void main() { gl_FragColor = vec4(1.0, 0.6, 0.2, 1.0); }";
+
+// Stateless so the result doesn't depend on which thread updates a particle
+static float random_float(unsigned int seed) {
+	seed ^= seed >> 16;
+	seed *= 0x7feb352d;
+	seed ^= seed >> 15;
+	seed *= 0x846ca68b;
+	seed ^= seed >> 16;
+	return (seed & 0xffffff) / (float)0x1000000;
+}
+
+static void spawn(unsigned int i) {
+	unsigned int seed = i * 4 + frame_index * 0x9e3779b9;
+	pos_x[i] = 0.0f;
+	pos_y[i] = -0.8f;
+	vel_x[i] = random_float(seed) - 0.5f;
+	vel_y[i] = 1.0f + random_float(seed + 1) * 1.5f;
+	life[i] = 1.0f + random_float(seed + 2) * 3.0f;
+}
+
+static void integrate(void *data, unsigned int begin, unsigned int end) {
+	(void)data;
+	for (unsigned int i = begin; i < end; i++) {
+		vel_y[i] -= GRAVITY * DT;
+		pos_x[i] += vel_x[i] * DT;
+		pos_y[i] += vel_y[i] * DT;
+		if (pos_y[i] < -1.0f) {
+			pos_y[i] = -1.0f;
+			vel_y[i] *= -0.6f;
+		}
+		if (pos_x[i] < -1.0f || pos_x[i] > 1.0f)
+			vel_x[i] = -vel_x[i];
+
+		life[i] -= DT;
+		if (life[i] <= 0.0f)
+			spawn(i);
+	}
+}
+
+static void write_vertices(void *data, unsigned int begin, unsigned int end) {
+	float *vertices = data;
+	for (unsigned int i = begin; i < end; i++) {
+		vertices[i * 2] = pos_x[i];
+		vertices[i * 2 + 1] = pos_y[i];
+	}
+}
+
+static double seconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void init() {
+	program = createProgram(vs, fs);
+	if (!program)
+		exit(1);
+	pos_attrib = glGetAttribLocation(program, "a_Position");
+	glGenBuffers(1, &vbo);
+}
+
+static void draw() {
+	double start = seconds();
+	float *vertices = frame_alloc(particle_count * 2 * sizeof(float), 64);
+	if (!vertices)
+		return;
+	job_t update = job_parallel_for(integrate, NULL, particle_count, GRAIN, NULL, 0);
+	job_t write = job_parallel_for(write_vertices, vertices, particle_count, GRAIN, &update, 1);
+	job_wait(write);
+	update_seconds += seconds() - start;
+	frame_index++;
+
+	glViewport(0, 0, renderer_get_width(), renderer_get_height());
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, particle_count * 2 * sizeof(float), vertices, GL_STREAM_DRAW);
+	glVertexAttribPointer(pos_attrib, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(pos_attrib);
+	glDrawArrays(GL_POINTS, 0, particle_count);
+	glDisableVertexAttribArray(pos_attrib);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void cleanup() {
+	glDeleteBuffers(1, &vbo);
+	glDeleteProgram(program);
+}
+
+int main(int argc, char **argv) {
+	particle_count = argc > 1 ? (unsigned int)atoi(argv[1]) : 1000000;
+	unsigned int frames = argc > 2 ? (unsigned int)atoi(argv[2]) : 120;
+	FILE *out = stdout;
+
+	if (!particle_count || !frames) {
+		printf("usage: %s [particles] [frames per run] [output.json]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 3) {
+		out = fopen(argv[3], "w");
+		if (!out) {
+			perror("fopen");
+			return 1;
+		}
+	}
+
+	pos_x = malloc(particle_count * sizeof(float));
+	pos_y = malloc(particle_count * sizeof(float));
+	vel_x = malloc(particle_count * sizeof(float));
+	vel_y = malloc(particle_count * sizeof(float));
+	life = malloc(particle_count * sizeof(float));
+	if (!pos_x || !pos_y || !vel_x || !vel_y || !life) {
+		printf("Malloc failed\n");
+		return 1;
+	}
+	for (unsigned int i = 0; i < particle_count; i++)
+		spawn(i);
+
+	// The vertices of a frame plus room for the overlay
+	frame_arena_configure(particle_count * 2 * sizeof(float) + FRAME_ARENA_DEFAULT_SIZE, FRAME_ARENA_DEFAULT_FRAMES);
+	if (init_renderer_offscreen(init, draw, cleanup, WIDTH, HEIGHT, NULL))
+		return 1;
+
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int cores = online > 1 ? online : 1;
+
+	fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"particles\": %u,\n  \"frames\": %u,\n  \"cores\": %u,\n  \"runs\": [\n",
+			(const char *)glGetString(GL_RENDERER), particle_count, frames, cores);
+
+	int ret = 0;
+	double single_thread = 0;
+	// 1, 2, 4, ... threads and finally all cores
+	for (unsigned int threads = 1;; threads = threads * 2 < cores ? threads * 2 : cores) {
+		if (init_jobs(threads)) {
+			ret = 1;
+			break;
+		}
+
+		ret = render_frames(WARMUP_FRAMES);
+		update_seconds = 0;
+		if (!ret)
+			ret = render_frames(frames);
+		free_jobs();
+
+		double per_ms = particle_count * (double)frames / (update_seconds * 1000.0);
+		if (threads == 1)
+			single_thread = per_ms;
+		fprintf(out, "    { \"threads\": %u, \"update_ms_per_frame\": %.3f, \"particles_per_ms\": %.0f, \"speedup\": %.2f }%s\n",
+				threads, update_seconds * 1000.0 / frames, per_ms, per_ms / single_thread, threads < cores ? "," : "");
+		if (ret || threads == cores)
+			break;
+	}
+	fprintf(out, "  ]\n}\n");
+
+	if (out != stdout)
+		fclose(out);
+	free_renderer();
+	free(pos_x);
+	free(pos_y);
+	free(vel_x);
+	free(vel_y);
+	free(life);
+	return ret;
+}
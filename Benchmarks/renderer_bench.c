@@ -0,0 +1,552 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <GLES2/gl2.h>
+
+#include "../Helpers/Renderer_helpers.h"
+#include "../Helpers/GL_helpers.h"
+#include "../Helpers/Arena_helpers.h"
+#include "../Helpers/Profiler_helpers.h"
+#include "../Helpers/Mesh_helpers.h"
+#include "../Helpers/Target_helpers.h"
+#include "../Helpers/Texture_helpers.h"
+#include "../Helpers/Text_helpers.h"
+
+// Headless renderer benchmark. Renders a set of fixed scenes offscreen and reports frames/s,
+// CPU time of the render thread per frame, GPU time of the scene (when timer queries are
+// available), heap allocations and text glyphs per frame as JSON, along with the most frame
+// arena memory any frame used.
+//
+// usage: renderer_bench [frames per scene] [output.json]
+//
+// Allocations are counted by wrapping malloc/calloc/realloc at link time, so they cover the
+// benchmark and the helpers but not the GL driver.
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define WARMUP_FRAMES 10
+#define SPRITE_COUNT 4000
+#define UPLOAD_FLOATS (256 * 1024)
+#define STORM_PROGRAMS 8
+#define MESH_INSTANCES 10000
+#define PAGING_TEXTURES 48
+#define PAGING_VISIBLE 8
+#define PAGING_SIZE 256
+#define PAGING_RESIDENT 16 // Textures that fit the cache budget
+#define TEXT_LINE_LENGTH 160
+
+/* Allocation counting */
+
+static unsigned long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return __real_realloc(ptr, size);
+}
+
+/* Scenes */
+
+static const char *color_vs =
+	"attribute vec4 a_Position;"
+	"void main() { gl_Position = a_Position; }";
+
+static const char *color_fs =
+	"precision mediump float;"
+	"uniform vec4 u_Color;"
+	"void main() { gl_FragColor = u_Color; }";
+
+static const char *sprite_vs =
+	"attribute vec2 a_Position;"
+	"attribute vec2 a_TexCoord;"
+	"varying vec2 v_TexCoord;"
+	"void main() { v_TexCoord = a_TexCoord; gl_Position = vec4(a_Position, 0.0, 1.0); }";
+
+static const char *sprite_fs =
+	"precision mediump float;"
+	"uniform sampler2D u_Texture;"
+	"varying vec2 v_TexCoord;"
+	"void main() { gl_FragColor = texture2D(u_Texture, v_TexCoord); }";
+
+static const char *instance_vs =
+	"attribute vec4 a_Position;"
+	"attribute vec2 a_Offset;"
+	"attribute vec2 a_ScaleRotation;"
+	"attribute vec4 a_Color;"
+	"varying vec4 v_Color;"
+	"void main() {"
+	"  float s = sin(a_ScaleRotation.y), c = cos(a_ScaleRotation.y);"
+	"  vec2 p = a_Position.xy * a_ScaleRotation.x;"
+	"  gl_Position = vec4(p.x * c - p.y * s + a_Offset.x, p.x * s + p.y * c + a_Offset.y, 0.0, 1.0);"
+	"  v_Color = a_Color;"
+	"}";
+
+static const char *instance_fs =
+	"precision mediump float;"
+	"varying vec4 v_Color;"
+	"void main() { gl_FragColor = v_Color; }";
+
+static GLuint color_program, sprite_program, sprite_texture, instance_program;
+static int instance_mesh = -1;
+static int panel_target = -1;
+static int paging_textures[PAGING_TEXTURES];
+static char paging_dir[] = "/tmp/renderer_bench.XXXXXX";
+static GLuint triangle_vbo, sprite_vbo, upload_vbo;
+static GLint color_pos_attrib, color_uniform, sprite_pos_attrib, sprite_uv_attrib, sprite_tex_uniform;
+static float *upload_data;
+static unsigned int frame_index;
+
+static void draw_triangle() {
+	glUseProgram(color_program);
+	glBindBuffer(GL_ARRAY_BUFFER, triangle_vbo);
+	glVertexAttribPointer(color_pos_attrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(color_pos_attrib);
+	glUniform4f(color_uniform, 1.0, 0.0, 0.0, 1.0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glDisableVertexAttribArray(color_pos_attrib);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void draw_text() {
+	for (int row = 0; row < 20; row++) {
+		for (int col = 0; col < 8; col++)
+			renderer_draw_number(frame_index * 997 + row * 8 + col, 20 + col * 150, 40 + row * 32, 2.0f);
+	}
+}
+
+static void draw_sdf_text() {
+	// Screens of changing text, from small print up to headings, all from the one atlas
+	static const float sizes[] = { 8, 12, 16, 24, 12, 8, 40, 10, 14, 64, 9, 11 };
+	char line[TEXT_LINE_LENGTH + 1];
+	float y = 4;
+	for (unsigned int row = 0; y < HEIGHT; row++) {
+		float size = sizes[row % (sizeof(sizes) / sizeof(sizes[0]))];
+		for (int i = 0; i < TEXT_LINE_LENGTH; i++)
+			line[i] = 33 + (row * 7 + i + frame_index) % 94;
+		line[TEXT_LINE_LENGTH] = '\0';
+		text_draw(line, 4, y, size, 0xFFFFFFFF - row * 0x00030507);
+		y += size * 1.25f;
+	}
+}
+
+static void draw_sprites() {
+	glUseProgram(sprite_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sprite_texture);
+	glUniform1i(sprite_tex_uniform, 0);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glBindBuffer(GL_ARRAY_BUFFER, sprite_vbo);
+	glVertexAttribPointer(sprite_pos_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+	glVertexAttribPointer(sprite_uv_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(sprite_pos_attrib);
+	glEnableVertexAttribArray(sprite_uv_attrib);
+	glDrawArrays(GL_TRIANGLES, 0, SPRITE_COUNT * 6);
+	glDisableVertexAttribArray(sprite_pos_attrib);
+	glDisableVertexAttribArray(sprite_uv_attrib);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glDisable(GL_BLEND);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static void draw_uploads() {
+	// Rewrite the whole buffer every frame, like a CPU animated mesh
+	for (unsigned int i = 0; i < UPLOAD_FLOATS; i += 2) {
+		upload_data[i] = ((i * 7 + frame_index * 13) % 2000) / 1000.0f - 1.0f;
+		upload_data[i + 1] = ((i * 3 + frame_index * 5) % 2000) / 1000.0f - 1.0f;
+	}
+
+	glUseProgram(color_program);
+	glBindBuffer(GL_ARRAY_BUFFER, upload_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, UPLOAD_FLOATS * sizeof(float), upload_data);
+	glVertexAttribPointer(color_pos_attrib, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glEnableVertexAttribArray(color_pos_attrib);
+	glUniform4f(color_uniform, 0.0, 0.0, 1.0, 1.0);
+	glDrawArrays(GL_POINTS, 0, UPLOAD_FLOATS / 2);
+	glDisableVertexAttribArray(color_pos_attrib);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void draw_mesh_instances() {
+	// Every object moves every frame, only the offsets are uploaded
+	for (unsigned int i = 0; i < MESH_INSTANCES; i++) {
+		float dx = ((i * 7 + frame_index) % 5) * 0.001f - 0.002f;
+		float dy = ((i * 3 + frame_index) % 5) * 0.001f - 0.002f;
+		mesh_move(instance_mesh, i, dx, dy);
+	}
+
+	glUseProgram(instance_program);
+	draw_mesh(instance_mesh, instance_program);
+}
+
+static void draw_cached_sprites() {
+	// The sprite flood as a static panel, rendered once and then drawn as one quad
+	if (panel_target < 0) {
+		panel_target = acquire_target(WIDTH, HEIGHT, TARGET_RGBA8888, 0);
+		if (panel_target < 0)
+			return;
+		bind_target(panel_target);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		draw_sprites();
+		bind_target(-1);
+	}
+	draw_target(panel_target, 0, 0, WIDTH, HEIGHT);
+}
+
+static void draw_post_process() {
+	// A fresh half resolution target every frame, served from the pool after the first one
+	int target = acquire_target(WIDTH / 2, HEIGHT / 2, TARGET_RGBA8888, TARGET_DEPTH);
+	if (target < 0)
+		return;
+	bind_target(target);
+	glClearColor(0.0f, 0.0f, 0.3f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	draw_triangle();
+	bind_target(-1);
+	draw_target(target, 0, 0, WIDTH, HEIGHT);
+	release_target(target);
+}
+
+static void draw_texture_paging() {
+	// A window sliding over more textures than the cache budget holds, so they page in and out
+	glUseProgram(sprite_program);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(sprite_tex_uniform, 0);
+
+	for (int i = 0; i < PAGING_VISIBLE; i++) {
+		unsigned int texture = texture_get(paging_textures[(frame_index / 2 + i) % PAGING_TEXTURES]);
+		if (!texture)
+			continue; // Still loading
+
+		float x = -1.0f + (i % 4) * 0.5f, y = i < 4 ? 0.0f : -1.0f;
+		const float quad[] = {
+			x, y, 0, 0, x + 0.5f, y, 1, 0, x, y + 1.0f, 0, 1,
+			x + 0.5f, y, 1, 0, x + 0.5f, y + 1.0f, 1, 1, x, y + 1.0f, 0, 1,
+		};
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glVertexAttribPointer(sprite_pos_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), quad);
+		glVertexAttribPointer(sprite_uv_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), quad + 2);
+		glEnableVertexAttribArray(sprite_pos_attrib);
+		glEnableVertexAttribArray(sprite_uv_attrib);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+	}
+
+	glDisableVertexAttribArray(sprite_pos_attrib);
+	glDisableVertexAttribArray(sprite_uv_attrib);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Writes the paging test images, alternating PPM and QOI (with only literal RGBA pixels)
+static int write_paging_images() {
+	unsigned char *pixels = malloc(PAGING_SIZE * PAGING_SIZE * 4);
+	if (!pixels || !mkdtemp(paging_dir)) {
+		free(pixels);
+		return 1;
+	}
+
+	for (int i = 0; i < PAGING_TEXTURES; i++) {
+		char path[64];
+		int qoi = i % 2;
+		snprintf(path, sizeof(path), "%s/%02d.%s", paging_dir, i, qoi ? "qoi" : "ppm");
+		FILE *f = fopen(path, "wb");
+		if (!f) {
+			free(pixels);
+			return 1;
+		}
+
+		for (int p = 0; p < PAGING_SIZE * PAGING_SIZE; p++) {
+			pixels[p * 4] = (p % PAGING_SIZE) ^ (i * 37);
+			pixels[p * 4 + 1] = (p / PAGING_SIZE) + i * 11;
+			pixels[p * 4 + 2] = i * 5;
+			pixels[p * 4 + 3] = 255;
+		}
+
+		if (qoi) {
+			const unsigned char header[14] = { 'q', 'o', 'i', 'f', 0, 0, PAGING_SIZE >> 8, PAGING_SIZE & 0xFF,
+					0, 0, PAGING_SIZE >> 8, PAGING_SIZE & 0xFF, 4, 0 };
+			const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+			fwrite(header, 1, sizeof(header), f);
+			for (int p = 0; p < PAGING_SIZE * PAGING_SIZE; p++) {
+				fputc(0xFF, f);
+				fwrite(&pixels[p * 4], 1, 4, f);
+			}
+			fwrite(end, 1, sizeof(end), f);
+		} else {
+			fprintf(f, "P6\n# renderer_bench\n%d %d\n255\n", PAGING_SIZE, PAGING_SIZE);
+			for (int p = 0; p < PAGING_SIZE * PAGING_SIZE; p++)
+				fwrite(&pixels[p * 4], 1, 3, f);
+		}
+		fclose(f);
+
+		paging_textures[i] = load_texture(path);
+		if (paging_textures[i] < 0) {
+			free(pixels);
+			return 1;
+		}
+	}
+
+	free(pixels);
+	return 0;
+}
+
+static void remove_paging_images() {
+	for (int i = 0; i < PAGING_TEXTURES; i++) {
+		char path[64];
+		snprintf(path, sizeof(path), "%s/%02d.%s", paging_dir, i, i % 2 ? "qoi" : "ppm");
+		unlink(path);
+	}
+	rmdir(paging_dir);
+}
+
+static void draw_program_storm() {
+	// Unique sources so drivers can't serve the programs from a shader cache
+	char fs[256];
+	for (int i = 0; i < STORM_PROGRAMS; i++) {
+		snprintf(fs, sizeof(fs),
+				"precision mediump float;"
+				"uniform vec4 u_Color;"
+				"void main() { gl_FragColor = u_Color * %u.0; }", frame_index * STORM_PROGRAMS + i + 1);
+		GLuint program = createProgram(color_vs, fs);
+		if (program)
+			glDeleteProgram(program);
+	}
+	draw_triangle();
+}
+
+struct scene {
+	const char *name;
+	void (*draw)(void);
+};
+
+static const struct scene scenes[] = {
+	{ "triangle", draw_triangle },
+	{ "overlay_text", draw_text },
+	{ "sdf_text", draw_sdf_text },
+	{ "sprite_flood", draw_sprites },
+	{ "buffer_uploads", draw_uploads },
+	{ "mesh_instances", draw_mesh_instances },
+	{ "cached_sprites", draw_cached_sprites },
+	{ "post_process", draw_post_process },
+	{ "texture_paging", draw_texture_paging },
+	{ "program_storm", draw_program_storm },
+};
+
+static const struct scene *current_scene = &scenes[0];
+
+static void init() {
+	color_program = createProgram(color_vs, color_fs);
+	sprite_program = createProgram(sprite_vs, sprite_fs);
+	instance_program = createProgram(instance_vs, instance_fs);
+	if (!color_program || !sprite_program || !instance_program)
+		exit(1);
+
+	color_pos_attrib = glGetAttribLocation(color_program, "a_Position");
+	color_uniform = glGetUniformLocation(color_program, "u_Color");
+	sprite_pos_attrib = glGetAttribLocation(sprite_program, "a_Position");
+	sprite_uv_attrib = glGetAttribLocation(sprite_program, "a_TexCoord");
+	sprite_tex_uniform = glGetUniformLocation(sprite_program, "u_Texture");
+
+	static const GLfloat triangle[] = {
+		0.0f, 0.25f, 0.0f,
+		-0.25f, -0.25f, 0.0f,
+		0.25f, -0.25f, 0.0f
+	};
+	glGenBuffers(1, &triangle_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, triangle_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+
+	// 16x16 sprite with a soft edge
+	unsigned char pixels[16 * 16 * 4];
+	for (int y = 0; y < 16; y++) {
+		for (int x = 0; x < 16; x++) {
+			int d = (x - 8) * (x - 8) + (y - 8) * (y - 8);
+			unsigned char *p = &pixels[(y * 16 + x) * 4];
+			p[0] = x * 16;
+			p[1] = y * 16;
+			p[2] = 200;
+			p[3] = d < 64 ? 255 - d * 4 : 0;
+		}
+	}
+	glGenTextures(1, &sprite_texture);
+	glBindTexture(GL_TEXTURE_2D, sprite_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 16, 16, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Static sprite quads scattered over the screen
+	float *quads = malloc(SPRITE_COUNT * 6 * 4 * sizeof(float));
+	if (!quads)
+		exit(1);
+	srand(1);
+	for (int i = 0; i < SPRITE_COUNT; i++) {
+		float x = rand() / (float)RAND_MAX * 2.0f - 1.0f, y = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+		float w = 32.0f / WIDTH, h = 32.0f / HEIGHT;
+		float quad[6][4] = {
+			{ x, y, 0, 0 }, { x + w, y, 1, 0 }, { x, y + h, 0, 1 },
+			{ x + w, y, 1, 0 }, { x + w, y + h, 1, 1 }, { x, y + h, 0, 1 },
+		};
+		memcpy(&quads[i * 24], quad, sizeof(quad));
+	}
+	glGenBuffers(1, &sprite_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, sprite_vbo);
+	glBufferData(GL_ARRAY_BUFFER, SPRITE_COUNT * 6 * 4 * sizeof(float), quads, GL_STATIC_DRAW);
+	free(quads);
+
+	upload_data = malloc(UPLOAD_FLOATS * sizeof(float));
+	if (!upload_data)
+		exit(1);
+	glGenBuffers(1, &upload_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, upload_vbo);
+	glBufferData(GL_ARRAY_BUFFER, UPLOAD_FLOATS * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Small triangles scattered over the screen, drawn as instances of one mesh
+	static const float small_triangle[] = { 0.0f, 0.01f, -0.01f, -0.01f, 0.01f, -0.01f };
+	instance_mesh = create_mesh(small_triangle, 3, 2, MESH_INSTANCES);
+	if (instance_mesh < 0)
+		exit(1);
+	for (int i = 0; i < MESH_INSTANCES; i++) {
+		int instance = mesh_add_instance(instance_mesh);
+		mesh_set_transform(instance_mesh, instance, rand() / (float)RAND_MAX * 2.0f - 1.0f,
+				rand() / (float)RAND_MAX * 2.0f - 1.0f, 1.0f, rand() / (float)RAND_MAX * 6.28f);
+		mesh_set_color(instance_mesh, instance, 0xFF000000 | (rand() & 0xFFFFFF));
+	}
+
+	// 256x256 with mipmaps is 4/3 * 256 KiB
+	texture_cache_configure(PAGING_RESIDENT * PAGING_SIZE * PAGING_SIZE * 4 * 4 / 3 + 4096, 0);
+	if (write_paging_images()) {
+		printf("Failed to write the paging test images\n");
+		exit(1);
+	}
+}
+
+static void draw() {
+	glViewport(0, 0, renderer_get_width(), renderer_get_height());
+	glClearColor(0.0f, 0.3f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	gpu_pass_begin(current_scene->name);
+	current_scene->draw();
+	gpu_pass_end();
+	frame_index++;
+}
+
+static void cleanup() {
+	glDeleteBuffers(1, &triangle_vbo);
+	glDeleteBuffers(1, &sprite_vbo);
+	glDeleteBuffers(1, &upload_vbo);
+	glDeleteTextures(1, &sprite_texture);
+	glDeleteProgram(color_program);
+	glDeleteProgram(sprite_program);
+	glDeleteProgram(instance_program);
+	free_mesh(instance_mesh);
+	release_target(panel_target);
+	for (int i = 0; i < PAGING_TEXTURES; i++)
+		release_texture(paging_textures[i]);
+	remove_paging_images();
+	free(upload_data);
+}
+
+static double seconds(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	unsigned int frames = argc > 1 ? (unsigned int)atoi(argv[1]) : 300;
+	FILE *out = stdout;
+
+	if (!frames) {
+		printf("usage: %s [frames per scene] [output.json]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) {
+		out = fopen(argv[2], "w");
+		if (!out) {
+			perror("fopen");
+			return 1;
+		}
+	}
+
+	if (init_renderer_offscreen(init, draw, cleanup, WIDTH, HEIGHT, NULL))
+		return 1;
+
+	fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %u,\n  \"scenes\": [\n",
+			(const char *)glGetString(GL_RENDERER), WIDTH, HEIGHT, frames);
+
+	int ret = 0;
+	const unsigned int scene_count = sizeof(scenes) / sizeof(scenes[0]);
+	for (unsigned int i = 0; i < scene_count && !ret; i++) {
+		current_scene = &scenes[i];
+		if (render_frames(WARMUP_FRAMES)) {
+			ret = 1;
+			break;
+		}
+
+		gpu_profiler_reset_totals();
+		unsigned long allocations_start = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+		double wall_start = seconds(CLOCK_MONOTONIC), cpu_start = seconds(CLOCK_THREAD_CPUTIME_ID);
+		ret = render_frames(frames);
+		double wall = seconds(CLOCK_MONOTONIC) - wall_start, cpu = seconds(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+		unsigned long allocated = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocations_start;
+
+		fprintf(out, "    { \"name\": \"%s\", \"fps\": %.2f, \"cpu_ms_per_frame\": %.3f, ",
+				current_scene->name, frames / wall, cpu * 1000.0 / frames);
+
+		const struct gpu_pass_time *passes;
+		unsigned int pass_count = gpu_profiler_results(&passes);
+		for (unsigned int p = 0; p < pass_count; p++) {
+			// Averaged over the frames whose queries were read back during the run
+			if (strcmp(passes[p].name, current_scene->name) == 0 && passes[p].frames)
+				fprintf(out, "\"gpu_ms_per_frame\": %.3f, ", passes[p].total_ms / passes[p].frames);
+		}
+
+		// Glyphs of the last frame, the FPS overlay's included
+		struct text_stats text;
+		text_stats(&text);
+		fprintf(out, "\"glyphs_per_frame\": %u, \"text_draws_per_frame\": %u, ", text.glyphs, text.draws);
+
+		fprintf(out, "\"allocations\": %lu, \"allocations_per_frame\": %.2f }%s\n",
+				allocated, (double)allocated / frames, i + 1 < scene_count ? "," : "");
+	}
+	struct target_pool_stats targets;
+	target_pool_stats(&targets);
+	fprintf(out, "  ],\n  \"frame_arena_high_water\": %zu,\n", frame_arena_high_water());
+	fprintf(out, "  \"target_pool\": { \"bytes\": %zu, \"targets\": %u, \"created\": %lu, \"evicted\": %lu },\n",
+			targets.bytes, targets.targets, targets.created, targets.evicted);
+
+	struct texture_cache_stats textures;
+	texture_cache_stats(&textures);
+	fprintf(out, "  \"texture_cache\": { \"bytes\": %zu, \"budget\": %zu, \"resident\": %u, \"loads\": %lu, \"evictions\": %lu },\n",
+			textures.bytes, textures.budget, textures.resident, textures.loads, textures.evictions);
+
+	struct text_stats text;
+	text_stats(&text);
+	fprintf(out, "  \"text_atlas\": { \"bytes\": %zu, \"from_cache\": %s, \"build_ms\": %.2f }\n}\n",
+			text.atlas_bytes, text.from_cache ? "true" : "false", text.build_ms);
+
+	if (out != stdout)
+		fclose(out);
+	free_renderer();
+	return ret;
+}
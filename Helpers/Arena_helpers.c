@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include "Arena_helpers.h"
+
+// Every arena starts on a cache line
+#define ARENA_ALIGNMENT 64
+#define MIN_ALIGNMENT 16
+
+static struct {
+	size_t size;
+	unsigned int frames;
+
+	unsigned char *memory; // frames * size bytes, one region per frame in flight
+	unsigned int current;
+	size_t used;           // Updated atomically, jobs may allocate during a frame
+	size_t high_water;
+	unsigned long failures;
+	int warned;
+} arena = { FRAME_ARENA_DEFAULT_SIZE, FRAME_ARENA_DEFAULT_FRAMES, NULL, 0, 0, 0, 0, 0 };
+
+int frame_arena_configure(size_t size, unsigned int frames_in_flight) {
+	if (arena.memory) {
+		printf("Arena Error: Frame arena must be configured before init_renderer\n");
+		return 1;
+	}
+	if (!size || !frames_in_flight) {
+		printf("Arena Error: Invalid frame arena size\n");
+		return 1;
+	}
+
+	arena.size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	arena.frames = frames_in_flight;
+	return 0;
+}
+
+// Called by the renderer
+int init_frame_arena() {
+	if (arena.memory)
+		return 0;
+
+	if (posix_memalign((void **)&arena.memory, ARENA_ALIGNMENT, arena.size * arena.frames)) {
+		printf("Arena Error: Failed to allocate %zu bytes\n", arena.size * arena.frames);
+		arena.memory = NULL;
+		return 1;
+	}
+
+	arena.current = 0;
+	arena.used = 0;
+	arena.high_water = 0;
+	arena.failures = 0;
+	arena.warned = 0;
+	return 0;
+}
+
+// Called by the renderer once the frame has been submitted, moves to the next frame's region
+void reset_frame_arena() {
+	if (!arena.memory)
+		return;
+
+	if (arena.used > arena.high_water)
+		arena.high_water = arena.used;
+
+	arena.current = (arena.current + 1) % arena.frames;
+	__atomic_store_n(&arena.used, 0, __ATOMIC_RELAXED);
+}
+
+void free_frame_arena() {
+	free(arena.memory);
+	arena.memory = NULL;
+}
+
+void *frame_alloc(size_t size, size_t align) {
+	if (!arena.memory) {
+		printf("Arena Error: Renderer haven't been initialized\n");
+		return NULL;
+	}
+	if (align & (align - 1)) {
+		printf("Arena Error: Alignment %zu is not a power of two\n", align);
+		return NULL;
+	}
+	if (align < MIN_ALIGNMENT)
+		align = MIN_ALIGNMENT;
+
+	// Regions are only cache line aligned, larger alignments are applied to the address
+	unsigned char *region = arena.memory + arena.current * arena.size;
+	uintptr_t base = (uintptr_t)region;
+	size_t used = __atomic_load_n(&arena.used, __ATOMIC_RELAXED);
+	size_t start, end;
+	do {
+		start = ((base + used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+		end = start + size;
+		if (start < used || end > arena.size || end < start) {
+			__atomic_add_fetch(&arena.failures, 1, __ATOMIC_RELAXED);
+			if (!__atomic_exchange_n(&arena.warned, 1, __ATOMIC_RELAXED))
+				printf("Arena Error: Frame arena full (%zu bytes), see frame_arena_high_water()\n", arena.size);
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&arena.used, &used, end, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return region + start;
+}
+
+char *frame_printf(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (length < 0)
+		return NULL;
+
+	char *str = frame_alloc(length + 1, 1);
+	if (!str)
+		return NULL;
+
+	va_start(args, format);
+	vsnprintf(str, length + 1, format, args);
+	va_end(args);
+	return str;
+}
+
+size_t frame_arena_used() {
+	return __atomic_load_n(&arena.used, __ATOMIC_RELAXED);
+}
+
+size_t frame_arena_high_water() {
+	size_t used = frame_arena_used();
+	return used > arena.high_water ? used : arena.high_water;
+}
+
+unsigned long frame_arena_failures() {
+	return __atomic_load_n(&arena.failures, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,34 @@
+#ifndef HELPERS_ARENA_HELPERS_H_
+#define HELPERS_ARENA_HELPERS_H_
+
+#include <stddef.h>
+
+// Per-frame scratch memory. Allocations are a pointer bump and are all released together when
+// the renderer presents the frame, so draw callbacks never need malloc/free. There is one arena
+// per frame in flight: memory handed out in frame N stays valid until frame N + frames_in_flight
+// starts, long enough for the GPU to read vertex data passed by pointer.
+
+// Default size of each frame's arena and number of frames in flight.
+#define FRAME_ARENA_DEFAULT_SIZE (256 * 1024)
+#define FRAME_ARENA_DEFAULT_FRAMES 2
+
+// Sizes the arenas, must be called before init_renderer. Returns 1 on invalid arguments.
+int frame_arena_configure(size_t size, unsigned int frames_in_flight);
+
+// Returns size bytes aligned to align (a power of two, at least 16 is used so SSE/NEON loads
+// work on any allocation), or NULL when the frame's arena is full or align isn't a power of
+// two. Safe to call from several threads during a frame.
+void *frame_alloc(size_t size, size_t align);
+
+// snprintf into the frame arena, NULL if it doesn't fit.
+char *frame_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// Bytes used so far in the current frame.
+size_t frame_arena_used();
+
+// Most bytes any single frame has used since the renderer started, and the number of
+// allocations that failed because the arena was full. Use it to size the arena.
+size_t frame_arena_high_water();
+unsigned long frame_arena_failures();
+
+#endif /* HELPERS_ARENA_HELPERS_H_ */
@@ -0,0 +1,494 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "Format_helpers.h"
+
+// Row kernels. n is the number of pixels in the row.
+struct format_kernels {
+	const char *isa;
+	void (*xrgb_to_rgb565)(uint16_t *dst, const uint32_t *src, unsigned int n);
+	void (*rgb565_to_xrgb)(uint32_t *dst, const uint16_t *src, unsigned int n);
+	void (*swap_rb)(uint32_t *dst, const uint32_t *src, unsigned int n);
+	void (*yuyv_to_xrgb)(uint32_t *dst, const uint8_t *src, unsigned int n);
+	void (*nv12_to_xrgb)(uint32_t *dst, const uint8_t *y, const uint8_t *uv, unsigned int n);
+};
+
+static struct format_kernels kernels;
+
+/* Scalar */
+
+static inline uint16_t pixel_to_rgb565(uint32_t p) {
+	return ((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F);
+}
+
+// Expands with bit replication so 0x1F becomes 0xFF
+static inline uint32_t pixel_from_rgb565(uint16_t p) {
+	uint32_t r = (p >> 8) & 0xF8, g = (p >> 3) & 0xFC, b = (p << 3) & 0xF8;
+	r |= r >> 5;
+	g |= g >> 6;
+	b |= b >> 5;
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+static inline uint32_t pixel_swap_rb(uint32_t p) {
+	return (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+}
+
+static inline int clamp_u8(int x) {
+	return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+// BT.601 limited range, 8 bit fixed point. The SIMD kernels use the same integer math.
+static inline uint32_t pixel_from_yuv(int y, int u, int v) {
+	int c = (y - 16) * 298 + 128, d = u - 128, e = v - 128;
+	int r = clamp_u8((c + 409 * e) >> 8);
+	int g = clamp_u8((c - 100 * d - 208 * e) >> 8);
+	int b = clamp_u8((c + 516 * d) >> 8);
+	return 0xFF000000 | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+}
+
+static void xrgb_to_rgb565_scalar(uint16_t *dst, const uint32_t *src, unsigned int n) {
+	for (unsigned int i = 0; i < n; i++)
+		dst[i] = pixel_to_rgb565(src[i]);
+}
+
+static void rgb565_to_xrgb_scalar(uint32_t *dst, const uint16_t *src, unsigned int n) {
+	for (unsigned int i = 0; i < n; i++)
+		dst[i] = pixel_from_rgb565(src[i]);
+}
+
+static void swap_rb_scalar(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	for (unsigned int i = 0; i < n; i++)
+		dst[i] = pixel_swap_rb(src[i]);
+}
+
+// The SIMD kernels finish their rows with these, starting at pixel i
+static void yuyv_to_xrgb_tail(uint32_t *dst, const uint8_t *src, unsigned int i, unsigned int n) {
+	for (; i < n; i++) {
+		const uint8_t *pair = src + (i / 2) * 4;
+		dst[i] = pixel_from_yuv(pair[(i & 1) * 2], pair[1], pair[3]);
+	}
+}
+
+static void nv12_to_xrgb_tail(uint32_t *dst, const uint8_t *y, const uint8_t *uv, unsigned int i, unsigned int n) {
+	for (; i < n; i++)
+		dst[i] = pixel_from_yuv(y[i], uv[i & ~1u], uv[(i & ~1u) + 1]);
+}
+
+static void yuyv_to_xrgb_scalar(uint32_t *dst, const uint8_t *src, unsigned int n) {
+	yuyv_to_xrgb_tail(dst, src, 0, n);
+}
+
+static void nv12_to_xrgb_scalar(uint32_t *dst, const uint8_t *y, const uint8_t *uv, unsigned int n) {
+	nv12_to_xrgb_tail(dst, y, uv, 0, n);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* SSE4.1 */
+
+__attribute__((target("sse4.1")))
+static inline __m128i to_rgb565_sse4(__m128i p) {
+	__m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xF800));
+	__m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07E0));
+	__m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001F));
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+__attribute__((target("sse4.1")))
+static void xrgb_to_rgb565_sse4(uint16_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = to_rgb565_sse4(_mm_loadu_si128((const __m128i *)(src + i)));
+		__m128i b = to_rgb565_sse4(_mm_loadu_si128((const __m128i *)(src + i + 4)));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi32(a, b));
+	}
+	xrgb_to_rgb565_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i from_rgb565_sse4(__m128i p) {
+	__m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xF8));
+	__m128i g = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0xFC));
+	__m128i b = _mm_and_si128(_mm_slli_epi32(p, 3), _mm_set1_epi32(0xF8));
+	r = _mm_or_si128(r, _mm_srli_epi32(r, 5));
+	g = _mm_or_si128(g, _mm_srli_epi32(g, 6));
+	b = _mm_or_si128(b, _mm_srli_epi32(b, 5));
+	return _mm_or_si128(_mm_or_si128(_mm_set1_epi32((int)0xFF000000), _mm_slli_epi32(r, 16)),
+			_mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("sse4.1")))
+static void rgb565_to_xrgb_sse4(uint32_t *dst, const uint16_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), from_rgb565_sse4(_mm_cvtepu16_epi32(p)));
+		_mm_storeu_si128((__m128i *)(dst + i + 4), from_rgb565_sse4(_mm_cvtepu16_epi32(_mm_srli_si128(p, 8))));
+	}
+	rgb565_to_xrgb_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static void swap_rb_sse4(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(p, mask));
+	}
+	swap_rb_scalar(dst + i, src + i, n - i);
+}
+
+// Four pixels, one component per 32 bit lane
+__attribute__((target("sse4.1")))
+static inline __m128i from_yuv_sse4(__m128i y, __m128i u, __m128i v) {
+	const __m128i zero = _mm_setzero_si128(), max = _mm_set1_epi32(255);
+	__m128i c = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(y, _mm_set1_epi32(16)), _mm_set1_epi32(298)),
+			_mm_set1_epi32(128));
+	__m128i d = _mm_sub_epi32(u, _mm_set1_epi32(128));
+	__m128i e = _mm_sub_epi32(v, _mm_set1_epi32(128));
+
+	__m128i r = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(e, _mm_set1_epi32(409))), 8);
+	__m128i g = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(100))),
+			_mm_mullo_epi32(e, _mm_set1_epi32(208))), 8);
+	__m128i b = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(d, _mm_set1_epi32(516))), 8);
+	r = _mm_min_epi32(_mm_max_epi32(r, zero), max);
+	g = _mm_min_epi32(_mm_max_epi32(g, zero), max);
+	b = _mm_min_epi32(_mm_max_epi32(b, zero), max);
+
+	return _mm_or_si128(_mm_or_si128(_mm_set1_epi32((int)0xFF000000), _mm_slli_epi32(r, 16)),
+			_mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("sse4.1")))
+static void yuyv_to_xrgb_sse4(uint32_t *dst, const uint8_t *src, unsigned int n) {
+	// Zero extend bytes of Y0 U0 Y1 V0 Y2 U1 Y3 V1 into 32 bit lanes
+	const __m128i y_mask = _mm_setr_epi8(0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1);
+	const __m128i u_mask = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1);
+	const __m128i v_mask = _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i p = _mm_loadl_epi64((const __m128i *)(src + i * 2));
+		__m128i rgb = from_yuv_sse4(_mm_shuffle_epi8(p, y_mask), _mm_shuffle_epi8(p, u_mask),
+				_mm_shuffle_epi8(p, v_mask));
+		_mm_storeu_si128((__m128i *)(dst + i), rgb);
+	}
+	yuyv_to_xrgb_tail(dst, src, i, n);
+}
+
+__attribute__((target("sse4.1")))
+static void nv12_to_xrgb_sse4(uint32_t *dst, const uint8_t *y, const uint8_t *uv, unsigned int n) {
+	const __m128i u_mask = _mm_setr_epi8(0, -1, -1, -1, 0, -1, -1, -1, 2, -1, -1, -1, 2, -1, -1, -1);
+	const __m128i v_mask = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 3, -1, -1, -1, 3, -1, -1, -1);
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		int y4, uv4;
+		memcpy(&y4, y + i, 4);
+		memcpy(&uv4, uv + i, 4);
+		__m128i c = _mm_cvtsi32_si128(uv4);
+		__m128i rgb = from_yuv_sse4(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(y4)), _mm_shuffle_epi8(c, u_mask),
+				_mm_shuffle_epi8(c, v_mask));
+		_mm_storeu_si128((__m128i *)(dst + i), rgb);
+	}
+	nv12_to_xrgb_tail(dst, y, uv, i, n);
+}
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static inline __m256i to_rgb565_avx2(__m256i p) {
+	__m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xF800));
+	__m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07E0));
+	__m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001F));
+	return _mm256_or_si256(_mm256_or_si256(r, g), b);
+}
+
+__attribute__((target("avx2")))
+static void xrgb_to_rgb565_avx2(uint16_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i a = to_rgb565_avx2(_mm256_loadu_si256((const __m256i *)(src + i)));
+		__m256i b = to_rgb565_avx2(_mm256_loadu_si256((const __m256i *)(src + i + 8)));
+		// packus works per 128 bit lane, restore the pixel order afterwards
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+		_mm256_storeu_si256((__m256i *)(dst + i), packed);
+	}
+	xrgb_to_rgb565_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void rgb565_to_xrgb_avx2(uint32_t *dst, const uint16_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i p = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+		__m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xF8));
+		__m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0xFC));
+		__m256i b = _mm256_and_si256(_mm256_slli_epi32(p, 3), _mm256_set1_epi32(0xF8));
+		r = _mm256_or_si256(r, _mm256_srli_epi32(r, 5));
+		g = _mm256_or_si256(g, _mm256_srli_epi32(g, 6));
+		b = _mm256_or_si256(b, _mm256_srli_epi32(b, 5));
+		__m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32((int)0xFF000000), _mm256_slli_epi32(r, 16)),
+				_mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+		_mm256_storeu_si256((__m256i *)(dst + i), out);
+	}
+	rgb565_to_xrgb_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void swap_rb_avx2(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i p = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(p, mask));
+	}
+	swap_rb_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i from_yuv_avx2(__m256i y, __m256i u, __m256i v) {
+	const __m256i zero = _mm256_setzero_si256(), max = _mm256_set1_epi32(255);
+	__m256i c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(16)),
+			_mm256_set1_epi32(298)), _mm256_set1_epi32(128));
+	__m256i d = _mm256_sub_epi32(u, _mm256_set1_epi32(128));
+	__m256i e = _mm256_sub_epi32(v, _mm256_set1_epi32(128));
+
+	__m256i r = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(e, _mm256_set1_epi32(409))), 8);
+	__m256i g = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(100))),
+			_mm256_mullo_epi32(e, _mm256_set1_epi32(208))), 8);
+	__m256i b = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(d, _mm256_set1_epi32(516))), 8);
+	r = _mm256_min_epi32(_mm256_max_epi32(r, zero), max);
+	g = _mm256_min_epi32(_mm256_max_epi32(g, zero), max);
+	b = _mm256_min_epi32(_mm256_max_epi32(b, zero), max);
+
+	return _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32((int)0xFF000000), _mm256_slli_epi32(r, 16)),
+			_mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("avx2")))
+static void yuyv_to_xrgb_avx2(uint32_t *dst, const uint8_t *src, unsigned int n) {
+	// Gather Y, U and V of eight pixels into the low 8 bytes, then widen
+	const __m128i y_mask = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i u_mask = _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i v_mask = _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + i * 2));
+		__m256i rgb = from_yuv_avx2(_mm256_cvtepu8_epi32(_mm_shuffle_epi8(p, y_mask)),
+				_mm256_cvtepu8_epi32(_mm_shuffle_epi8(p, u_mask)),
+				_mm256_cvtepu8_epi32(_mm_shuffle_epi8(p, v_mask)));
+		_mm256_storeu_si256((__m256i *)(dst + i), rgb);
+	}
+	yuyv_to_xrgb_tail(dst, src, i, n);
+}
+
+__attribute__((target("avx2")))
+static void nv12_to_xrgb_avx2(uint32_t *dst, const uint8_t *y, const uint8_t *uv, unsigned int n) {
+	const __m128i u_mask = _mm_setr_epi8(0, 0, 2, 2, 4, 4, 6, 6, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i v_mask = _mm_setr_epi8(1, 1, 3, 3, 5, 5, 7, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i c = _mm_loadl_epi64((const __m128i *)(uv + i));
+		__m256i rgb = from_yuv_avx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + i))),
+				_mm256_cvtepu8_epi32(_mm_shuffle_epi8(c, u_mask)),
+				_mm256_cvtepu8_epi32(_mm_shuffle_epi8(c, v_mask)));
+		_mm256_storeu_si256((__m256i *)(dst + i), rgb);
+	}
+	nv12_to_xrgb_tail(dst, y, uv, i, n);
+}
+#endif /* x86 */
+
+#ifdef __ARM_NEON
+/* NEON */
+
+static void xrgb_to_rgb565_neon(uint16_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+		uint16x8_t out = vshll_n_u8(p.val[2], 8);
+		out = vsriq_n_u16(out, vshll_n_u8(p.val[1], 8), 5);
+		out = vsriq_n_u16(out, vshll_n_u8(p.val[0], 8), 11);
+		vst1q_u16(dst + i, out);
+	}
+	xrgb_to_rgb565_scalar(dst + i, src + i, n - i);
+}
+
+static void rgb565_to_xrgb_neon(uint32_t *dst, const uint16_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint16x8_t p = vld1q_u16(src + i);
+		uint8x8x4_t out;
+		uint8x8_t r = vand_u8(vshrn_n_u16(p, 8), vdup_n_u8(0xF8));
+		uint8x8_t g = vand_u8(vshrn_n_u16(p, 3), vdup_n_u8(0xFC));
+		uint8x8_t b = vand_u8(vmovn_u16(vshlq_n_u16(p, 3)), vdup_n_u8(0xF8));
+		out.val[0] = vorr_u8(b, vshr_n_u8(b, 5));
+		out.val[1] = vorr_u8(g, vshr_n_u8(g, 6));
+		out.val[2] = vorr_u8(r, vshr_n_u8(r, 5));
+		out.val[3] = vdup_n_u8(0xFF);
+		vst4_u8((uint8_t *)(dst + i), out);
+	}
+	rgb565_to_xrgb_scalar(dst + i, src + i, n - i);
+}
+
+static void swap_rb_neon(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint8x8x4_t p = vld4_u8((const uint8_t *)(src + i));
+		uint8x8_t t = p.val[0];
+		p.val[0] = p.val[2];
+		p.val[2] = t;
+		vst4_u8((uint8_t *)(dst + i), p);
+	}
+	swap_rb_scalar(dst + i, src + i, n - i);
+}
+
+static inline uint8x8_t yuv_channel_neon(int32x4_t lo, int32x4_t hi) {
+	return vqmovn_u16(vcombine_u16(vqmovun_s32(vshrq_n_s32(lo, 8)), vqmovun_s32(vshrq_n_s32(hi, 8))));
+}
+
+// Eight pixels, stored as XRGB8888
+static inline void from_yuv_neon(uint32_t *dst, uint8x8_t y, uint8x8_t u, uint8x8_t v) {
+	int16x8_t c = vreinterpretq_s16_u16(vsubl_u8(y, vdup_n_u8(16)));
+	int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(u, vdup_n_u8(128)));
+	int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(v, vdup_n_u8(128)));
+	int32x4_t c_lo = vmlal_n_s16(vdupq_n_s32(128), vget_low_s16(c), 298);
+	int32x4_t c_hi = vmlal_n_s16(vdupq_n_s32(128), vget_high_s16(c), 298);
+
+	uint8x8x4_t out;
+	out.val[2] = yuv_channel_neon(vmlal_n_s16(c_lo, vget_low_s16(e), 409), vmlal_n_s16(c_hi, vget_high_s16(e), 409));
+	out.val[1] = yuv_channel_neon(
+			vmlal_n_s16(vmlal_n_s16(c_lo, vget_low_s16(d), -100), vget_low_s16(e), -208),
+			vmlal_n_s16(vmlal_n_s16(c_hi, vget_high_s16(d), -100), vget_high_s16(e), -208));
+	out.val[0] = yuv_channel_neon(vmlal_n_s16(c_lo, vget_low_s16(d), 516), vmlal_n_s16(c_hi, vget_high_s16(d), 516));
+	out.val[3] = vdup_n_u8(0xFF);
+	vst4_u8((uint8_t *)dst, out);
+}
+
+static void yuyv_to_xrgb_neon(uint32_t *dst, const uint8_t *src, unsigned int n) {
+	unsigned int i = 0;
+	// vld4 splits 16 pixels into even Y, U, odd Y and V
+	for (; i + 16 <= n; i += 16) {
+		uint8x8x4_t p = vld4_u8(src + i * 2);
+		uint8x8x2_t y = vzip_u8(p.val[0], p.val[2]);
+		uint8x8x2_t u = vzip_u8(p.val[1], p.val[1]);
+		uint8x8x2_t v = vzip_u8(p.val[3], p.val[3]);
+		from_yuv_neon(dst + i, y.val[0], u.val[0], v.val[0]);
+		from_yuv_neon(dst + i + 8, y.val[1], u.val[1], v.val[1]);
+	}
+	yuyv_to_xrgb_tail(dst, src, i, n);
+}
+
+static void nv12_to_xrgb_neon(uint32_t *dst, const uint8_t *y, const uint8_t *uv, unsigned int n) {
+	unsigned int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		uint8x8x2_t c = vld2_u8(uv + i);
+		uint8x8x2_t u = vzip_u8(c.val[0], c.val[0]);
+		uint8x8x2_t v = vzip_u8(c.val[1], c.val[1]);
+		from_yuv_neon(dst + i, vld1_u8(y + i), u.val[0], v.val[0]);
+		from_yuv_neon(dst + i + 8, vld1_u8(y + i + 8), u.val[1], v.val[1]);
+	}
+	nv12_to_xrgb_tail(dst, y, uv, i, n);
+}
+#endif /* __ARM_NEON */
+
+static const struct format_kernels scalar_kernels = {
+	"scalar", xrgb_to_rgb565_scalar, rgb565_to_xrgb_scalar, swap_rb_scalar, yuyv_to_xrgb_scalar, nv12_to_xrgb_scalar
+};
+
+int format_select_isa(enum format_isa isa) {
+	switch (isa) {
+	case FORMAT_ISA_AUTO:
+#if defined(__x86_64__) || defined(__i386__)
+		if (!format_select_isa(FORMAT_ISA_AVX2) || !format_select_isa(FORMAT_ISA_SSE4))
+			return 0;
+#elif defined(__ARM_NEON)
+		return format_select_isa(FORMAT_ISA_NEON);
+#endif
+		kernels = scalar_kernels;
+		return 0;
+	case FORMAT_ISA_SCALAR:
+		kernels = scalar_kernels;
+		return 0;
+#if defined(__x86_64__) || defined(__i386__)
+	case FORMAT_ISA_SSE4:
+		__builtin_cpu_init();
+		if (!__builtin_cpu_supports("sse4.1"))
+			return 1;
+		kernels = (struct format_kernels){ "sse4", xrgb_to_rgb565_sse4, rgb565_to_xrgb_sse4, swap_rb_sse4,
+				yuyv_to_xrgb_sse4, nv12_to_xrgb_sse4 };
+		return 0;
+	case FORMAT_ISA_AVX2:
+		__builtin_cpu_init();
+		if (!__builtin_cpu_supports("avx2"))
+			return 1;
+		kernels = (struct format_kernels){ "avx2", xrgb_to_rgb565_avx2, rgb565_to_xrgb_avx2, swap_rb_avx2,
+				yuyv_to_xrgb_avx2, nv12_to_xrgb_avx2 };
+		return 0;
+#endif
+#ifdef __ARM_NEON
+	case FORMAT_ISA_NEON:
+		kernels = (struct format_kernels){ "neon", xrgb_to_rgb565_neon, rgb565_to_xrgb_neon, swap_rb_neon,
+				yuyv_to_xrgb_neon, nv12_to_xrgb_neon };
+		return 0;
+#endif
+	default:
+		return 1;
+	}
+}
+
+static inline const struct format_kernels *get_kernels() {
+	if (!kernels.isa)
+		format_select_isa(FORMAT_ISA_AUTO);
+	return &kernels;
+}
+
+const char *format_isa_name() {
+	return get_kernels()->isa;
+}
+
+void convert_xrgb8888_to_rgb565(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height) {
+	const struct format_kernels *k = get_kernels();
+	for (unsigned int row = 0; row < height; row++)
+		k->xrgb_to_rgb565((uint16_t *)((uint8_t *)dst + (size_t)row * dst_stride),
+				(const uint32_t *)((const uint8_t *)src + (size_t)row * src_stride), width);
+}
+
+void convert_rgb565_to_xrgb8888(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height) {
+	const struct format_kernels *k = get_kernels();
+	for (unsigned int row = 0; row < height; row++)
+		k->rgb565_to_xrgb((uint32_t *)((uint8_t *)dst + (size_t)row * dst_stride),
+				(const uint16_t *)((const uint8_t *)src + (size_t)row * src_stride), width);
+}
+
+void convert_rgba_bgra(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height) {
+	const struct format_kernels *k = get_kernels();
+	for (unsigned int row = 0; row < height; row++)
+		k->swap_rb((uint32_t *)((uint8_t *)dst + (size_t)row * dst_stride),
+				(const uint32_t *)((const uint8_t *)src + (size_t)row * src_stride), width);
+}
+
+void convert_yuyv_to_xrgb8888(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height) {
+	const struct format_kernels *k = get_kernels();
+	for (unsigned int row = 0; row < height; row++)
+		k->yuyv_to_xrgb((uint32_t *)((uint8_t *)dst + (size_t)row * dst_stride),
+				(const uint8_t *)src + (size_t)row * src_stride, width);
+}
+
+void convert_nv12_to_xrgb8888(void *dst, unsigned int dst_stride, const void *y_plane, unsigned int y_stride,
+		const void *uv_plane, unsigned int uv_stride, unsigned int width, unsigned int height) {
+	const struct format_kernels *k = get_kernels();
+	for (unsigned int row = 0; row < height; row++)
+		k->nv12_to_xrgb((uint32_t *)((uint8_t *)dst + (size_t)row * dst_stride),
+				(const uint8_t *)y_plane + (size_t)row * y_stride,
+				(const uint8_t *)uv_plane + (size_t)(row / 2) * uv_stride, width);
+}
@@ -0,0 +1,40 @@
+#ifndef HELPERS_FORMAT_HELPERS_H_
+#define HELPERS_FORMAT_HELPERS_H_
+
+#include <stdint.h>
+
+// Instruction sets the conversion kernels are built for. FORMAT_ISA_AUTO picks the best one
+// the CPU supports, which is also what happens on the first conversion if nothing was selected.
+enum format_isa {
+	FORMAT_ISA_AUTO,
+	FORMAT_ISA_SCALAR,
+	FORMAT_ISA_SSE4,
+	FORMAT_ISA_AVX2,
+	FORMAT_ISA_NEON,
+};
+
+// Returns 0 if the kernels were switched, 1 if the instruction set isn't available.
+int format_select_isa(enum format_isa isa);
+
+// Name of the selected instruction set ("scalar", "sse4", "avx2" or "neon").
+const char *format_isa_name();
+
+// Image conversions. Strides are in bytes, 32 bit pixels are in DRM byte order
+// (XRGB8888 is B, G, R, X in memory). YUV input is BT.601 limited range.
+void convert_xrgb8888_to_rgb565(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height);
+
+void convert_rgb565_to_xrgb8888(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height);
+
+// Swaps the R and B channels, so it converts RGBA to BGRA and back.
+void convert_rgba_bgra(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height);
+
+void convert_yuyv_to_xrgb8888(void *dst, unsigned int dst_stride, const void *src, unsigned int src_stride,
+		unsigned int width, unsigned int height);
+
+void convert_nv12_to_xrgb8888(void *dst, unsigned int dst_stride, const void *y_plane, unsigned int y_stride,
+		const void *uv_plane, unsigned int uv_stride, unsigned int width, unsigned int height);
+
+#endif /* HELPERS_FORMAT_HELPERS_H_ */
@@ -1,30 +1,57 @@
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <drm/drm_fourcc.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <limits.h>
+#include <time.h>
 #include <unistd.h>
 #include "GL_helpers.h"
+#include "Trace_helpers.h"
+
+static void printShaderLog(GLuint shader, GLenum type) {
+    GLint infoLen = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
+    if (infoLen > 1) {
+        char *infoLog = (char *)malloc(infoLen);
+        glGetShaderInfoLog(shader, infoLen, NULL, infoLog);
+        printf("GL Error: Error compiling shader (%s):\n%s\n",
+                type == GL_VERTEX_SHADER ? "Vertex Shader" : "Fragment Shader", infoLog);
+        free(infoLog);
+    }
+}
+
+static void printProgramLog(GLuint program) {
+    GLint infoLen = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
+    if (infoLen > 1) {
+        char *infoLog = (char *)malloc(infoLen);
+        glGetProgramInfoLog(program, infoLen, NULL, infoLog);
+        printf("GL Error: Error linking program:\n%s\n", infoLog);
+        free(infoLog);
+    }
+}
 
 static GLuint compileShader(GLenum type, const char *source) {
+    TRACE_BEGIN(type == GL_VERTEX_SHADER ? "compile vertex shader" : "compile fragment shader");
     GLuint shader = glCreateShader(type);
     glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
 
+    // Drivers may compile lazily, the status query is part of the cost
     GLint compiled;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    TRACE_END();
     if (!compiled) {
-        GLint infoLen = 0;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
-        if (infoLen > 1) {
-            char *infoLog = (char *)malloc(infoLen);
-            glGetShaderInfoLog(shader, infoLen, NULL, infoLog);
-            printf("GL Error: Error compiling shader (%s):\n%s\n",
-                    type == GL_VERTEX_SHADER ? "Vertex Shader" : "Fragment Shader", infoLog);
-            free(infoLog);
-        }
+        printShaderLog(shader, type);
         glDeleteShader(shader);
         return 0;
     }
@@ -42,19 +69,14 @@ unsigned int createProgram(const char *vertexSource, const char *fragmentSource)
     GLuint program = glCreateProgram();
     glAttachShader(program, vertexShader);
     glAttachShader(program, fragmentShader);
+    TRACE_BEGIN("link program");
     glLinkProgram(program);
 
     GLint linked;
     glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    TRACE_END();
     if (!linked) {
-        GLint infoLen = 0;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
-        if (infoLen > 1) {
-            char *infoLog = (char *)malloc(infoLen);
-            glGetProgramInfoLog(program, infoLen, NULL, infoLog);
-            printf("GL Error: Error linking program:\n%s\n", infoLog);
-            free(infoLog);
-        }
+        printProgramLog(program);
         glDeleteProgram(program);
         return 0;
     }
@@ -68,6 +90,39 @@ unsigned int createProgram(const char *vertexSource, const char *fragmentSource)
     return program;
 }
 
+// Maps a shader file read only. Returns NULL on failure.
+static char *mapShaderFile(const char *path, size_t *size) {
+	struct stat st;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("GL Error: Failed to open shader file: %s\n", path);
+		return NULL;
+	}
+	// Get file size
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0) {
+		printf("GL Error: Empty shader file: %s\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	// Map file to memory, the mapping stays valid after closing the fd
+	char *source = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (source == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+
+	return source;
+}
+
 unsigned int createProgramFromFile(const char *vertexSourceFile, const char *fragmentSourceFile){
 	if(!vertexSourceFile){
 		printf("GL Error: Invalid vertex shader file\n");
@@ -77,67 +132,533 @@ unsigned int createProgramFromFile(const char *vertexSourceFile, const char *fra
 		printf("GL Error: Invalid fragment shader file\n");
 		return 0;
 	}
-	char* vertexSource = NULL, *fragmentSource = NULL;
-	GLuint program = 0;
-	struct stat st;
 	size_t vert_size, frag_size;
 
-	int vert_fd = open(vertexSourceFile, O_RDONLY);
-	if(vert_fd < 0){
-		printf("GL Error: Failed to open vertex shader file: %s\n", vertexSourceFile);
+	char *vertexSource = mapShaderFile(vertexSourceFile, &vert_size);
+	if (!vertexSource)
+		return 0;
+
+	char *fragmentSource = mapShaderFile(fragmentSourceFile, &frag_size);
+	if (!fragmentSource) {
+		munmap(vertexSource, vert_size);
 		return 0;
 	}
-	// Get file size
-	if (fstat(vert_fd, &st) == -1) {
-		perror("fstat");
-		close(vert_fd);
+
+	GLuint program = createProgram(vertexSource, fragmentSource);
+
+	munmap(fragmentSource, frag_size);
+	munmap(vertexSource, vert_size);
+
+	return program;
+}
+
+// Shader hot reload. Watched programs are recompiled between frames when one of their files
+// changes. The directories are watched rather than the files, since most editors save by
+// renaming a temporary file over the original. The new program only replaces the current one
+// once it linked, so a broken edit keeps the last working program on screen.
+#define MAX_WATCHED_PROGRAMS 16
+#define RELOAD_SETTLE_MS 30
+
+struct watched_program {
+	int used;
+	char *files[2]; // vertex, fragment
+	int wds[2];
+	GLuint program;
+	program_reload_cb cb;
+
+	int dirty;
+	struct timespec changed_at;
+
+	// Compile in flight
+	GLuint pending_program, pending_shaders[2];
+};
+
+static struct watched_program watched_programs[MAX_WATCHED_PROGRAMS];
+static int inotify_fd = -1;
+static int parallel_compile = -1;
+
+static long elapsed_us(const struct timespec *since) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000000L + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static int watchFile(const char *path) {
+	char dir[PATH_MAX];
+	const char *slash = strrchr(path, '/');
+
+	if (!slash) {
+		strcpy(dir, ".");
+	}
+	else {
+		size_t len = slash == path ? 1 : (size_t)(slash - path);
+		if (len >= sizeof(dir))
+			return -1;
+		memcpy(dir, path, len);
+		dir[len] = '\0';
+	}
+
+	return inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+}
+
+int watchProgramFromFile(const char *vertexSourceFile, const char *fragmentSourceFile, program_reload_cb cb) {
+	int id = -1;
+	for (int i = 0; i < MAX_WATCHED_PROGRAMS; i++) {
+		if (!watched_programs[i].used) {
+			id = i;
+			break;
+		}
+	}
+	if (id < 0) {
+		printf("GL Error: Too many watched programs\n");
+		return -1;
+	}
+
+	GLuint program = createProgramFromFile(vertexSourceFile, fragmentSourceFile);
+	if (!program)
+		return -1;
+
+	if (inotify_fd < 0) {
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd < 0) {
+			perror("inotify_init1");
+			glDeleteProgram(program);
+			return -1;
+		}
+	}
+
+	struct watched_program *w = &watched_programs[id];
+	memset(w, 0, sizeof(*w));
+	w->files[0] = strdup(vertexSourceFile);
+	w->files[1] = strdup(fragmentSourceFile);
+	w->wds[0] = watchFile(vertexSourceFile);
+	w->wds[1] = watchFile(fragmentSourceFile);
+	if (!w->files[0] || !w->files[1] || w->wds[0] < 0 || w->wds[1] < 0) {
+		printf("GL Error: Failed to watch shader files of %s\n", vertexSourceFile);
+		free(w->files[0]);
+		free(w->files[1]);
+		memset(w, 0, sizeof(*w));
+		glDeleteProgram(program);
+		return -1;
+	}
+
+	w->used = 1;
+	w->program = program;
+	w->cb = cb;
+	return id;
+}
+
+unsigned int getWatchedProgram(int id) {
+	if (id < 0 || id >= MAX_WATCHED_PROGRAMS || !watched_programs[id].used)
 		return 0;
+
+	return watched_programs[id].program;
+}
+
+static void dropPendingProgram(struct watched_program *w) {
+	for (int i = 0; i < 2; i++) {
+		if (w->pending_shaders[i])
+			glDeleteShader(w->pending_shaders[i]);
+		w->pending_shaders[i] = 0;
 	}
+	if (w->pending_program)
+		glDeleteProgram(w->pending_program);
+	w->pending_program = 0;
+}
 
-	vert_size = st.st_size;
-	// Map file to memory
-	vertexSource = mmap(NULL, vert_size, PROT_READ, MAP_PRIVATE, vert_fd, 0);
-	if (vertexSource == MAP_FAILED) {
-		perror("mmap");
-		close(vert_fd);
+void unwatchProgram(int id) {
+	if (id < 0 || id >= MAX_WATCHED_PROGRAMS || !watched_programs[id].used)
+		return;
+
+	struct watched_program *w = &watched_programs[id];
+	dropPendingProgram(w);
+	if (w->program)
+		glDeleteProgram(w->program);
+
+	// Directories can be shared between programs, only drop watches nobody else uses
+	for (int f = 0; f < 2; f++) {
+		int shared = f == 1 && w->wds[1] == w->wds[0];
+		for (int i = 0; i < MAX_WATCHED_PROGRAMS && !shared; i++) {
+			if (i != id && watched_programs[i].used &&
+					(watched_programs[i].wds[0] == w->wds[f] || watched_programs[i].wds[1] == w->wds[f]))
+				shared = 1;
+		}
+		if (!shared)
+			inotify_rm_watch(inotify_fd, w->wds[f]);
+		free(w->files[f]);
+	}
+	memset(w, 0, sizeof(*w));
+}
+
+void freeProgramWatches() {
+	for (int i = 0; i < MAX_WATCHED_PROGRAMS; i++)
+		unwatchProgram(i);
+
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+	parallel_compile = -1;
+}
+
+static void markChangedFiles() {
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			if (!ev->len)
+				continue;
+
+			for (int i = 0; i < MAX_WATCHED_PROGRAMS; i++) {
+				struct watched_program *w = &watched_programs[i];
+				if (!w->used)
+					continue;
+				for (int f = 0; f < 2; f++) {
+					const char *slash = strrchr(w->files[f], '/');
+					const char *name = slash ? slash + 1 : w->files[f];
+					if (ev->wd == w->wds[f] && strcmp(ev->name, name) == 0) {
+						w->dirty = 1;
+						clock_gettime(CLOCK_MONOTONIC, &w->changed_at);
+					}
+				}
+			}
+		}
+	}
+}
+
+// Compiles and links without querying any status, so drivers with parallel compile don't block
+static int startReload(struct watched_program *w) {
+	size_t sizes[2];
+	char *sources[2];
+
+	sources[0] = mapShaderFile(w->files[0], &sizes[0]);
+	if (!sources[0])
+		return 1;
+	sources[1] = mapShaderFile(w->files[1], &sizes[1]);
+	if (!sources[1]) {
+		munmap(sources[0], sizes[0]);
 		return 1;
 	}
 
-	int frag_fd = open(fragmentSourceFile, O_RDONLY);
-	if (frag_fd < 0) {
-		printf("GL Error: Failed to open fragment shader file: %s\n", fragmentSourceFile);
-		munmap(vertexSource, vert_size);
-		close(vert_fd);
+	TRACE_BEGIN("start shader reload");
+	const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	w->pending_program = glCreateProgram();
+	for (int i = 0; i < 2; i++) {
+		GLint length = (GLint)sizes[i];
+		const char *source = sources[i];
+		w->pending_shaders[i] = glCreateShader(types[i]);
+		glShaderSource(w->pending_shaders[i], 1, &source, &length);
+		glCompileShader(w->pending_shaders[i]);
+		glAttachShader(w->pending_program, w->pending_shaders[i]);
+	}
+	glLinkProgram(w->pending_program);
+	TRACE_END();
+
+	munmap(sources[1], sizes[1]);
+	munmap(sources[0], sizes[0]);
+	return 0;
+}
+
+// Returns 1 while the driver is still compiling
+static int finishReload(struct watched_program *w) {
+	if (parallel_compile) {
+		GLint done = GL_FALSE;
+		glGetProgramiv(w->pending_program, GL_COMPLETION_STATUS_KHR, &done);
+		if (!done)
+			return 1;
+	}
+
+	GLint linked;
+	TRACE_BEGIN("finish shader reload");
+	glGetProgramiv(w->pending_program, GL_LINK_STATUS, &linked);
+	TRACE_END();
+	if (!linked) {
+		const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+		for (int i = 0; i < 2; i++) {
+			GLint compiled;
+			glGetShaderiv(w->pending_shaders[i], GL_COMPILE_STATUS, &compiled);
+			if (!compiled)
+				printShaderLog(w->pending_shaders[i], types[i]);
+		}
+		printProgramLog(w->pending_program);
+		printf("GL Error: Reload of %s failed, keeping the previous program\n", w->files[0]);
+		dropPendingProgram(w);
 		return 0;
 	}
 
-	// Get file size
-	if (fstat(frag_fd, &st) == -1) {
-		perror("fstat");
-		close(frag_fd);
-		munmap(vertexSource, vert_size);
-		close(vert_fd);
+	for (int i = 0; i < 2; i++)
+		glDetachShader(w->pending_program, w->pending_shaders[i]);
+
+	GLuint old = w->program;
+	w->program = w->pending_program;
+	w->pending_program = 0;
+	dropPendingProgram(w);
+	glDeleteProgram(old);
+
+	printf("Reloaded program: %s, %s\n", w->files[0], w->files[1]);
+	if (w->cb)
+		w->cb(w->program);
+	return 0;
+}
+
+void processProgramReloads(unsigned int budget_us) {
+	if (inotify_fd < 0)
+		return;
+
+	if (parallel_compile < 0) {
+		const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+		parallel_compile = extensions && strstr(extensions, "GL_KHR_parallel_shader_compile") != NULL;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	markChangedFiles();
+
+	for (int i = 0; i < MAX_WATCHED_PROGRAMS; i++) {
+		struct watched_program *w = &watched_programs[i];
+		if (!w->used)
+			continue;
+
+		if (w->pending_program) {
+			if (finishReload(w))
+				continue;
+		}
+		else if (w->dirty && elapsed_us(&w->changed_at) >= RELOAD_SETTLE_MS * 1000L) {
+			// Without parallel compile the driver compiles synchronously, so start at most
+			// what fits in the frame's budget and pick the rest up on the next frames
+			if (elapsed_us(&start) >= (long)budget_us)
+				break;
+			w->dirty = 0;
+			if (startReload(w) == 0 && !parallel_compile)
+				finishReload(w);
+		}
+	}
+}
+
+// dma-buf import cache. Raw fd numbers get reused as soon as the producer closes them, so
+// entries are keyed by the inode behind the fd (unique per dma-buf while our EGLImage
+// holds a reference to it) together with the plane layout. Entries taken with
+// acquireDmabuf() are counted and never evicted. importDmabuf() and acquireDmabuf() hand out
+// separate textures of the same EGLImage, so releasing one can't drop the other's reference.
+#define DMABUF_CACHE_SIZE 64
+
+struct dmabuf_entry {
+	dev_t st_dev;
+	ino_t st_ino;
+	unsigned int width, height;
+	uint32_t format, stride, offset;
+	uint64_t modifier;
+	EGLImageKHR image;
+	GLuint texture; // Returned by importDmabuf()
+	GLuint acquired; // Returned by acquireDmabuf(), shared by all its references
+	unsigned int refs; // acquireDmabuf() calls not released yet
+	unsigned long last_use;
+};
+
+static struct dmabuf_entry dmabuf_cache[DMABUF_CACHE_SIZE];
+static unsigned long dmabuf_use_counter = 0;
+
+static PFNEGLCREATEIMAGEKHRPROC egl_create_image = NULL;
+static PFNEGLDESTROYIMAGEKHRPROC egl_destroy_image = NULL;
+static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC gl_image_target_texture = NULL;
+static EGLDisplay dmabuf_display = EGL_NO_DISPLAY;
+static int has_modifiers = 0;
+
+static int has_extension(const char *extensions, const char *name) {
+	size_t len = strlen(name);
+	const char *p = extensions;
+
+	while (p && (p = strstr(p, name)) != NULL) {
+		if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+			return 1;
+		p += len;
+	}
+	return 0;
+}
+
+static int init_dmabuf_import() {
+	EGLDisplay display = eglGetCurrentDisplay();
+	if (display == EGL_NO_DISPLAY) {
+		printf("GL Error: dma-buf import needs a current EGL context\n");
+		return 1;
+	}
+	if (display == dmabuf_display)
 		return 0;
+
+	const char *egl_extensions = eglQueryString(display, EGL_EXTENSIONS);
+	const char *gl_extensions = (const char *)glGetString(GL_EXTENSIONS);
+	if (!has_extension(egl_extensions, "EGL_EXT_image_dma_buf_import")) {
+		printf("GL Error: EGL_EXT_image_dma_buf_import is not supported\n");
+		return 1;
+	}
+	if (!has_extension(gl_extensions, "GL_OES_EGL_image_external")) {
+		printf("GL Error: GL_OES_EGL_image_external is not supported\n");
+		return 1;
 	}
-	frag_size = st.st_size;
 
-	// Map file to memory
-	fragmentSource = mmap(NULL, frag_size, PROT_READ, MAP_PRIVATE, frag_fd, 0);
-	if (fragmentSource == MAP_FAILED) {
-		perror("mmap");
-		close(frag_fd);
-		munmap(vertexSource, vert_size);
-		close(vert_fd);
+	egl_create_image = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+	egl_destroy_image = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+	gl_image_target_texture = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress("glEGLImageTargetTexture2DOES");
+	if (!egl_create_image || !egl_destroy_image || !gl_image_target_texture) {
+		printf("GL Error: Failed to load EGLImage entry points\n");
 		return 1;
 	}
 
-	program = createProgram(vertexSource, fragmentSource);
+	has_modifiers = has_extension(egl_extensions, "EGL_EXT_image_dma_buf_import_modifiers");
+	dmabuf_display = display;
+	return 0;
+}
+
+static void destroy_dmabuf_entry(struct dmabuf_entry *entry) {
+	if (entry->texture)
+		glDeleteTextures(1, &entry->texture);
+	if (entry->acquired)
+		glDeleteTextures(1, &entry->acquired);
+	if (entry->image != EGL_NO_IMAGE_KHR)
+		egl_destroy_image(dmabuf_display, entry->image);
+	memset(entry, 0, sizeof(*entry));
+}
+
+// The entry's texture for importDmabuf() or acquireDmabuf(), created on first use
+static GLuint dmabuf_texture(struct dmabuf_entry *entry, int acquire) {
+	GLuint *texture = acquire ? &entry->acquired : &entry->texture;
+	if (!*texture) {
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, *texture);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		gl_image_target_texture(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES)entry->image);
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+	}
+	if (acquire)
+		entry->refs++;
+	return *texture;
+}
+
+static unsigned int import_dmabuf(int fd, unsigned int width, unsigned int height, uint32_t format,
+		uint64_t modifier, uint32_t stride, uint32_t offset, int acquire) {
+	if (fd < 0 || !width || !height || !stride) {
+		printf("GL Error: Invalid dma-buf description\n");
+		return 0;
+	}
+	if (init_dmabuf_import())
+		return 0;
 
-	munmap(fragmentSource, frag_size);
-	close(frag_fd);
-	munmap(vertexSource, vert_size);
-	close(vert_fd);
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror("fstat");
+		return 0;
+	}
 
-	return program;
+	// Look for a previous import of the same buffer, remembering a free slot or else the least
+	// recently used one nobody acquired
+	struct dmabuf_entry *slot = NULL;
+	for (int i = 0; i < DMABUF_CACHE_SIZE; i++) {
+		struct dmabuf_entry *entry = &dmabuf_cache[i];
+		if (entry->image != EGL_NO_IMAGE_KHR && entry->st_dev == st.st_dev && entry->st_ino == st.st_ino &&
+				entry->width == width && entry->height == height && entry->format == format &&
+				entry->modifier == modifier && entry->stride == stride && entry->offset == offset) {
+			entry->last_use = ++dmabuf_use_counter;
+			return dmabuf_texture(entry, acquire);
+		}
+		if (entry->refs || (slot && slot->image == EGL_NO_IMAGE_KHR))
+			continue;
+		if (!slot || entry->image == EGL_NO_IMAGE_KHR || entry->last_use < slot->last_use)
+			slot = entry;
+	}
+	if (!slot) {
+		printf("GL Error: dma-buf import cache is full of acquired buffers\n");
+		return 0;
+	}
+
+	if (modifier != DRM_FORMAT_MOD_INVALID && !has_modifiers) {
+		printf("GL Error: Explicit dma-buf modifiers are not supported\n");
+		return 0;
+	}
+
+	EGLint attribs[] = {
+		EGL_WIDTH, (EGLint)width,
+		EGL_HEIGHT, (EGLint)height,
+		EGL_LINUX_DRM_FOURCC_EXT, (EGLint)format,
+		EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, (EGLint)offset,
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, (EGLint)stride,
+		EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, (EGLint)(modifier & 0xffffffff),
+		EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, (EGLint)(modifier >> 32),
+		EGL_NONE
+	};
+	// Implicit modifier: terminate the list before the modifier attributes
+	if (modifier == DRM_FORMAT_MOD_INVALID)
+		attribs[12] = EGL_NONE;
+
+	EGLImageKHR image = egl_create_image(dmabuf_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+	if (image == EGL_NO_IMAGE_KHR) {
+		printf("GL Error: Failed to import dma-buf (0x%x)\n", eglGetError());
+		return 0;
+	}
+
+	if (slot->image != EGL_NO_IMAGE_KHR)
+		destroy_dmabuf_entry(slot);
+
+	slot->st_dev = st.st_dev;
+	slot->st_ino = st.st_ino;
+	slot->width = width;
+	slot->height = height;
+	slot->format = format;
+	slot->modifier = modifier;
+	slot->stride = stride;
+	slot->offset = offset;
+	slot->image = image;
+	slot->last_use = ++dmabuf_use_counter;
+
+	return dmabuf_texture(slot, acquire);
 }
 
+unsigned int importDmabuf(int fd, unsigned int width, unsigned int height, uint32_t format,
+		uint64_t modifier, uint32_t stride, uint32_t offset) {
+	return import_dmabuf(fd, width, height, format, modifier, stride, offset, 0);
+}
+
+unsigned int acquireDmabuf(int fd, unsigned int width, unsigned int height, uint32_t format,
+		uint64_t modifier, uint32_t stride, uint32_t offset) {
+	return import_dmabuf(fd, width, height, format, modifier, stride, offset, 1);
+}
+
+void releaseDmabuf(unsigned int texture) {
+	if (!texture)
+		return;
+
+	for (int i = 0; i < DMABUF_CACHE_SIZE; i++) {
+		struct dmabuf_entry *entry = &dmabuf_cache[i];
+		if (entry->acquired == texture) {
+			if (--entry->refs)
+				return;
+			// Keep the image while its importDmabuf() texture may still be sampled
+			glDeleteTextures(1, &entry->acquired);
+			entry->acquired = 0;
+			if (!entry->texture)
+				destroy_dmabuf_entry(entry);
+			return;
+		}
+		if (entry->texture == texture) {
+			glDeleteTextures(1, &entry->texture);
+			entry->texture = 0;
+			if (!entry->refs)
+				destroy_dmabuf_entry(entry);
+			return;
+		}
+	}
+}
+
+void freeDmabufCache() {
+	for (int i = 0; i < DMABUF_CACHE_SIZE; i++) {
+		if (dmabuf_cache[i].image != EGL_NO_IMAGE_KHR)
+			destroy_dmabuf_entry(&dmabuf_cache[i]);
+	}
+	dmabuf_display = EGL_NO_DISPLAY;
+}
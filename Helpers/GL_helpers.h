@@ -1,6 +1,8 @@
 #ifndef HELPERS_GL_HELPERS_H_
 #define HELPERS_GL_HELPERS_H_
 
+#include <stdint.h>
+
 #define RED 1.0f, 0.0f, 0.0f, 1.0f
 #define BLUE 0.0f, 0.0f, 1.0f, 1.0f
 #define GREEN  0.0f, 1.0f, 0.0f, 1.0f
@@ -19,4 +21,52 @@ unsigned int createProgram(const char *vertexSource, const char *fragmentSource)
 
 unsigned int createProgramFromFile(const char *vertexSourceFile, const char *fragmentSourceFile);
 
+// Called with the new program after a successful hot reload, e.g. to query the attribute
+// and uniform locations again.
+typedef void (*program_reload_cb)(unsigned int program);
+
+// Creates a program like createProgramFromFile and recompiles it whenever one of the files
+// changes on disk. Reloads run between frames within a time budget and only replace the
+// program if it links. Returns a watch id, -1 on failure.
+int watchProgramFromFile(const char *vertexSourceFile, const char *fragmentSourceFile, program_reload_cb cb);
+
+// Current program of a watch. Query it every frame, the handle changes after a reload.
+unsigned int getWatchedProgram(int id);
+
+// Stops watching and deletes the program.
+void unwatchProgram(int id);
+
+// Picks up file changes and advances reloads, spending at most about budget_us on
+// synchronous compiles. The renderer calls this once per frame.
+void processProgramReloads(unsigned int budget_us);
+
+// Unwatches every program. Called by the renderer before the EGL context goes away.
+void freeProgramWatches();
+
+// Imports a single plane dma-buf as an EGLImage bound to a GL_TEXTURE_EXTERNAL_OES texture
+// (sample it with samplerExternalOES). No pixel data is copied. Pass DRM_FORMAT_MOD_INVALID
+// as modifier for implicit layouts. Imports are cached per buffer inode, so importing the
+// same buffer again returns the same texture. Returns 0 on failure, also when all 64 cache
+// slots hold acquired imports.
+//
+// The cache evicts the least recently used import that isn't acquired when it needs a slot,
+// deleting its texture. A texture from importDmabuf() is only safe to use until the next
+// import, so import the buffer again in every frame that samples it.
+unsigned int importDmabuf(int fd, unsigned int width, unsigned int height, uint32_t format,
+		uint64_t modifier, uint32_t stride, uint32_t offset);
+
+// Like importDmabuf(), but the import is never evicted: the texture stays valid until it is
+// passed to releaseDmabuf(). Acquiring the same buffer twice returns the same texture and
+// needs two releases. It is never the texture importDmabuf() returns for that buffer.
+unsigned int acquireDmabuf(int fd, unsigned int width, unsigned int height, uint32_t format,
+		uint64_t modifier, uint32_t stride, uint32_t offset);
+
+// Drops one acquireDmabuf() reference, or deletes an importDmabuf() texture. The EGLImage
+// is deleted once neither texture is left, releasing an import never touches the references
+// held by acquireDmabuf() callers of the same buffer.
+void releaseDmabuf(unsigned int texture);
+
+// Drops every cached import. Called by the renderer before the EGL context goes away.
+void freeDmabufCache();
+
 #endif /* HELPERS_GL_HELPERS_H_ */
@@ -1,12 +1,18 @@
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <linux/input.h>
 #include <termios.h>
+#include <pthread.h>
 #include "Input_helpers.h"
+#include "Trace_helpers.h"
 
 // Store callbacks
 static key_event_cb g_key_cb = NULL;
@@ -16,7 +22,216 @@ static int kbd_fd = 0;
 static unsigned char mouse_data[3];
 static bool key_state[KEY_CNT] = {0};
 
-static int open_keyboard_device(void) {
+// Input recordings. A recording starts with a 5 byte header ("SDRI" and the format version),
+// followed by one record per event:
+//   varint frames since the previous event
+//   varint microseconds since the previous event
+//   u8 type, then for keys: u16 code (little endian), u8 value
+//                for mouse: u8 buttons, s8 dx, s8 dy
+// Frames are counted in process_inputs calls, so a replay can deliver every event on exactly
+// the frame it was recorded on.
+#define RECORDING_MAGIC "SDRI"
+#define RECORDING_VERSION 1
+
+enum recorded_event_type {
+    RECORDED_KEY = 0,
+    RECORDED_MOUSE = 1,
+};
+
+static uint64_t frame_counter = 0;
+
+static struct {
+    FILE *file;
+    uint64_t last_frame;
+    uint64_t last_us;
+    struct timespec start;
+} recorder;
+
+static struct {
+    unsigned char *data;
+    size_t size;
+    size_t pos;
+    float rate;
+    struct timespec start;
+    // Next event, decoded ahead of time
+    uint64_t frame;
+    uint64_t time_us;
+    bool pending;
+} replay;
+
+static uint64_t elapsed_us(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000 + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static void write_varint(FILE *f, uint64_t value) {
+    do {
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        fputc(byte | (value ? 0x80 : 0), f);
+    } while (value);
+}
+
+static bool read_varint(uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && replay.pos < replay.size; shift += 7) {
+        unsigned char byte = replay.data[replay.pos++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void record_event_header(enum recorded_event_type type) {
+    uint64_t now = elapsed_us(&recorder.start);
+    write_varint(recorder.file, frame_counter - recorder.last_frame);
+    write_varint(recorder.file, now - recorder.last_us);
+    fputc(type, recorder.file);
+    recorder.last_frame = frame_counter;
+    recorder.last_us = now;
+}
+
+static void record_key(int code, int value) {
+    if (!recorder.file)
+        return;
+
+    record_event_header(RECORDED_KEY);
+    fputc(code & 0xFF, recorder.file);
+    fputc((code >> 8) & 0xFF, recorder.file);
+    fputc(value, recorder.file);
+}
+
+static void record_mouse(const unsigned char packet[3]) {
+    if (!recorder.file)
+        return;
+
+    record_event_header(RECORDED_MOUSE);
+    fwrite(packet, 1, 3, recorder.file);
+}
+
+int start_input_recording(const char *path) {
+    if (recorder.file) {
+        printf("Input Handler Error: Already recording\n");
+        return 1;
+    }
+
+    recorder.file = fopen(path, "wb");
+    if (!recorder.file) {
+        printf("Input Handler Error: Failed to open %s\n", path);
+        return 1;
+    }
+    fwrite(RECORDING_MAGIC, 1, 4, recorder.file);
+    fputc(RECORDING_VERSION, recorder.file);
+
+    recorder.last_frame = frame_counter;
+    recorder.last_us = 0;
+    clock_gettime(CLOCK_MONOTONIC, &recorder.start);
+    return 0;
+}
+
+void stop_input_recording() {
+    if (recorder.file) {
+        fclose(recorder.file);
+        recorder.file = NULL;
+    }
+}
+
+// Decodes the frame and time of the next event, leaving pos at its type byte
+static void replay_next() {
+    uint64_t frames, us;
+    replay.pending = read_varint(&frames) && read_varint(&us) && replay.pos < replay.size;
+    if (replay.pending) {
+        replay.frame += frames;
+        replay.time_us += us;
+    }
+}
+
+int init_input_replay(const char *path, float rate, key_event_cb key_cb, mouse_event_cb mouse_cb) {
+    if(!key_cb && !mouse_cb){
+        printf("Input Handler Error: Both callback functions are NULL\n");
+        return 1;
+    }
+    if(g_key_cb || g_mouse_cb){
+        printf("Input Handler Error: Input handler already initialized\n");
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Input Handler Error: Failed to open %s\n", path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < 5) {
+        printf("Input Handler Error: Invalid recording %s\n", path);
+        close(fd);
+        return 1;
+    }
+    replay.size = st.st_size;
+    replay.data = mmap(NULL, replay.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (replay.data == MAP_FAILED) {
+        perror("mmap");
+        replay.data = NULL;
+        return 1;
+    }
+    if (memcmp(replay.data, RECORDING_MAGIC, 4) || replay.data[4] != RECORDING_VERSION) {
+        printf("Input Handler Error: %s is not a version %d recording\n", path, RECORDING_VERSION);
+        munmap(replay.data, replay.size);
+        replay.data = NULL;
+        return 1;
+    }
+
+    g_key_cb = key_cb;
+    g_mouse_cb = mouse_cb;
+
+    replay.pos = 5;
+    replay.rate = rate;
+    replay.frame = frame_counter;
+    replay.time_us = 0;
+    clock_gettime(CLOCK_MONOTONIC, &replay.start);
+    replay_next();
+    return 0;
+}
+
+static int process_replay() {
+    uint64_t now = replay.rate > 0 ? (uint64_t)(elapsed_us(&replay.start) * (double)replay.rate) : 0;
+
+    while (replay.pending && (replay.rate > 0 ? replay.time_us <= now : replay.frame <= frame_counter)) {
+        unsigned char type = replay.data[replay.pos++];
+        if (type == RECORDED_KEY && replay.pos + 3 <= replay.size) {
+            int code = replay.data[replay.pos] | (replay.data[replay.pos + 1] << 8);
+            if (code < KEY_CNT)
+                key_state[code] = replay.data[replay.pos + 2] != 0;
+            replay.pos += 3;
+        }
+        else if (type == RECORDED_MOUSE && replay.pos + 3 <= replay.size) {
+            const unsigned char *packet = &replay.data[replay.pos];
+            if (g_mouse_cb)
+                g_mouse_cb((signed char)packet[1], (signed char)packet[2],
+                        packet[0] & 0x1, (packet[0] & 0x2) >> 1, (packet[0] & 0x4) >> 2);
+            replay.pos += 3;
+        }
+        else {
+            printf("Input Handler Error: Corrupt recording at offset %zu\n", replay.pos);
+            replay.pending = false;
+            break;
+        }
+        replay_next();
+    }
+
+    if (g_key_cb && g_key_cb())
+        return 1;
+
+    // The recording is over, stop like the user would have
+    return !replay.pending;
+}
+
+// Finds the first keyboard's event device by its sysfs name. Returns 0 and the device path
+// on success.
+static int find_keyboard_device(char *dev_path, size_t size) {
     struct dirent *entry;
     DIR *dir = opendir("/dev/input");
     if (!dir) {
@@ -24,9 +239,9 @@ static int open_keyboard_device(void) {
         return -1;
     }
 
-    char path[256];
+    char path[300];
     char name[256];
-    int fd = -1;
+    int ret = -1;
 
     while ((entry = readdir(dir)) != NULL) {
         if (strncmp(entry->d_name, "event", 5) == 0) {
@@ -38,10 +253,9 @@ static int open_keyboard_device(void) {
                     name[strcspn(name, "\n")] = 0;
                     if (strstr(name, "Keyboard") || strstr(name, "keyboard")) {
                         // Found a keyboard device
-                        char dev_path[256];
-                        snprintf(dev_path, sizeof(dev_path), "/dev/input/%s", entry->d_name);
-                        fd = open(dev_path, O_RDONLY | O_NONBLOCK);
+                        snprintf(dev_path, size, "/dev/input/%s", entry->d_name);
                         fclose(f);
+                        ret = 0;
                         break;
                     }
                 }
@@ -51,7 +265,63 @@ static int open_keyboard_device(void) {
     }
 
     closedir(dir);
-    return fd;
+    return ret;
+}
+
+// The sysfs scan is slow compared to the rest of startup, so the renderer starts it on a
+// thread while it sets up GBM/EGL, and init_input_handler picks up the result.
+static struct {
+    pthread_t thread;
+    bool started;
+    bool done; // Joined, result and path are still to be picked up
+    int result;
+    char path[300];
+} keyboard_scan;
+
+static void *scan_keyboard_device(void *arg) {
+    (void)arg;
+    TRACE_THREAD_NAME("input scan");
+    TRACE_BEGIN("scan keyboard devices");
+    keyboard_scan.result = find_keyboard_device(keyboard_scan.path, sizeof(keyboard_scan.path));
+    TRACE_END();
+    return NULL;
+}
+
+void prefetch_input_devices() {
+    if (keyboard_scan.started)
+        return;
+
+    if (pthread_create(&keyboard_scan.thread, NULL, scan_keyboard_device, NULL) == 0)
+        keyboard_scan.started = true;
+}
+
+// Waits for the scan thread and keeps its result. The renderer calls it when it fails to
+// initialize or is freed, so the thread never outlives it.
+void finish_input_prefetch() {
+    if (keyboard_scan.started) {
+        pthread_join(keyboard_scan.thread, NULL);
+        keyboard_scan.started = false;
+        keyboard_scan.done = true;
+    }
+}
+
+static int open_keyboard_device(void) {
+    int ret;
+    char path[300];
+
+    finish_input_prefetch();
+    if (keyboard_scan.done) {
+        keyboard_scan.done = false;
+        ret = keyboard_scan.result;
+        memcpy(path, keyboard_scan.path, sizeof(path));
+    }
+    else {
+        ret = find_keyboard_device(path, sizeof(path));
+    }
+
+    if (ret)
+        return -1;
+    return open(path, O_RDONLY | O_NONBLOCK);
 }
 
 static void set_raw_mode(int enable) {
@@ -112,22 +382,37 @@ int init_input_handler(key_event_cb key_cb, mouse_event_cb mouse_cb) {
 int process_inputs() {
     int ret = 0;
 
+    frame_counter++;
+    if (replay.data)
+        return process_replay();
+
     // Keyboard events
     if (kbd_fd > 0) {
         struct input_event ev;
+        TRACE_BEGIN("evdev read");
         while (read(kbd_fd, &ev, sizeof(ev)) > 0) {
 			if (ev.type == EV_KEY && ev.code < KEY_CNT) {
 				key_state[ev.code] = (ev.value != 0); // press or hold = true, release = false
+				record_key(ev.code, ev.value);
+				TRACE_INSTANT("key event");
 			}
         }
-        if(g_key_cb())
+        TRACE_END();
+        TRACE_BEGIN("key callback");
+        int stop = g_key_cb();
+        TRACE_END();
+        if(stop)
         	ret = 1;
     }
 
     // Mouse events
     if (mouse_fd > 0) {
+        TRACE_BEGIN("mouse read");
         ssize_t m = read(mouse_fd, mouse_data, sizeof(mouse_data));
+        TRACE_END();
         if (m > 0) {
+            TRACE_INSTANT("mouse event");
+            record_mouse(mouse_data);
             int left = mouse_data[0] & 0x1;
             int right = (mouse_data[0] & 0x2) >> 1;
             int middle = (mouse_data[0] & 0x4) >> 2;
@@ -141,6 +426,16 @@ int process_inputs() {
 }
 
 void free_input_handler() {
+    finish_input_prefetch();
+    keyboard_scan.done = false;
+    stop_input_recording();
+    if (replay.data) {
+        munmap(replay.data, replay.size);
+        memset(&replay, 0, sizeof(replay));
+        memset(key_state, 0, sizeof(key_state));
+    }
+    g_key_cb = NULL;
+    g_mouse_cb = NULL;
     if(mouse_fd){
         close(mouse_fd);
         mouse_fd = 0;
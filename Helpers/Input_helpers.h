@@ -11,6 +11,19 @@ int init_input_handler(key_event_cb key_cb, mouse_event_cb mouse_cb);
 
 bool is_key_pressed(int key);
 
+// Records the key and mouse events the handler receives, with timestamps and frame numbers,
+// to a compact binary file until stop_input_recording or free_input_handler.
+int start_input_recording(const char *path);
+
+void stop_input_recording();
+
+// Initializes the input handler from a recording instead of the live devices. Events go
+// through is_key_pressed and the callbacks like live ones. rate scales the recorded timing
+// (1.0 is the original speed, 2.0 twice as fast); with rate 0 every event is delivered on
+// the frame it was recorded on, independent of the frame rate, for repeatable benchmarks.
+// Once the recording is exhausted the render loop stops.
+int init_input_replay(const char *path, float rate, key_event_cb key_cb, mouse_event_cb mouse_cb);
+
 void free_input_handler();
 
 #endif
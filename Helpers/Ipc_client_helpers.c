@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <drm/drm_fourcc.h>
+#include "Ipc_client_helpers.h"
+
+struct client_buffer {
+	int used;
+	int busy; // Submitted and not released yet
+	uint32_t *pixels;
+	size_t size;
+	unsigned int stride;
+};
+
+static struct {
+	int fd;
+	struct client_buffer buffers[IPC_MAX_BUFFERS];
+	int next; // Where ipc_acquire_buffer starts looking, so buffers are used in turn
+} client = { .fd = -1 };
+
+static int send_message(const struct ipc_message *msg, int fd) {
+	struct iovec iov = { (void *)msg, sizeof(*msg) };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr header = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+	if (fd >= 0) {
+		memset(control, 0, sizeof(control));
+		header.msg_control = control;
+		header.msg_controllen = sizeof(control);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+	}
+
+	if (sendmsg(client.fd, &header, MSG_NOSIGNAL) != sizeof(*msg)) {
+		printf("IPC Error: Failed to send to the server (%s)\n", strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+// Handles one message from the server, waiting up to timeout_ms. Returns -1 when the
+// connection is gone, 0 on timeout and 1 otherwise.
+static int read_message(int timeout_ms) {
+	struct pollfd pfd = { client.fd, POLLIN, 0 };
+	int ret = poll(&pfd, 1, timeout_ms);
+	if (ret <= 0)
+		return ret < 0 && errno != EINTR ? -1 : 0;
+
+	struct ipc_message msg;
+	ssize_t n = recv(client.fd, &msg, sizeof(msg), 0);
+	if (n != sizeof(msg))
+		return -1;
+
+	if (msg.type == IPC_RELEASE && msg.buffer < IPC_MAX_BUFFERS)
+		client.buffers[msg.buffer].busy = 0;
+	return 1;
+}
+
+static int free_slot() {
+	for (int i = 0; i < IPC_MAX_BUFFERS; i++) {
+		if (!client.buffers[i].used)
+			return i;
+	}
+	printf("IPC Error: No free buffer slot\n");
+	return -1;
+}
+
+int ipc_connect(const char *path) {
+	if (client.fd >= 0) {
+		printf("IPC Error: Already connected\n");
+		return 1;
+	}
+
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	if (!path || strlen(path) >= sizeof(address.sun_path)) {
+		printf("IPC Error: Invalid socket path\n");
+		return 1;
+	}
+	strcpy(address.sun_path, path);
+
+	client.fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (client.fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	if (connect(client.fd, (struct sockaddr *)&address, sizeof(address))) {
+		printf("IPC Error: Failed to connect to %s (%s)\n", path, strerror(errno));
+		close(client.fd);
+		client.fd = -1;
+		return 1;
+	}
+	return 0;
+}
+
+int ipc_create_buffer(unsigned int width, unsigned int height, uint32_t format) {
+	if (client.fd < 0) {
+		printf("IPC Error: Not connected\n");
+		return -1;
+	}
+	int id = free_slot();
+	if (id < 0)
+		return -1;
+
+	// Whole pages, so the server can wrap the memfd in a udmabuf
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = ((size_t)width * height * 4 + page - 1) / page * page;
+
+	int fd = memfd_create("ipc-buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		perror("memfd_create");
+		return -1;
+	}
+	if (ftruncate(fd, size) || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL)) {
+		perror("memfd");
+		close(fd);
+		return -1;
+	}
+
+	uint32_t *pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pixels == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return -1;
+	}
+
+	struct ipc_message msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = IPC_ADD_BUFFER;
+	msg.buffer = id;
+	msg.add.kind = IPC_BUFFER_MEMFD;
+	msg.add.width = width;
+	msg.add.height = height;
+	msg.add.stride = width * 4;
+	msg.add.format = format;
+	msg.add.modifier = DRM_FORMAT_MOD_LINEAR;
+	int ret = send_message(&msg, fd);
+	close(fd);
+	if (ret) {
+		munmap(pixels, size);
+		return -1;
+	}
+
+	struct client_buffer *buffer = &client.buffers[id];
+	memset(buffer, 0, sizeof(*buffer));
+	buffer->used = 1;
+	buffer->pixels = pixels;
+	buffer->size = size;
+	buffer->stride = width;
+	return id;
+}
+
+int ipc_add_dmabuf(int fd, unsigned int width, unsigned int height, uint32_t format, uint64_t modifier,
+		uint32_t stride, uint32_t offset) {
+	if (client.fd < 0) {
+		printf("IPC Error: Not connected\n");
+		return -1;
+	}
+	int id = free_slot();
+	if (id < 0)
+		return -1;
+
+	struct ipc_message msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = IPC_ADD_BUFFER;
+	msg.buffer = id;
+	msg.add.kind = IPC_BUFFER_DMABUF;
+	msg.add.width = width;
+	msg.add.height = height;
+	msg.add.stride = stride;
+	msg.add.offset = offset;
+	msg.add.format = format;
+	msg.add.modifier = modifier;
+	if (send_message(&msg, fd))
+		return -1;
+
+	memset(&client.buffers[id], 0, sizeof(struct client_buffer));
+	client.buffers[id].used = 1;
+	return id;
+}
+
+uint32_t *ipc_buffer_pixels(int buffer, unsigned int *stride) {
+	if (buffer < 0 || buffer >= IPC_MAX_BUFFERS || !client.buffers[buffer].used) {
+		printf("IPC Error: Invalid buffer\n");
+		return NULL;
+	}
+	if (stride)
+		*stride = client.buffers[buffer].stride;
+	return client.buffers[buffer].pixels;
+}
+
+int ipc_set_layer(int x, int y, int z) {
+	if (client.fd < 0) {
+		printf("IPC Error: Not connected\n");
+		return 1;
+	}
+
+	struct ipc_message msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = IPC_SET_LAYER;
+	msg.layer.x = x;
+	msg.layer.y = y;
+	msg.layer.z = z;
+	return send_message(&msg, -1);
+}
+
+int ipc_submit(int buffer, const struct ipc_rect *damage, unsigned int count) {
+	if (buffer < 0 || buffer >= IPC_MAX_BUFFERS || !client.buffers[buffer].used || client.fd < 0) {
+		printf("IPC Error: Invalid buffer\n");
+		return 1;
+	}
+
+	struct ipc_message msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = IPC_SUBMIT;
+	msg.buffer = buffer;
+	if (damage && count <= IPC_MAX_DAMAGE) {
+		msg.submit.damage_count = count;
+		memcpy(msg.submit.damage, damage, count * sizeof(*damage));
+	}
+	if (send_message(&msg, -1))
+		return 1;
+
+	client.buffers[buffer].busy = 1;
+	return 0;
+}
+
+int ipc_acquire_buffer(int timeout_ms) {
+	if (client.fd < 0) {
+		printf("IPC Error: Not connected\n");
+		return -1;
+	}
+
+	for (;;) {
+		// Take in every release already queued, then the buffer that was released first
+		while (read_message(0) > 0)
+			;
+		for (int i = 0; i < IPC_MAX_BUFFERS; i++) {
+			int id = (client.next + i) % IPC_MAX_BUFFERS;
+			if (client.buffers[id].used && !client.buffers[id].busy) {
+				client.next = id + 1;
+				return id;
+			}
+		}
+
+		int ret = read_message(timeout_ms);
+		if (ret < 0)
+			printf("IPC Error: Server disconnected\n");
+		if (ret <= 0)
+			return -1;
+	}
+}
+
+void ipc_remove_buffer(int buffer) {
+	if (buffer < 0 || buffer >= IPC_MAX_BUFFERS || !client.buffers[buffer].used) {
+		printf("IPC Error: Invalid buffer\n");
+		return;
+	}
+
+	if (client.fd >= 0) {
+		struct ipc_message msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.type = IPC_REMOVE_BUFFER;
+		msg.buffer = buffer;
+		send_message(&msg, -1);
+	}
+
+	struct client_buffer *b = &client.buffers[buffer];
+	if (b->pixels)
+		munmap(b->pixels, b->size);
+	memset(b, 0, sizeof(*b));
+}
+
+void ipc_disconnect() {
+	// The server drops the buffers of a closed connection itself
+	if (client.fd >= 0)
+		close(client.fd);
+	client.fd = -1;
+	client.next = 0;
+
+	for (int i = 0; i < IPC_MAX_BUFFERS; i++) {
+		if (client.buffers[i].used)
+			ipc_remove_buffer(i);
+	}
+}
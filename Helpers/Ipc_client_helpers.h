@@ -0,0 +1,48 @@
+#ifndef HELPERS_IPC_CLIENT_HELPERS_H_
+#define HELPERS_IPC_CLIENT_HELPERS_H_
+
+#include <stdint.h>
+#include "Ipc_helpers.h"
+
+// Client side of the frame submission protocol in Ipc_helpers.h, for processes that don't
+// render themselves. Needs no GL. A process has one connection.
+//
+//   ipc_connect("/run/renderer.sock");
+//   int buffers[2] = { ipc_create_buffer(w, h, DRM_FORMAT_XRGB8888), ... };
+//   for (;;) {
+//       int buffer = ipc_acquire_buffer(-1); // Waits until the server released one
+//       draw into ipc_buffer_pixels(buffer, &stride) ...
+//       ipc_submit(buffer, damage, damage_count);
+//   }
+
+int ipc_connect(const char *path);
+
+// Creates a sealed memfd buffer of XRGB8888 or ARGB8888 (not premultiplied) pixels and hands
+// it to the server. Returns a buffer id, -1 on failure.
+int ipc_create_buffer(unsigned int width, unsigned int height, uint32_t format);
+
+// Hands a single plane dma-buf to the server, which imports it with EGL. fd can be closed
+// afterwards. Returns a buffer id, -1 on failure.
+int ipc_add_dmabuf(int fd, unsigned int width, unsigned int height, uint32_t format, uint64_t modifier,
+		uint32_t stride, uint32_t offset);
+
+// Pixels of a memfd buffer, stride is in pixels. NULL for dma-bufs.
+uint32_t *ipc_buffer_pixels(int buffer, unsigned int *stride);
+
+// Position of the layer in screen pixels from the top left, higher z is drawn later
+int ipc_set_layer(int x, int y, int z);
+
+// Shows the buffer from the next frame on. damage lists what changed since the previous submit,
+// count 0 means everything. The buffer must not be drawn into until it is acquired again.
+int ipc_submit(int buffer, const struct ipc_rect *damage, unsigned int count);
+
+// Returns a buffer the server isn't using, waiting up to timeout_ms (-1 forever) for a
+// release. Returns -1 on timeout or when the server went away.
+int ipc_acquire_buffer(int timeout_ms);
+
+void ipc_remove_buffer(int buffer);
+
+// Closes the connection and frees every buffer
+void ipc_disconnect();
+
+#endif /* HELPERS_IPC_CLIENT_HELPERS_H_ */
@@ -0,0 +1,743 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/udmabuf.h>
+#include <drm/drm_fourcc.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include "Ipc_helpers.h"
+#include "Renderer_helpers.h"
+#include "GL_helpers.h"
+#include "Software_helpers.h"
+#include "Trace_helpers.h"
+
+// Largest buffer width or height accepted from a client
+#define MAX_BUFFER_SIZE 16384
+// Messages read from a client per frame. A client resubmitting every buffer it gets back as
+// dropped would otherwise keep the render thread in its loop.
+#define MAX_MESSAGES_PER_FRAME 64
+
+struct ipc_buffer {
+	int used;
+	enum ipc_buffer_type kind;
+	int fd;
+	int dmabuf;  // udmabuf wrapping a memfd, -1 if none
+	unsigned int width, height, stride, offset;
+	uint32_t format;
+	uint64_t modifier;
+	const uint8_t *map; // memfd mapping, NULL for dma-bufs
+	size_t map_size;
+	GLuint texture;     // Acquired dma-buf import, 0 if the buffer is uploaded
+};
+
+struct ipc_client {
+	int used;
+	int fd;
+	int pid;
+	int x, y, z;
+	struct ipc_buffer buffers[IPC_MAX_BUFFERS];
+
+	// Buffer ids, -1 for none. The retired buffer was replaced in this frame and is released
+	// once the frame is presented.
+	int pending, current, retired;
+
+	// Removed buffers the last frame may still read, destroyed once the next one is presented.
+	// Their ids are free again right away. Only the current and the retired buffer get here.
+	struct ipc_buffer removed[2];
+	unsigned int removed_count;
+
+	// Changes since the last frame that was uploaded
+	struct ipc_rect damage[IPC_MAX_DAMAGE];
+	unsigned int damage_count;
+	int full_damage;
+
+	// Upload path: the layer's copy of the client's last frame
+	GLuint texture;
+	unsigned int texture_width, texture_height;
+
+	unsigned long submitted, presented, dropped;
+	unsigned long long uploaded_bytes;
+};
+
+static struct {
+	int fd; // Listening socket, -1 when stopped
+	struct sockaddr_un address;
+	struct ipc_client clients[MAX_IPC_CLIENTS];
+	int udmabuf_fd;      // -2 not opened yet, -1 unavailable
+	int unpack_subimage; // 0 not checked, 1 supported, -1 unsupported
+
+	GLuint program, external_program;
+	GLint pos_attrib, uv_attrib, tex_uniform, size_uniform;
+	GLint external_pos_attrib, external_uv_attrib, external_tex_uniform, external_size_uniform;
+	int program_failed;
+} server = { .fd = -1, .udmabuf_fd = -2 };
+
+static int format_has_alpha(uint32_t format) {
+	return format == DRM_FORMAT_ARGB8888 || format == DRM_FORMAT_ABGR8888 ||
+			format == DRM_FORMAT_RGBA8888 || format == DRM_FORMAT_BGRA8888;
+}
+
+// Buffers that are drawn from where they are instead of from the layer texture
+static int samples_buffer(const struct ipc_buffer *buffer) {
+	return buffer->texture || renderer_is_software();
+}
+
+static int send_release(struct ipc_client *client, int id) {
+	struct ipc_message msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = IPC_RELEASE;
+	msg.buffer = id;
+	return send(client->fd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(msg);
+}
+
+static void destroy_buffer(struct ipc_buffer *buffer) {
+	if (buffer->texture)
+		releaseDmabuf(buffer->texture);
+	if (buffer->map)
+		munmap((void *)buffer->map, buffer->map_size);
+	if (buffer->dmabuf >= 0)
+		close(buffer->dmabuf);
+	close(buffer->fd);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+static void drop_client(struct ipc_client *client) {
+	for (int i = 0; i < IPC_MAX_BUFFERS; i++) {
+		if (client->buffers[i].used)
+			destroy_buffer(&client->buffers[i]);
+	}
+	for (unsigned int i = 0; i < client->removed_count; i++)
+		destroy_buffer(&client->removed[i]);
+	if (client->texture)
+		glDeleteTextures(1, &client->texture);
+	close(client->fd);
+	printf("IPC: Client %d disconnected\n", client->pid);
+	memset(client, 0, sizeof(*client));
+}
+
+// memfds are only read through the GPU when /dev/udmabuf can turn them into a dma-buf the
+// driver imports. The memfd has to cover whole pages from a page aligned offset.
+static void import_memfd(struct ipc_buffer *buffer, size_t file_size) {
+	if (server.udmabuf_fd == -2)
+		server.udmabuf_fd = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+	if (server.udmabuf_fd < 0)
+		return;
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t size = ((size_t)buffer->stride * buffer->height + page - 1) / page * page;
+	if (buffer->offset % page || buffer->offset + size > file_size)
+		return;
+
+	struct udmabuf_create create = {
+		.memfd = buffer->fd,
+		.flags = UDMABUF_FLAGS_CLOEXEC,
+		.offset = buffer->offset,
+		.size = size,
+	};
+	buffer->dmabuf = ioctl(server.udmabuf_fd, UDMABUF_CREATE, &create);
+	if (buffer->dmabuf < 0)
+		return;
+
+	buffer->texture = acquireDmabuf(buffer->dmabuf, buffer->width, buffer->height, buffer->format,
+			DRM_FORMAT_MOD_INVALID, buffer->stride, 0);
+	if (!buffer->texture) {
+		close(buffer->dmabuf);
+		buffer->dmabuf = -1;
+	}
+}
+
+static int add_buffer(struct ipc_client *client, const struct ipc_message *msg, int fd) {
+	struct ipc_buffer *buffer = &client->buffers[msg->buffer];
+	if (buffer->used) {
+		printf("IPC Error: Buffer %u of client %d already exists\n", msg->buffer, client->pid);
+		return 1;
+	}
+	if (fd < 0 || !msg->add.width || !msg->add.height || msg->add.width > MAX_BUFFER_SIZE ||
+			msg->add.height > MAX_BUFFER_SIZE || msg->add.stride < msg->add.width * 4 || msg->add.stride % 4) {
+		printf("IPC Error: Invalid buffer from client %d\n", client->pid);
+		return 1;
+	}
+
+	buffer->kind = msg->add.kind;
+	buffer->fd = fd;
+	buffer->dmabuf = -1;
+	buffer->width = msg->add.width;
+	buffer->height = msg->add.height;
+	buffer->stride = msg->add.stride;
+	buffer->offset = msg->add.offset;
+	buffer->format = msg->add.format;
+	buffer->modifier = msg->add.modifier;
+
+	if (buffer->kind == IPC_BUFFER_DMABUF) {
+		if (renderer_is_software()) {
+			printf("IPC Error: dma-buf layers need the GL renderer\n");
+			return 1;
+		}
+		buffer->texture = acquireDmabuf(fd, buffer->width, buffer->height, buffer->format, buffer->modifier,
+				buffer->stride, buffer->offset);
+		if (!buffer->texture)
+			return 1;
+		buffer->used = 1;
+		return 0;
+	}
+
+	if (buffer->kind != IPC_BUFFER_MEMFD ||
+			(buffer->format != DRM_FORMAT_XRGB8888 && buffer->format != DRM_FORMAT_ARGB8888)) {
+		printf("IPC Error: Client %d sent an unsupported buffer type or format\n", client->pid);
+		return 1;
+	}
+
+	// A client shrinking the file under the mapping would crash the server with SIGBUS. fcntl
+	// fails for files that aren't memfds, which can't be sealed.
+	struct stat st;
+	size_t size = (size_t)buffer->offset + (size_t)buffer->stride * buffer->height;
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) || (size_t)st.st_size < size) {
+		printf("IPC Error: memfd of client %d is not sealed against shrinking or too small\n", client->pid);
+		return 1;
+	}
+
+	buffer->map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (buffer->map == MAP_FAILED) {
+		perror("mmap");
+		buffer->map = NULL;
+		return 1;
+	}
+	buffer->map_size = size;
+	buffer->used = 1;
+
+	if (!renderer_is_software())
+		import_memfd(buffer, st.st_size);
+	return 0;
+}
+
+static void add_damage(struct ipc_client *client, const struct ipc_message *msg) {
+	if (!msg->submit.damage_count || msg->submit.damage_count > IPC_MAX_DAMAGE ||
+			client->damage_count + msg->submit.damage_count > IPC_MAX_DAMAGE) {
+		client->full_damage = 1;
+		return;
+	}
+	memcpy(&client->damage[client->damage_count], msg->submit.damage,
+			msg->submit.damage_count * sizeof(struct ipc_rect));
+	client->damage_count += msg->submit.damage_count;
+}
+
+// Returns 1 on a protocol error, the client is dropped then. fd is closed unless a buffer
+// keeps it.
+static int handle_message(struct ipc_client *client, const struct ipc_message *msg, int fd) {
+	if (msg->type != IPC_SET_LAYER && msg->buffer >= IPC_MAX_BUFFERS) {
+		printf("IPC Error: Invalid buffer id %u from client %d\n", msg->buffer, client->pid);
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+
+	if (msg->type == IPC_ADD_BUFFER) {
+		if (add_buffer(client, msg, fd)) {
+			if (fd >= 0)
+				close(fd);
+			return 1;
+		}
+		return 0;
+	}
+	if (fd >= 0)
+		close(fd);
+
+	struct ipc_buffer *buffer = msg->type == IPC_SET_LAYER ? NULL : &client->buffers[msg->buffer];
+	switch (msg->type) {
+	case IPC_SET_LAYER:
+		client->x = msg->layer.x;
+		client->y = msg->layer.y;
+		client->z = msg->layer.z;
+		return 0;
+
+	case IPC_REMOVE_BUFFER:
+		if (!buffer->used)
+			break;
+		if (client->pending == (int)msg->buffer)
+			client->pending = -1;
+		if (client->current == (int)msg->buffer || client->retired == (int)msg->buffer) {
+			if (client->current == (int)msg->buffer)
+				client->current = -1;
+			if (client->retired == (int)msg->buffer)
+				client->retired = -1;
+			client->removed[client->removed_count++] = *buffer;
+			memset(buffer, 0, sizeof(*buffer));
+		}
+		else {
+			destroy_buffer(buffer);
+		}
+		return 0;
+
+	case IPC_SUBMIT:
+		if (!buffer->used)
+			break;
+		client->submitted++;
+		if (client->pending >= 0 && client->pending != (int)msg->buffer) {
+			client->dropped++;
+			if (send_release(client, client->pending))
+				return 1;
+		}
+		client->pending = msg->buffer;
+		add_damage(client, msg);
+		return 0;
+	}
+
+	printf("IPC Error: Invalid message %u from client %d\n", msg->type, client->pid);
+	return 1;
+}
+
+// Reads what the client sent since the last frame. Returns 1 when it has to be dropped.
+static int receive_messages(struct ipc_client *client) {
+	for (int i = 0; i < MAX_MESSAGES_PER_FRAME; i++) {
+		struct ipc_message msg;
+		char control[CMSG_SPACE(sizeof(int))];
+		struct iovec iov = { &msg, sizeof(msg) };
+		struct msghdr header = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+
+		ssize_t n = recvmsg(client->fd, &header, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+		if (n < 0)
+			return errno != EAGAIN && errno != EWOULDBLOCK;
+		if (n == 0)
+			return 1;
+
+		int fd = -1;
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+		if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+		if (n != sizeof(msg) || (header.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+			printf("IPC Error: Malformed message from client %d\n", client->pid);
+			if (fd >= 0)
+				close(fd);
+			return 1;
+		}
+		if (handle_message(client, &msg, fd))
+			return 1;
+	}
+	return 0;
+}
+
+static void accept_clients() {
+	for (;;) {
+		int fd = accept4(server.fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+
+		struct ipc_client *client = NULL;
+		for (int i = 0; i < MAX_IPC_CLIENTS && !client; i++) {
+			if (!server.clients[i].used)
+				client = &server.clients[i];
+		}
+		if (!client) {
+			printf("IPC Error: Too many clients\n");
+			close(fd);
+			continue;
+		}
+
+		struct ucred credentials = { 0 };
+		socklen_t length = sizeof(credentials);
+		getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length);
+
+		memset(client, 0, sizeof(*client));
+		client->used = 1;
+		client->fd = fd;
+		client->pid = credentials.pid;
+		client->pending = client->current = client->retired = -1;
+		printf("IPC: Client %d connected\n", client->pid);
+	}
+}
+
+// Uploads a rectangle of the mapping. Without GL_EXT_unpack_subimage whole rows are uploaded.
+static void upload_rect(struct ipc_client *client, const struct ipc_buffer *buffer,
+		unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	const uint8_t *pixels = buffer->map + buffer->offset + (size_t)y * buffer->stride;
+
+	if (server.unpack_subimage > 0) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, buffer->stride / 4);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels + x * 4);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+		client->uploaded_bytes += (unsigned long long)width * height * 4;
+		return;
+	}
+
+	if (buffer->stride == buffer->width * 4) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, buffer->width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	}
+	else {
+		for (unsigned int row = 0; row < height; row++)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y + row, buffer->width, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+					pixels + (size_t)row * buffer->stride);
+	}
+	client->uploaded_bytes += (unsigned long long)buffer->width * height * 4;
+}
+
+// Copies the damage of a memfd into the layer texture, after which the buffer is free again
+static void upload_buffer(struct ipc_client *client, const struct ipc_buffer *buffer) {
+	if (!server.unpack_subimage) {
+		const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+		const char *version = (const char *)glGetString(GL_VERSION);
+		server.unpack_subimage = (extensions && strstr(extensions, "GL_EXT_unpack_subimage")) ||
+				(version && strncmp(version, "OpenGL ES 3", 11) == 0) ? 1 : -1;
+	}
+
+	if (!client->texture)
+		glGenTextures(1, &client->texture);
+	glBindTexture(GL_TEXTURE_2D, client->texture);
+
+	int full = client->full_damage;
+	if (client->texture_width != buffer->width || client->texture_height != buffer->height) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, buffer->width, buffer->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		client->texture_width = buffer->width;
+		client->texture_height = buffer->height;
+		full = 1;
+	}
+
+	if (full) {
+		upload_rect(client, buffer, 0, 0, buffer->width, buffer->height);
+	}
+	else {
+		for (unsigned int i = 0; i < client->damage_count; i++) {
+			const struct ipc_rect *rect = &client->damage[i];
+			int x0 = rect->x < 0 ? 0 : rect->x;
+			int y0 = rect->y < 0 ? 0 : rect->y;
+			long x1 = (long)rect->x + rect->width, y1 = (long)rect->y + rect->height;
+			if (x1 > (long)buffer->width)
+				x1 = buffer->width;
+			if (y1 > (long)buffer->height)
+				y1 = buffer->height;
+			if (x1 > x0 && y1 > y0)
+				upload_rect(client, buffer, x0, y0, x1 - x0, y1 - y0);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Makes the newest submit the client's frame
+static int latch_frame(struct ipc_client *client) {
+	int id = client->pending;
+	struct ipc_buffer *buffer = &client->buffers[id];
+	client->pending = -1;
+	client->presented++;
+
+	if (samples_buffer(buffer)) {
+		if (client->current >= 0 && client->current != id)
+			client->retired = client->current;
+		client->current = id;
+	}
+	else {
+		TRACE_BEGIN("ipc upload");
+		upload_buffer(client, buffer);
+		TRACE_END();
+		client->current = id;
+		if (send_release(client, id))
+			return 1;
+	}
+
+	client->damage_count = 0;
+	client->full_damage = 0;
+	return 0;
+}
+
+// Called by the renderer before draw()
+void process_ipc() {
+	if (server.fd < 0)
+		return;
+
+	TRACE_BEGIN("ipc");
+	accept_clients();
+	for (int i = 0; i < MAX_IPC_CLIENTS; i++) {
+		struct ipc_client *client = &server.clients[i];
+		if (!client->used)
+			continue;
+		if (receive_messages(client) || (client->pending >= 0 && latch_frame(client)))
+			drop_client(client);
+	}
+	TRACE_END();
+}
+
+static int init_layer_programs() {
+	const char *vertex_shader =
+		"attribute vec2 a_Position;"
+		"attribute vec2 a_TexCoord;"
+		"uniform vec2 u_Screen;"
+		"varying vec2 v_TexCoord;"
+		"void main() {"
+		"    v_TexCoord = a_TexCoord;"
+		"    gl_Position = vec4(a_Position.x / u_Screen.x * 2.0 - 1.0, 1.0 - a_Position.y / u_Screen.y * 2.0, 0.0, 1.0);"
+		"}";
+
+	// Uploaded XRGB8888/ARGB8888 bytes are B, G, R, A in memory
+	const char *fragment_shader =
+		"precision mediump float;"
+		"uniform sampler2D u_Texture;"
+		"varying vec2 v_TexCoord;"
+		"void main() { gl_FragColor = texture2D(u_Texture, v_TexCoord).bgra; }";
+
+	const char *external_fragment_shader =
+		"#extension GL_OES_EGL_image_external : require\n"
+		"precision mediump float;"
+		"uniform samplerExternalOES u_Texture;"
+		"varying vec2 v_TexCoord;"
+		"void main() { gl_FragColor = texture2D(u_Texture, v_TexCoord); }";
+
+	server.program = createProgram(vertex_shader, fragment_shader);
+	server.external_program = createProgram(vertex_shader, external_fragment_shader);
+	if (!server.program) {
+		printf("IPC Error: Failed to create the layer program\n");
+		return 1;
+	}
+
+	server.pos_attrib = glGetAttribLocation(server.program, "a_Position");
+	server.uv_attrib = glGetAttribLocation(server.program, "a_TexCoord");
+	server.tex_uniform = glGetUniformLocation(server.program, "u_Texture");
+	server.size_uniform = glGetUniformLocation(server.program, "u_Screen");
+	if (server.external_program) {
+		server.external_pos_attrib = glGetAttribLocation(server.external_program, "a_Position");
+		server.external_uv_attrib = glGetAttribLocation(server.external_program, "a_TexCoord");
+		server.external_tex_uniform = glGetUniformLocation(server.external_program, "u_Texture");
+		server.external_size_uniform = glGetUniformLocation(server.external_program, "u_Screen");
+	}
+	return 0;
+}
+
+static void draw_layer_gl(const struct ipc_client *client, const struct ipc_buffer *buffer) {
+	int external = buffer->texture != 0;
+	if (external && !server.external_program)
+		return;
+
+	GLuint program = external ? server.external_program : server.program;
+	GLint pos_attrib = external ? server.external_pos_attrib : server.pos_attrib;
+	GLint uv_attrib = external ? server.external_uv_attrib : server.uv_attrib;
+	GLenum target = external ? GL_TEXTURE_EXTERNAL_OES : GL_TEXTURE_2D;
+
+	// Buffer rows start at the top like the quad's
+	float x = client->x, y = client->y;
+	const float quad[] = {
+		x, y, 0.0f, 0.0f,
+		x + buffer->width, y, 1.0f, 0.0f,
+		x, y + buffer->height, 0.0f, 1.0f,
+		x + buffer->width, y + buffer->height, 1.0f, 1.0f,
+	};
+
+	glUseProgram(program);
+	glUniform2f(external ? server.external_size_uniform : server.size_uniform,
+			renderer_get_width(), renderer_get_height());
+	glUniform1i(external ? server.external_tex_uniform : server.tex_uniform, 0);
+	glBindTexture(target, external ? buffer->texture : client->texture);
+
+	if (format_has_alpha(buffer->format)) {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	glVertexAttribPointer(pos_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), quad);
+	glEnableVertexAttribArray(pos_attrib);
+	glVertexAttribPointer(uv_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), quad + 2);
+	glEnableVertexAttribArray(uv_attrib);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glDisableVertexAttribArray(pos_attrib);
+	glDisableVertexAttribArray(uv_attrib);
+	glDisable(GL_BLEND);
+	glBindTexture(target, 0);
+}
+
+static void draw_layer_software(const struct ipc_client *client, const struct ipc_buffer *buffer) {
+	struct sw_canvas *canvas = renderer_get_canvas();
+	const uint32_t *pixels = (const uint32_t *)(buffer->map + buffer->offset);
+	if (format_has_alpha(buffer->format))
+		sw_blend(canvas, client->x, client->y, pixels, buffer->width, buffer->height, buffer->stride / 4);
+	else
+		sw_blit(canvas, client->x, client->y, pixels, buffer->width, buffer->height, buffer->stride / 4);
+}
+
+// Called by the renderer after draw(): the layers go over the application's frame, lowest z first
+void draw_ipc_layers() {
+	if (server.fd < 0)
+		return;
+
+	int order[MAX_IPC_CLIENTS];
+	unsigned int count = 0;
+	for (int i = 0; i < MAX_IPC_CLIENTS; i++) {
+		const struct ipc_client *client = &server.clients[i];
+		if (!client->used || client->current < 0)
+			continue;
+
+		unsigned int j = count++;
+		for (; j > 0 && server.clients[order[j - 1]].z > client->z; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+	if (!count)
+		return;
+
+	TRACE_BEGIN("ipc layers");
+	int software = renderer_is_software();
+	GLboolean depth_test = GL_FALSE, scissor_test = GL_FALSE;
+	if (!software) {
+		if (!server.program && !server.program_failed && init_layer_programs())
+			server.program_failed = 1;
+		if (server.program_failed) {
+			TRACE_END();
+			return;
+		}
+
+		depth_test = glIsEnabled(GL_DEPTH_TEST);
+		scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_SCISSOR_TEST);
+		glViewport(0, 0, renderer_get_width(), renderer_get_height());
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		const struct ipc_client *client = &server.clients[order[i]];
+		const struct ipc_buffer *buffer = &client->buffers[client->current];
+		if (software)
+			draw_layer_software(client, buffer);
+		else
+			draw_layer_gl(client, buffer);
+	}
+
+	if (!software) {
+		glUseProgram(0);
+		if (depth_test)
+			glEnable(GL_DEPTH_TEST);
+		if (scissor_test)
+			glEnable(GL_SCISSOR_TEST);
+	}
+	TRACE_END();
+}
+
+// Called by the renderer after the swap. The GPU has finished the frames that read the
+// buffers replaced in this one, so they go back to their clients.
+void ipc_frame_end() {
+	if (server.fd < 0)
+		return;
+
+	for (int i = 0; i < MAX_IPC_CLIENTS; i++) {
+		struct ipc_client *client = &server.clients[i];
+		if (!client->used)
+			continue;
+
+		int failed = 0;
+		if (client->retired >= 0) {
+			failed = send_release(client, client->retired);
+			client->retired = -1;
+		}
+		for (unsigned int j = 0; j < client->removed_count; j++)
+			destroy_buffer(&client->removed[j]);
+		client->removed_count = 0;
+		if (failed)
+			drop_client(client);
+	}
+}
+
+int ipc_server_start(const char *path) {
+	if (server.fd >= 0) {
+		printf("IPC Error: Server is already running\n");
+		return 1;
+	}
+	if (!path || strlen(path) >= sizeof(server.address.sun_path)) {
+		printf("IPC Error: Invalid socket path\n");
+		return 1;
+	}
+
+	server.fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (server.fd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	memset(&server.address, 0, sizeof(server.address));
+	server.address.sun_family = AF_UNIX;
+	strcpy(server.address.sun_path, path);
+	unlink(path);
+	if (bind(server.fd, (struct sockaddr *)&server.address, sizeof(server.address)) ||
+			listen(server.fd, MAX_IPC_CLIENTS)) {
+		printf("IPC Error: Failed to listen on %s (%s)\n", path, strerror(errno));
+		close(server.fd);
+		server.fd = -1;
+		return 1;
+	}
+
+	printf("IPC: Listening on %s\n", path);
+	return 0;
+}
+
+void ipc_server_stop() {
+	if (server.fd < 0)
+		return;
+
+	for (int i = 0; i < MAX_IPC_CLIENTS; i++) {
+		if (server.clients[i].used)
+			drop_client(&server.clients[i]);
+	}
+	if (server.program)
+		glDeleteProgram(server.program);
+	if (server.external_program)
+		glDeleteProgram(server.external_program);
+	if (server.udmabuf_fd >= 0)
+		close(server.udmabuf_fd);
+
+	close(server.fd);
+	unlink(server.address.sun_path);
+	memset(&server, 0, sizeof(server));
+	server.fd = -1;
+	server.udmabuf_fd = -2;
+}
+
+// Called by the renderer before the EGL context goes away.
+void free_ipc_server() {
+	ipc_server_stop();
+}
+
+unsigned int ipc_client_count() {
+	unsigned int count = 0;
+	for (int i = 0; i < MAX_IPC_CLIENTS; i++)
+		count += server.clients[i].used;
+	return count;
+}
+
+int ipc_client_stats(unsigned int index, struct ipc_client_stats *stats) {
+	if (index >= MAX_IPC_CLIENTS || !server.clients[index].used)
+		return 1;
+
+	const struct ipc_client *client = &server.clients[index];
+	memset(stats, 0, sizeof(*stats));
+	stats->pid = client->pid;
+	stats->x = client->x;
+	stats->y = client->y;
+	stats->z = client->z;
+	if (client->current >= 0) {
+		const struct ipc_buffer *buffer = &client->buffers[client->current];
+		stats->width = buffer->width;
+		stats->height = buffer->height;
+		stats->zero_copy = buffer->texture != 0;
+	}
+	stats->submitted = client->submitted;
+	stats->presented = client->presented;
+	stats->dropped = client->dropped;
+	stats->uploaded_bytes = client->uploaded_bytes;
+	return 0;
+}
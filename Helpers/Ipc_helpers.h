@@ -0,0 +1,87 @@
+#ifndef HELPERS_IPC_HELPERS_H_
+#define HELPERS_IPC_HELPERS_H_
+
+#include <stdint.h>
+
+// Frame submission from other processes. The server listens on a Unix socket; clients pass
+// their buffers once as file descriptors (a sealed memfd or a dma-buf), then submit frames by
+// buffer id with the rectangles that changed. Every connected client is a layer the renderer
+// draws over the application's frame, in z order, at its position in screen pixels.
+//
+// Nothing is copied on the CPU. dma-bufs are sampled by the GPU where they are, and so are
+// memfds when /dev/udmabuf can wrap them in a dma-buf. Otherwise a memfd is mapped and only
+// its damage rectangles are uploaded straight from the mapping; the software renderer blits
+// layers from the mappings.
+//
+// A submitted buffer is the client's again once the server sends IPC_RELEASE for it: right
+// after the upload, or once a newer frame replaced it and the GPU stopped reading it.
+
+#define MAX_IPC_CLIENTS 8
+#define IPC_MAX_BUFFERS 4 // Per client
+#define IPC_MAX_DAMAGE 16 // Rectangles per submit, more is sent as a full damage
+
+// Wire protocol, one struct ipc_message per SOCK_SEQPACKET packet
+
+enum ipc_message_type {
+	IPC_ADD_BUFFER = 1, // Client, the buffer's fd is passed with SCM_RIGHTS
+	IPC_REMOVE_BUFFER,  // Client
+	IPC_SET_LAYER,      // Client, position and z order
+	IPC_SUBMIT,         // Client, shows the buffer from the next frame on
+	IPC_RELEASE,        // Server, the client may draw into the buffer again
+};
+
+enum ipc_buffer_type {
+	IPC_BUFFER_MEMFD,  // Must be sealed with F_SEAL_SHRINK; XRGB8888 or ARGB8888
+	IPC_BUFFER_DMABUF, // Any single plane format and modifier EGL can import, GL only
+};
+
+struct ipc_rect {
+	int32_t x, y, width, height;
+};
+
+struct ipc_message {
+	uint32_t type;
+	uint32_t buffer; // Client chosen id below IPC_MAX_BUFFERS
+	union {
+		struct {
+			uint32_t kind; // enum ipc_buffer_type
+			uint32_t width, height, stride, offset;
+			uint32_t format; // DRM fourcc
+			uint64_t modifier;
+		} add;
+		struct {
+			int32_t x, y, z;
+		} layer;
+		struct {
+			uint32_t damage_count; // 0 damages the whole buffer
+			struct ipc_rect damage[IPC_MAX_DAMAGE];
+		} submit;
+	};
+};
+
+// Server
+
+struct ipc_client_stats {
+	int pid;
+	int x, y, z;
+	unsigned int width, height; // Of the buffer on screen, 0 before the first frame
+	int zero_copy;              // Sampled from the client's buffer, not an uploaded copy
+	unsigned long submitted;
+	unsigned long presented;    // Submits that made it into a frame
+	unsigned long dropped;      // Replaced by a newer submit before the next frame
+	unsigned long long uploaded_bytes;
+};
+
+// Starts listening on path, replacing a stale socket file. Clients are served between frames
+// on the render thread. Returns 1 on failure.
+int ipc_server_start(const char *path);
+
+// Disconnects every client and removes the socket. free_renderer() calls it too.
+void ipc_server_stop();
+
+unsigned int ipc_client_count();
+
+// Stats of the client in slot index (below MAX_IPC_CLIENTS). Returns 1 if the slot is empty.
+int ipc_client_stats(unsigned int index, struct ipc_client_stats *stats);
+
+#endif /* HELPERS_IPC_HELPERS_H_ */
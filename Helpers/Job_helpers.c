@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "Job_helpers.h"
+#include "Trace_helpers.h"
+
+#define MAX_THREADS 64
+#define DEQUE_SIZE 1024
+
+struct job {
+	job_func func;
+	void *data;
+	unsigned int grain;
+	unsigned int remaining; // Items not run yet, atomic
+	int done;               // Atomic
+	unsigned int pending_deps;
+	int first_edge;         // Jobs waiting for this one, -1 terminated list in edges
+};
+
+// Dependency edge, "dependent" runs after the job whose list it is in
+struct edge {
+	unsigned int dependent;
+	int next;
+};
+
+struct task {
+	struct job *job;
+	unsigned int begin, end;
+};
+
+// Owner pushes and pops at the bottom, thieves take the oldest (largest) ranges from the top
+struct deque {
+	pthread_mutex_t lock;
+	unsigned int top, bottom;
+	struct task tasks[DEQUE_SIZE];
+} __attribute__((aligned(64)));
+
+static struct {
+	int initialized;
+	unsigned int thread_count; // Workers + the thread that called init_jobs
+	pthread_t threads[MAX_THREADS];
+	struct deque deques[MAX_THREADS];
+
+	// Frame scoped job graph
+	pthread_mutex_t graph_lock;
+	struct job jobs[MAX_FRAME_JOBS];
+	unsigned int job_count;
+	struct edge edges[MAX_FRAME_JOBS * MAX_JOB_DEPENDENCIES];
+	unsigned int edge_count;
+
+	// Idle workers sleep until something is queued
+	pthread_mutex_t sleep_lock;
+	pthread_cond_t wake;
+	unsigned int queued;
+	unsigned int sleepers;
+	int quit;
+} pool = { .graph_lock = PTHREAD_MUTEX_INITIALIZER, .sleep_lock = PTHREAD_MUTEX_INITIALIZER,
+		.wake = PTHREAD_COND_INITIALIZER };
+
+// Deque of the current thread, threads that aren't workers share deque 0
+static __thread unsigned int thread_index;
+
+static int push_task(struct deque *d, struct job *job, unsigned int begin, unsigned int end) {
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom - d->top == DEQUE_SIZE) {
+		pthread_mutex_unlock(&d->lock);
+		return 1;
+	}
+	d->tasks[d->bottom % DEQUE_SIZE] = (struct task){ job, begin, end };
+	d->bottom++;
+	pthread_mutex_unlock(&d->lock);
+
+	__atomic_add_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool.sleepers, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&pool.sleep_lock);
+		pthread_cond_signal(&pool.wake);
+		pthread_mutex_unlock(&pool.sleep_lock);
+	}
+	return 0;
+}
+
+static int pop_task(struct deque *d, struct task *task) {
+	pthread_mutex_lock(&d->lock);
+	int found = d->bottom != d->top;
+	if (found)
+		*task = d->tasks[--d->bottom % DEQUE_SIZE];
+	pthread_mutex_unlock(&d->lock);
+
+	if (found)
+		__atomic_sub_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+	return found;
+}
+
+static int steal_task(struct deque *d, struct task *task) {
+	pthread_mutex_lock(&d->lock);
+	int found = d->bottom != d->top;
+	if (found)
+		*task = d->tasks[d->top++ % DEQUE_SIZE];
+	pthread_mutex_unlock(&d->lock);
+
+	if (found)
+		__atomic_sub_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+	return found;
+}
+
+static void run_task(struct task task);
+
+static void schedule(struct job *job, unsigned int count) {
+	struct deque *d = &pool.deques[thread_index];
+	if (push_task(d, job, 0, count))
+		run_task((struct task){ job, 0, count }); // Deque full, run it here
+}
+
+static void complete(struct job *job);
+
+static void run_task(struct task task) {
+	struct job *job = task.job;
+	struct deque *d = &pool.deques[thread_index];
+
+	// Split off the upper halves for thieves until the range is down to the grain size
+	while (task.end - task.begin > job->grain) {
+		unsigned int mid = task.begin + (task.end - task.begin) / 2;
+		if (push_task(d, job, mid, task.end))
+			break;
+		task.end = mid;
+	}
+
+	if (task.end > task.begin) {
+		TRACE_BEGIN("job");
+		job->func(job->data, task.begin, task.end);
+		TRACE_END();
+	}
+
+	// An empty job is a single empty task, so it completes exactly once too
+	if (__atomic_sub_fetch(&job->remaining, task.end - task.begin, __ATOMIC_ACQ_REL) == 0)
+		complete(job);
+}
+
+// Marks the job done and schedules dependents that have nothing else to wait for
+static void complete(struct job *job) {
+	struct job *ready[MAX_FRAME_JOBS];
+	unsigned int ready_count = 0;
+
+	pthread_mutex_lock(&pool.graph_lock);
+	__atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+	for (int e = job->first_edge; e >= 0; e = pool.edges[e].next) {
+		struct job *dependent = &pool.jobs[pool.edges[e].dependent];
+		if (--dependent->pending_deps == 0)
+			ready[ready_count++] = dependent;
+	}
+	pthread_mutex_unlock(&pool.graph_lock);
+
+	for (unsigned int i = 0; i < ready_count; i++)
+		schedule(ready[i], __atomic_load_n(&ready[i]->remaining, __ATOMIC_RELAXED));
+}
+
+// Runs one queued task from this thread's deque or stolen from another, 0 if there was none
+static int run_one() {
+	struct task task;
+	if (pop_task(&pool.deques[thread_index], &task)) {
+		run_task(task);
+		return 1;
+	}
+
+	for (unsigned int i = 1; i < pool.thread_count; i++) {
+		unsigned int victim = (thread_index + i) % pool.thread_count;
+		if (steal_task(&pool.deques[victim], &task)) {
+			run_task(task);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void *worker(void *arg) {
+	thread_index = (unsigned int)(uintptr_t)arg;
+	TRACE_THREAD_NAME("job worker");
+
+	while (!__atomic_load_n(&pool.quit, __ATOMIC_ACQUIRE)) {
+		if (run_one())
+			continue;
+
+		pthread_mutex_lock(&pool.sleep_lock);
+		__atomic_add_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+		while (!__atomic_load_n(&pool.queued, __ATOMIC_SEQ_CST) && !pool.quit)
+			pthread_cond_wait(&pool.wake, &pool.sleep_lock);
+		__atomic_sub_fetch(&pool.sleepers, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&pool.sleep_lock);
+	}
+	return NULL;
+}
+
+int init_jobs(unsigned int threads) {
+	if (pool.initialized) {
+		printf("Job Error: Job system have already initialized\n");
+		return 1;
+	}
+
+	if (!threads) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 1 ? cores : 1;
+	}
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+	unsigned int workers = threads - 1;
+
+	for (unsigned int i = 0; i <= workers; i++) {
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+		pool.deques[i].top = pool.deques[i].bottom = 0;
+	}
+	pool.quit = 0;
+	pool.job_count = 0;
+	pool.edge_count = 0;
+	pool.thread_count = 1;
+	thread_index = 0;
+
+	for (unsigned int i = 1; i <= workers; i++) {
+		if (pthread_create(&pool.threads[i], NULL, worker, (void *)(uintptr_t)i)) {
+			printf("Job Error: Failed to start worker %u\n", i);
+			break;
+		}
+		pool.thread_count++;
+	}
+
+	pool.initialized = 1;
+	return 0;
+}
+
+job_t job_parallel_for(job_func func, void *data, unsigned int count, unsigned int grain,
+		const job_t *deps, unsigned int dep_count) {
+	if (!pool.initialized) {
+		printf("Job Error: Job system haven't been initialized\n");
+		return 0;
+	}
+	if (dep_count > MAX_JOB_DEPENDENCIES) {
+		printf("Job Error: Too many dependencies\n");
+		return 0;
+	}
+
+	pthread_mutex_lock(&pool.graph_lock);
+	if (pool.job_count == MAX_FRAME_JOBS) {
+		pthread_mutex_unlock(&pool.graph_lock);
+		printf("Job Error: More than %d jobs in a frame\n", MAX_FRAME_JOBS);
+		return 0;
+	}
+
+	unsigned int index = pool.job_count++;
+	struct job *job = &pool.jobs[index];
+	job->func = func;
+	job->data = data;
+	job->grain = grain ? grain : 1;
+	job->remaining = count;
+	job->done = 0;
+	job->pending_deps = 0;
+	job->first_edge = -1;
+
+	for (unsigned int i = 0; i < dep_count; i++) {
+		if (!deps[i] || deps[i] > index) // Only earlier jobs of this frame
+			continue;
+		struct job *dep = &pool.jobs[deps[i] - 1];
+		if (__atomic_load_n(&dep->done, __ATOMIC_ACQUIRE))
+			continue;
+
+		struct edge *edge = &pool.edges[pool.edge_count];
+		edge->dependent = index;
+		edge->next = dep->first_edge;
+		dep->first_edge = pool.edge_count++;
+		job->pending_deps++;
+	}
+
+	int ready = job->pending_deps == 0;
+	pthread_mutex_unlock(&pool.graph_lock);
+
+	if (ready)
+		schedule(job, count);
+	return index + 1;
+}
+
+void job_wait(job_t handle) {
+	if (!pool.initialized || !handle || handle > pool.job_count)
+		return;
+
+	struct job *job = &pool.jobs[handle - 1];
+	while (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE)) {
+		if (!run_one())
+			sched_yield();
+	}
+}
+
+void job_wait_frame() {
+	if (!pool.initialized)
+		return;
+
+	for (unsigned int i = 0; i < pool.job_count; i++)
+		job_wait(i + 1);
+
+	pthread_mutex_lock(&pool.graph_lock);
+	pool.job_count = 0;
+	pool.edge_count = 0;
+	pthread_mutex_unlock(&pool.graph_lock);
+}
+
+unsigned int job_thread_count() {
+	return pool.initialized ? pool.thread_count : 1;
+}
+
+void free_jobs() {
+	if (!pool.initialized)
+		return;
+
+	job_wait_frame();
+
+	pthread_mutex_lock(&pool.sleep_lock);
+	__atomic_store_n(&pool.quit, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.sleep_lock);
+
+	for (unsigned int i = 1; i < pool.thread_count; i++)
+		pthread_join(pool.threads[i], NULL);
+	for (unsigned int i = 0; i < pool.thread_count; i++)
+		pthread_mutex_destroy(&pool.deques[i].lock);
+
+	pool.thread_count = 0;
+	pool.initialized = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef HELPERS_JOB_HELPERS_H_
+#define HELPERS_JOB_HELPERS_H_
+
+// Work-stealing thread pool for CPU side scene updates. A job is a parallel-for over
+// [0, count): each worker splits the range it runs in halves down to the grain size and other
+// workers steal the larger halves, so uneven work balances itself.
+//
+// Jobs are frame scoped. Handles are only valid until the end of the frame they were
+// submitted in: the renderer waits for every job after the swap, before the frame arena is
+// reset, so jobs may write straight into frame_alloc() memory (e.g. vertex data) that the
+// draw function passes to GL after job_wait().
+
+typedef unsigned int job_t; // 0 is no job
+
+// Called with a sub-range of the job's range
+typedef void (*job_func)(void *data, unsigned int begin, unsigned int end);
+
+// Most jobs submitted in one frame and most dependencies of one job
+#define MAX_FRAME_JOBS 256
+#define MAX_JOB_DEPENDENCIES 4
+
+// Starts the pool with threads threads (0 is one per core), counting the calling thread, which
+// runs jobs while it waits. Returns 1 on error.
+int init_jobs(unsigned int threads);
+
+// Runs func over [0, count) in pieces of at least grain items once all deps have finished.
+// Returns 0 (and runs nothing) if the frame's job limit is reached.
+job_t job_parallel_for(job_func func, void *data, unsigned int count, unsigned int grain,
+		const job_t *deps, unsigned int dep_count);
+
+// Waits for a job, running queued work meanwhile.
+void job_wait(job_t job);
+
+// Waits for every job of the frame and recycles the handles. Called by the renderer.
+void job_wait_frame();
+
+// Number of threads running jobs, including the calling thread.
+unsigned int job_thread_count();
+
+void free_jobs();
+
+#endif /* HELPERS_JOB_HELPERS_H_ */
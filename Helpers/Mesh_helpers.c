@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include "Mesh_helpers.h"
+
+// Changed instances of one instance array, as a few disjoint ranges each uploaded on its own.
+// Changes closer than DIRTY_MERGE_GAP instances to a range join it: re-uploading a few clean
+// instances is cheaper than another glBufferSubData.
+#define MAX_DIRTY_RANGES 4
+#define DIRTY_MERGE_GAP 64
+
+struct dirty_range {
+	unsigned int begin, end;
+};
+
+struct dirty_ranges {
+	unsigned int count;
+	struct dirty_range ranges[MAX_DIRTY_RANGES];
+};
+
+struct mesh {
+	int used;
+	GLuint vertex_buffer;
+	GLuint instance_buffer;
+	unsigned int vertex_count;
+	unsigned int components;
+	unsigned int max_instances;
+	unsigned int instance_count;
+
+	// SoA instance data, laid out the same way in instance_buffer
+	float *offsets;          // x, y
+	float *scale_rotations;  // scale, rotation
+	unsigned char *colors;   // r, g, b, a
+	struct dirty_ranges dirty_offsets, dirty_scale_rotations, dirty_colors;
+};
+
+static struct mesh meshes[MAX_MESHES];
+
+static PFNGLDRAWARRAYSINSTANCEDEXTPROC draw_arrays_instanced;
+static PFNGLVERTEXATTRIBDIVISOREXTPROC vertex_attrib_divisor;
+static int instancing = 0; // 0 not checked, 1 available, -1 unsupported
+
+struct mesh_attribs {
+	GLint position, offset, scale_rotation, color;
+};
+
+static int init_instancing() {
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	const char *version = (const char *)glGetString(GL_VERSION);
+	instancing = -1;
+
+	if (extensions && strstr(extensions, "GL_EXT_instanced_arrays")) {
+		draw_arrays_instanced = (PFNGLDRAWARRAYSINSTANCEDEXTPROC)eglGetProcAddress("glDrawArraysInstancedEXT");
+		vertex_attrib_divisor = (PFNGLVERTEXATTRIBDIVISOREXTPROC)eglGetProcAddress("glVertexAttribDivisorEXT");
+	} else if (extensions && strstr(extensions, "GL_ANGLE_instanced_arrays")) {
+		draw_arrays_instanced = (PFNGLDRAWARRAYSINSTANCEDEXTPROC)eglGetProcAddress("glDrawArraysInstancedANGLE");
+		vertex_attrib_divisor = (PFNGLVERTEXATTRIBDIVISOREXTPROC)eglGetProcAddress("glVertexAttribDivisorANGLE");
+	} else if (version && strncmp(version, "OpenGL ES 3", 11) == 0) {
+		// Core in GLES 3, drivers hand out a 3.x context for a 2.0 request
+		draw_arrays_instanced = (PFNGLDRAWARRAYSINSTANCEDEXTPROC)eglGetProcAddress("glDrawArraysInstanced");
+		vertex_attrib_divisor = (PFNGLVERTEXATTRIBDIVISOREXTPROC)eglGetProcAddress("glVertexAttribDivisor");
+	}
+
+	if (draw_arrays_instanced && vertex_attrib_divisor)
+		instancing = 1;
+	else
+		printf("Mesh: No instanced arrays, drawing instances one by one\n");
+	return instancing != 1;
+}
+
+int mesh_instancing_available() {
+	if (!instancing && eglGetCurrentContext() != EGL_NO_CONTEXT)
+		init_instancing();
+	return instancing == 1;
+}
+
+static struct mesh *get_mesh(int id) {
+	if (id < 0 || id >= MAX_MESHES || !meshes[id].used)
+		return NULL;
+	return &meshes[id];
+}
+
+// Clean instances between the range and instance, 0 if they touch
+static unsigned int range_gap(const struct dirty_range *range, unsigned int begin, unsigned int end) {
+	if (end < range->begin)
+		return range->begin - end;
+	if (begin > range->end)
+		return begin - range->end;
+	return 0;
+}
+
+static void mark_dirty(struct dirty_ranges *dirty, unsigned int instance) {
+	int nearest = -1;
+	unsigned int nearest_gap = UINT_MAX;
+	for (unsigned int i = 0; i < dirty->count; i++) {
+		struct dirty_range *range = &dirty->ranges[i];
+		if (instance >= range->begin && instance < range->end)
+			return;
+		unsigned int gap = range_gap(range, instance, instance + 1);
+		if (gap < nearest_gap) {
+			nearest = i;
+			nearest_gap = gap;
+		}
+	}
+
+	if (nearest < 0 || (nearest_gap > DIRTY_MERGE_GAP && dirty->count < MAX_DIRTY_RANGES)) {
+		dirty->ranges[dirty->count++] = (struct dirty_range){ instance, instance + 1 };
+		return;
+	}
+
+	// Grow the nearest range, then take in the ranges it got close to
+	struct dirty_range *range = &dirty->ranges[nearest];
+	if (instance < range->begin)
+		range->begin = instance;
+	else
+		range->end = instance + 1;
+
+	for (int i = 0; i < (int)dirty->count; i++) {
+		struct dirty_range *other = &dirty->ranges[i];
+		if (other == range || range_gap(range, other->begin, other->end) > DIRTY_MERGE_GAP)
+			continue;
+		if (other->begin < range->begin)
+			range->begin = other->begin;
+		if (other->end > range->end)
+			range->end = other->end;
+
+		// Keep the ranges packed, range may be the last one that moves into the hole
+		struct dirty_range *last = &dirty->ranges[--dirty->count];
+		if (last == range)
+			range = other;
+		*other = *last;
+		i = -1; // Check again, the range grew
+	}
+}
+
+int create_mesh(const float *vertices, unsigned int vertex_count, unsigned int components,
+		unsigned int max_instances) {
+	if (components < 2 || components > 3 || !vertex_count || !max_instances) {
+		printf("Mesh Error: Invalid mesh layout\n");
+		return -1;
+	}
+
+	int id = -1;
+	for (int i = 0; i < MAX_MESHES; i++) {
+		if (!meshes[i].used) {
+			id = i;
+			break;
+		}
+	}
+	if (id < 0) {
+		printf("Mesh Error: More than %d meshes\n", MAX_MESHES);
+		return -1;
+	}
+
+	struct mesh *mesh = &meshes[id];
+	memset(mesh, 0, sizeof(*mesh));
+	mesh->offsets = calloc(max_instances, 2 * sizeof(float));
+	mesh->scale_rotations = calloc(max_instances, 2 * sizeof(float));
+	mesh->colors = calloc(max_instances, 4);
+	if (!mesh->offsets || !mesh->scale_rotations || !mesh->colors) {
+		printf("Mesh Error: Malloc failed\n");
+		free(mesh->offsets);
+		free(mesh->scale_rotations);
+		free(mesh->colors);
+		return -1;
+	}
+	mesh->vertex_count = vertex_count;
+	mesh->components = components;
+	mesh->max_instances = max_instances;
+	mesh->used = 1;
+
+	// The software renderer has no context, its meshes only hold the instances
+	if (eglGetCurrentContext() == EGL_NO_CONTEXT)
+		return id;
+
+	glGenBuffers(1, &mesh->vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * components * sizeof(float), vertices, GL_STATIC_DRAW);
+
+	// Instance arrays are only read from the buffer when drawing instanced
+	if (mesh_instancing_available()) {
+		glGenBuffers(1, &mesh->instance_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh->instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, max_instances * (4 * sizeof(float) + 4), NULL, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return id;
+}
+
+int mesh_add_instance(int id) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh)
+		return -1;
+	if (mesh->instance_count == mesh->max_instances) {
+		printf("Mesh Error: More than %u instances\n", mesh->max_instances);
+		return -1;
+	}
+
+	unsigned int instance = mesh->instance_count++;
+	mesh_set_transform(id, instance, 0.0f, 0.0f, 1.0f, 0.0f);
+	mesh_set_color(id, instance, 0xFFFFFFFF);
+	return instance;
+}
+
+unsigned int mesh_instance_count(int id) {
+	struct mesh *mesh = get_mesh(id);
+	return mesh ? mesh->instance_count : 0;
+}
+
+void mesh_set_transform(int id, unsigned int instance, float x, float y, float scale, float rotation) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh || instance >= mesh->instance_count)
+		return;
+
+	mesh->offsets[instance * 2] = x;
+	mesh->offsets[instance * 2 + 1] = y;
+	mark_dirty(&mesh->dirty_offsets, instance);
+
+	float *scale_rotation = &mesh->scale_rotations[instance * 2];
+	if (scale_rotation[0] != scale || scale_rotation[1] != rotation) {
+		scale_rotation[0] = scale;
+		scale_rotation[1] = rotation;
+		mark_dirty(&mesh->dirty_scale_rotations, instance);
+	}
+}
+
+void mesh_move(int id, unsigned int instance, float dx, float dy) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh || instance >= mesh->instance_count)
+		return;
+
+	mesh->offsets[instance * 2] += dx;
+	mesh->offsets[instance * 2 + 1] += dy;
+	mark_dirty(&mesh->dirty_offsets, instance);
+}
+
+void mesh_get_transform(int id, unsigned int instance, float *x, float *y, float *scale, float *rotation) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh || instance >= mesh->instance_count)
+		return;
+
+	if (x)
+		*x = mesh->offsets[instance * 2];
+	if (y)
+		*y = mesh->offsets[instance * 2 + 1];
+	if (scale)
+		*scale = mesh->scale_rotations[instance * 2];
+	if (rotation)
+		*rotation = mesh->scale_rotations[instance * 2 + 1];
+}
+
+void mesh_set_color(int id, unsigned int instance, uint32_t color) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh || instance >= mesh->instance_count)
+		return;
+
+	unsigned char *rgba = &mesh->colors[instance * 4];
+	rgba[0] = color >> 16;
+	rgba[1] = color >> 8;
+	rgba[2] = color;
+	rgba[3] = color >> 24;
+	mark_dirty(&mesh->dirty_colors, instance);
+}
+
+// Uploads the changed parts of one instance array, which starts at base in the buffer
+static void upload_ranges(struct dirty_ranges *dirty, GLintptr base, unsigned int stride, const void *data) {
+	for (unsigned int i = 0; i < dirty->count; i++) {
+		const struct dirty_range *range = &dirty->ranges[i];
+		glBufferSubData(GL_ARRAY_BUFFER, base + range->begin * stride, (range->end - range->begin) * stride,
+				(const unsigned char *)data + range->begin * stride);
+	}
+	dirty->count = 0;
+}
+
+// Looked up on every draw: program names are reused after a hot reload or a relink
+static void lookup_attribs(GLuint program, struct mesh_attribs *attribs) {
+	attribs->position = glGetAttribLocation(program, "a_Position");
+	attribs->offset = glGetAttribLocation(program, "a_Offset");
+	attribs->scale_rotation = glGetAttribLocation(program, "a_ScaleRotation");
+	attribs->color = glGetAttribLocation(program, "a_Color");
+}
+
+static void bind_instance_array(GLint location, GLint size, GLenum type, GLboolean normalized, GLintptr offset) {
+	if (location < 0)
+		return;
+	glVertexAttribPointer(location, size, type, normalized, 0, (void *)offset);
+	glEnableVertexAttribArray(location);
+	vertex_attrib_divisor(location, 1);
+}
+
+static void unbind_instance_array(GLint location) {
+	if (location < 0)
+		return;
+	vertex_attrib_divisor(location, 0);
+	glDisableVertexAttribArray(location);
+}
+
+static void draw_instanced(struct mesh *mesh, const struct mesh_attribs *attribs) {
+	GLintptr offsets_base = 0;
+	GLintptr scale_rotations_base = mesh->max_instances * 2 * sizeof(float);
+	GLintptr colors_base = mesh->max_instances * 4 * sizeof(float);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->instance_buffer);
+	upload_ranges(&mesh->dirty_offsets, offsets_base, 2 * sizeof(float), mesh->offsets);
+	upload_ranges(&mesh->dirty_scale_rotations, scale_rotations_base, 2 * sizeof(float), mesh->scale_rotations);
+	upload_ranges(&mesh->dirty_colors, colors_base, 4, mesh->colors);
+
+	bind_instance_array(attribs->offset, 2, GL_FLOAT, GL_FALSE, offsets_base);
+	bind_instance_array(attribs->scale_rotation, 2, GL_FLOAT, GL_FALSE, scale_rotations_base);
+	bind_instance_array(attribs->color, 4, GL_UNSIGNED_BYTE, GL_TRUE, colors_base);
+
+	draw_arrays_instanced(GL_TRIANGLES, 0, mesh->vertex_count, mesh->instance_count);
+
+	unbind_instance_array(attribs->offset);
+	unbind_instance_array(attribs->scale_rotation);
+	unbind_instance_array(attribs->color);
+}
+
+// Per-instance values as constant attributes, one draw per instance
+static void draw_one_by_one(struct mesh *mesh, const struct mesh_attribs *attribs) {
+	for (unsigned int i = 0; i < mesh->instance_count; i++) {
+		if (attribs->offset >= 0)
+			glVertexAttrib2fv(attribs->offset, &mesh->offsets[i * 2]);
+		if (attribs->scale_rotation >= 0)
+			glVertexAttrib2fv(attribs->scale_rotation, &mesh->scale_rotations[i * 2]);
+		if (attribs->color >= 0) {
+			const unsigned char *rgba = &mesh->colors[i * 4];
+			glVertexAttrib4f(attribs->color, rgba[0] / 255.0f, rgba[1] / 255.0f, rgba[2] / 255.0f, rgba[3] / 255.0f);
+		}
+		glDrawArrays(GL_TRIANGLES, 0, mesh->vertex_count);
+	}
+
+	mesh->dirty_offsets.count = 0;
+	mesh->dirty_scale_rotations.count = 0;
+	mesh->dirty_colors.count = 0;
+}
+
+void draw_mesh(int id, unsigned int program) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh || !mesh->vertex_buffer || !mesh->instance_count)
+		return;
+
+	struct mesh_attribs attribs;
+	lookup_attribs(program, &attribs);
+	if (attribs.position < 0) {
+		printf("Mesh Error: Program %u has no a_Position attribute\n", program);
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vertex_buffer);
+	glVertexAttribPointer(attribs.position, mesh->components, GL_FLOAT, GL_FALSE, 0, (void *)0);
+	glEnableVertexAttribArray(attribs.position);
+
+	if (mesh->instance_buffer)
+		draw_instanced(mesh, &attribs);
+	else
+		draw_one_by_one(mesh, &attribs);
+
+	glDisableVertexAttribArray(attribs.position);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void free_mesh(int id) {
+	struct mesh *mesh = get_mesh(id);
+	if (!mesh)
+		return;
+
+	if (mesh->vertex_buffer)
+		glDeleteBuffers(1, &mesh->vertex_buffer);
+	if (mesh->instance_buffer)
+		glDeleteBuffers(1, &mesh->instance_buffer);
+	free(mesh->offsets);
+	free(mesh->scale_rotations);
+	free(mesh->colors);
+	memset(mesh, 0, sizeof(*mesh));
+}
+
+void free_meshes() {
+	for (int i = 0; i < MAX_MESHES; i++)
+		free_mesh(i);
+
+	// The next context may support a different path
+	instancing = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef HELPERS_MESH_HELPERS_H_
+#define HELPERS_MESH_HELPERS_H_
+
+#include <stdint.h>
+
+// Static meshes drawn as many instances. The vertices are uploaded once; each instance has an
+// offset, a scale, a rotation and a color, kept in a structure-of-arrays instance buffer of
+// which only the changed ranges are uploaded before a draw. Moving an object rewrites 8
+// bytes, not its vertices.
+//
+// Instances are drawn in one call with instanced arrays (GL_EXT_instanced_arrays,
+// GL_ANGLE_instanced_arrays or GLES 3). Without them each instance is drawn on its own with
+// the per-instance values set as constant vertex attributes, so the same program works for
+// both paths.
+//
+// Programs passed to draw_mesh() read these attributes, any of them may be left out:
+//   attribute vec4 a_Position;      // Mesh vertex
+//   attribute vec2 a_Offset;        // Instance position
+//   attribute vec2 a_ScaleRotation; // Instance scale and rotation in radians
+//   attribute vec4 a_Color;         // Instance color
+
+#define MAX_MESHES 16
+
+// Uploads vertex_count vertices of components (2 or 3) floats each, with room for up to
+// max_instances instances. Without a GL context (the software renderer) the mesh only keeps
+// the instance data. Returns a mesh id, -1 on failure.
+int create_mesh(const float *vertices, unsigned int vertex_count, unsigned int components,
+		unsigned int max_instances);
+
+// Adds an instance at the origin with scale 1, no rotation and a white color. Returns its
+// index, -1 if the mesh is full.
+int mesh_add_instance(int mesh);
+
+unsigned int mesh_instance_count(int mesh);
+
+void mesh_set_transform(int mesh, unsigned int instance, float x, float y, float scale, float rotation);
+void mesh_move(int mesh, unsigned int instance, float dx, float dy);
+void mesh_get_transform(int mesh, unsigned int instance, float *x, float *y, float *scale, float *rotation);
+
+// Color as 0xAARRGGBB, like the software canvas
+void mesh_set_color(int mesh, unsigned int instance, uint32_t color);
+
+// Uploads the changed instances and draws them all with program, which must be in use. The
+// attribute locations are looked up on every call, so a reloaded or relinked program works.
+void draw_mesh(int mesh, unsigned int program);
+
+// Returns 1 if instances are drawn with instanced arrays. Needs a current context.
+int mesh_instancing_available();
+
+void free_mesh(int mesh);
+
+// Frees every mesh. Called by the renderer before the EGL context goes away.
+void free_meshes();
+
+#endif /* HELPERS_MESH_HELPERS_H_ */
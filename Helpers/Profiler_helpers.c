@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include "Profiler_helpers.h"
+
+// Frames in flight before a frame's queries are read back
+#define PROFILER_FRAMES 4
+// Timer queries per frame, a pass may run several times per frame
+#define MAX_QUERIES 32
+
+static PFNGLGENQUERIESEXTPROC gen_queries;
+static PFNGLDELETEQUERIESEXTPROC delete_queries;
+static PFNGLBEGINQUERYEXTPROC begin_query;
+static PFNGLENDQUERYEXTPROC end_query;
+static PFNGLGETQUERYOBJECTUIVEXTPROC get_query_uiv;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64v;
+
+static struct {
+	int state; // 0 not initialized, 1 available, -1 unsupported
+	GLuint queries[PROFILER_FRAMES][MAX_QUERIES];
+	unsigned char pass_of[PROFILER_FRAMES][MAX_QUERIES];
+	unsigned int count[PROFILER_FRAMES];
+	unsigned int frame; // Ring slot of the frame being recorded
+	int active;         // A pass is open
+	int warned;
+
+	struct gpu_pass_time passes[GPU_PROFILER_MAX_PASSES];
+	unsigned int pass_count;
+} profiler;
+
+static int init_gpu_profiler() {
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	profiler.state = -1;
+	if (!extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query"))
+		return 1;
+
+	gen_queries = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress("glGenQueriesEXT");
+	delete_queries = (PFNGLDELETEQUERIESEXTPROC)eglGetProcAddress("glDeleteQueriesEXT");
+	begin_query = (PFNGLBEGINQUERYEXTPROC)eglGetProcAddress("glBeginQueryEXT");
+	end_query = (PFNGLENDQUERYEXTPROC)eglGetProcAddress("glEndQueryEXT");
+	get_query_uiv = (PFNGLGETQUERYOBJECTUIVEXTPROC)eglGetProcAddress("glGetQueryObjectuivEXT");
+	get_query_ui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+	if (!gen_queries || !delete_queries || !begin_query || !end_query || !get_query_uiv || !get_query_ui64v) {
+		printf("Profiler Error: Failed to load timer query entry points\n");
+		return 1;
+	}
+
+	for (int i = 0; i < PROFILER_FRAMES; i++)
+		gen_queries(MAX_QUERIES, profiler.queries[i]);
+
+	// Clear a pending disjoint flag so the first frames count
+	GLint disjoint;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	profiler.state = 1;
+	return 0;
+}
+
+int gpu_profiler_available() {
+	if (!profiler.state && eglGetCurrentContext() != EGL_NO_CONTEXT)
+		init_gpu_profiler();
+	return profiler.state == 1;
+}
+
+static int find_pass(const char *name) {
+	for (unsigned int i = 0; i < profiler.pass_count; i++) {
+		if (profiler.passes[i].name == name || strcmp(profiler.passes[i].name, name) == 0)
+			return i;
+	}
+	if (profiler.pass_count == GPU_PROFILER_MAX_PASSES)
+		return -1;
+
+	memset(&profiler.passes[profiler.pass_count], 0, sizeof(struct gpu_pass_time));
+	profiler.passes[profiler.pass_count].name = name;
+	return profiler.pass_count++;
+}
+
+void gpu_pass_begin(const char *name) {
+	if (!gpu_profiler_available())
+		return;
+
+	unsigned int *count = &profiler.count[profiler.frame];
+	int pass = find_pass(name);
+	if (profiler.active || pass < 0 || *count == MAX_QUERIES) {
+		if (!profiler.warned)
+			printf("Profiler Error: Pass %s ignored (nested pass or too many passes)\n", name);
+		profiler.warned = 1;
+		return;
+	}
+
+	profiler.pass_of[profiler.frame][*count] = pass;
+	begin_query(GL_TIME_ELAPSED_EXT, profiler.queries[profiler.frame][*count]);
+	(*count)++;
+	profiler.active = 1;
+}
+
+void gpu_pass_end() {
+	if (profiler.state != 1 || !profiler.active)
+		return;
+
+	end_query(GL_TIME_ELAPSED_EXT);
+	profiler.active = 0;
+}
+
+// Called by the renderer after each swap. Moves to the next ring slot and reads back the
+// frame that was recorded in it PROFILER_FRAMES - 1 frames ago.
+void gpu_profiler_frame_end() {
+	if (profiler.state != 1)
+		return;
+
+	if (profiler.active)
+		gpu_pass_end();
+
+	// A disjoint event (GPU reset, frequency change) invalidates everything in flight
+	GLint disjoint = 0;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	if (disjoint)
+		memset(profiler.count, 0, sizeof(profiler.count));
+
+	profiler.frame = (profiler.frame + 1) % PROFILER_FRAMES;
+	unsigned int slot = profiler.frame;
+	unsigned int count = profiler.count[slot];
+	if (!count)
+		return;
+
+	// Queries complete in order, if the last one is done they all are
+	GLuint available = 0;
+	get_query_uiv(profiler.queries[slot][count - 1], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+	if (available) {
+		GLuint64 total[GPU_PROFILER_MAX_PASSES] = { 0 };
+		unsigned char measured[GPU_PROFILER_MAX_PASSES] = { 0 };
+		for (unsigned int i = 0; i < count; i++) {
+			GLuint64 ns = 0;
+			get_query_ui64v(profiler.queries[slot][i], GL_QUERY_RESULT_EXT, &ns);
+			total[profiler.pass_of[slot][i]] += ns;
+			measured[profiler.pass_of[slot][i]] = 1;
+		}
+		for (unsigned int i = 0; i < profiler.pass_count; i++) {
+			profiler.passes[i].ms = total[i] / 1000000.0f;
+			if (measured[i]) {
+				profiler.passes[i].total_ms += total[i] / 1000000.0;
+				profiler.passes[i].frames++;
+			}
+		}
+	}
+
+	profiler.count[slot] = 0;
+}
+
+unsigned int gpu_profiler_results(const struct gpu_pass_time **passes) {
+	*passes = profiler.passes;
+	return profiler.state == 1 ? profiler.pass_count : 0;
+}
+
+void gpu_profiler_reset_totals() {
+	for (unsigned int i = 0; i < profiler.pass_count; i++) {
+		profiler.passes[i].total_ms = 0;
+		profiler.passes[i].frames = 0;
+	}
+}
+
+void free_gpu_profiler() {
+	if (profiler.state == 1) {
+		for (int i = 0; i < PROFILER_FRAMES; i++)
+			delete_queries(MAX_QUERIES, profiler.queries[i]);
+	}
+	memset(&profiler, 0, sizeof(profiler));
+}
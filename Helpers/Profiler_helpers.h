@@ -0,0 +1,32 @@
+#ifndef HELPERS_PROFILER_HELPERS_H_
+#define HELPERS_PROFILER_HELPERS_H_
+
+// GPU time of named render passes, measured with GL_EXT_disjoint_timer_query. Each frame's
+// queries are read back a few frames later, so measuring never stalls the pipeline. The
+// overlay shows the pass times next to the FPS counter.
+//
+// Passes can't nest (the extension allows one timer at a time) and names must be string
+// literals. Without the extension, or on the software renderer, the calls do nothing.
+
+#define GPU_PROFILER_MAX_PASSES 16
+
+struct gpu_pass_time {
+	const char *name;
+	float ms;        // GPU time of the pass in the most recent measured frame
+	double total_ms; // Summed over the measured frames since gpu_profiler_reset_totals()
+	unsigned long frames;
+};
+
+void gpu_pass_begin(const char *name);
+void gpu_pass_end();
+
+// Points passes at the measured passes, in the order they were first seen. Returns the count.
+unsigned int gpu_profiler_results(const struct gpu_pass_time **passes);
+
+// Clears total_ms and frames of every pass, e.g. to average a pass over a benchmark run.
+void gpu_profiler_reset_totals();
+
+// Returns 1 if the GPU supports timer queries. Needs a current context.
+int gpu_profiler_available();
+
+#endif /* HELPERS_PROFILER_HELPERS_H_ */
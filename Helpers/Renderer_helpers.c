@@ -1,19 +1,87 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm/drm_fourcc.h>
 #include <gbm.h>
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include <unistd.h>
 #include <string.h>
 #include "Renderer_helpers.h"
+#include "Software_helpers.h"
+#include "Arena_helpers.h"
+#include "Trace_helpers.h"
+#include "Profiler_helpers.h"
+#include "Job_helpers.h"
+#include "Format_helpers.h"
+#include "Ipc_helpers.h"
+#include "Text_helpers.h"
 
 extern int process_inputs();
+extern void prefetch_input_devices();
+extern void finish_input_prefetch();
 extern int createProgram(const char *vertexSource, const char *fragmentSource);
+extern void freeDmabufCache();
+extern void processProgramReloads(unsigned int budget_us);
+extern void freeProgramWatches();
+extern int init_frame_arena();
+extern void reset_frame_arena();
+extern void free_frame_arena();
+extern void gpu_profiler_frame_end();
+extern void free_gpu_profiler();
+extern void free_meshes();
+extern void target_pool_frame_end();
+extern void free_target_pool();
+extern void process_texture_uploads();
+extern void free_texture_cache();
+extern void process_ipc();
+extern void draw_ipc_layers();
+extern void ipc_frame_end();
+extern void free_ipc_server();
+extern void draw_text_overlay();
+extern void text_frame_end();
+extern void free_text();
+
+// Time per frame shader hot reloads may spend compiling synchronously
+#define RELOAD_BUDGET_US 2000
+
+// CPU rendered scanout buffer used when EGL is not available
+struct dumb_buffer {
+    uint32_t handle;
+    uint32_t fb;
+    uint32_t pitch;
+    uint64_t size;
+    uint32_t *map;
+};
+
+// How frames get from the render device to the display card, see init_offload_buffers
+enum offload_mode {
+    OFFLOAD_NONE,
+    OFFLOAD_EXPORT, // Render device buffers imported into the display card
+    OFFLOAD_IMPORT, // Display card dumb buffers imported into the render device
+    OFFLOAD_COPY,   // glReadPixels into dumb buffers
+};
+
+static const char *const offload_mode_names[] = { "none", "export", "import", "copy" };
+
+// Scanout buffer of the offload path, rendered to through a dma-buf EGLImage
+struct offload_buffer {
+    struct gbm_bo *bo;     // Export only, the buffer on the render device
+    uint32_t handle;       // Export only, GEM handle of the PRIME import on the display card
+    uint32_t fb;
+    EGLImageKHR image;
+    GLuint renderbuffer, framebuffer;
+};
 
 static struct internal_device{
     unsigned int width, height;
@@ -26,6 +94,7 @@ static struct internal_device{
     drmModeCrtc *crtc;
     drmModeModeInfo mode;
     drmModeEncoder *encoder;
+    int vrr;
 
     // GBM
     struct gbm_device *gbm;
@@ -36,9 +105,52 @@ static struct internal_device{
     EGLContext context;
     EGLSurface egl_surface;
 
+    // Negotiated surface, format is its DRM fourcc
+    struct surface_config surface;
+    uint32_t format;
+    EGLConfig egl_config;
+
+    // Primary plane and whether the GBM surface uses explicit modifiers
+    uint32_t plane_id;
+    int modifiers;
+    int linear;
+
+    // Explicit sync. With atomic, flips carry the GPU's fence as IN_FENCE_FD and return
+    // OUT_FENCE_PTR, otherwise legacy flips rely on the kernel's implicit fencing.
+    int atomic;
+    uint32_t fb_prop, in_fence_prop, out_fence_prop;
+    int kms_fence_fd;
+    int sync_khr;
+
     struct gbm_bo *previous_bo;
     uint32_t previous_fb;
 
+    // Offscreen rendering into a pbuffer, no display
+    int offscreen;
+    int started;
+
+    // Software fallback
+    int software;
+    struct dumb_buffer dumb[2];
+    int back;
+    struct sw_canvas canvas;
+
+    // Render offload: GL runs on another device (a render node or Mesa's surfaceless
+    // platform), finished frames are flipped from the display card's buffers. Export and
+    // import draw straight into the back buffer's framebuffer, without a surface; copy draws
+    // into a pbuffer.
+    enum offload_mode offload;
+    int render_fd;
+    struct gbm_device *render_gbm;
+    struct offload_buffer offload_buffers[2];
+    GLuint offload_depth, offload_stencil; // Shared by both framebuffers
+    int offload_reflected;                 // The primary plane flips the buffers vertically
+    uint32_t rotation_prop;
+    // Without reflection frames go through this texture and are drawn upside down
+    GLuint offload_framebuffer, offload_texture, offload_program;
+    GLint offload_pos_attrib, offload_tex_uniform;
+    uint8_t *offload_staging;
+
     // User defined init and draw functions
     func_t init;
     func_t draw;
@@ -47,214 +159,271 @@ static struct internal_device{
 
 static struct internal_device *dev = NULL;
 
-static GLuint text_program, text_texture;
-static GLint text_pos_attrib, text_uv_attrib, text_color_uniform, text_tex_uniform;
-static GLint text_proj_uniform;
-
-// Simple orthographic projection (NDC)
-static float ortho_proj[16] = {
-    2.0f/800, 0, 0, 0,
-    0, -2.0f/600, 0, 0,
-    0, 0, -1, 0,
-   -1, 1, 0, 1
-};
+// The overlay's text atlas is only created when something is first drawn with it
+static int overlay_enabled = 1;
 
-static const unsigned char digits_font[10][8] = {
-    {0x3C,0x66,0x6E,0x76,0x66,0x66,0x3C,0x00}, // 0
-    {0x18,0x38,0x18,0x18,0x18,0x18,0x7E,0x00}, // 1
-    {0x3C,0x66,0x06,0x0C,0x18,0x30,0x7E,0x00}, // 2
-    {0x3C,0x66,0x06,0x1C,0x06,0x66,0x3C,0x00}, // 3
-    {0x0C,0x1C,0x3C,0x6C,0x7E,0x0C,0x1E,0x00}, // 4
-    {0x7E,0x60,0x7C,0x06,0x06,0x66,0x3C,0x00}, // 5
-    {0x1C,0x30,0x60,0x7C,0x66,0x66,0x3C,0x00}, // 6
-    {0x7E,0x66,0x0C,0x18,0x18,0x18,0x18,0x00}, // 7
-    {0x3C,0x66,0x66,0x3C,0x66,0x66,0x3C,0x00}, // 8
-    {0x3C,0x66,0x66,0x3E,0x06,0x0C,0x38,0x00}  // 9
-};
+#define OVERLAY_YELLOW 0xFFFFFF00
+#define OVERLAY_CYAN 0xFF00FFFF
 
-static int init_fps_renderer() {
-    const char* vertex_shader =
-        "attribute vec4 a_Position;"
-        "attribute vec2 a_TexCoord;"
-        "uniform mat4 u_Proj;"
-        "varying vec2 v_TexCoord;"
-        "void main() { "
-        "    v_TexCoord = a_TexCoord; "
-        "    gl_Position = u_Proj * a_Position; "
-        "}";
-
-    const char* fragment_shader =
-        "precision mediump float;"
-        "uniform sampler2D u_Texture;"
-        "uniform vec4 u_Color;"
-        "varying vec2 v_TexCoord;"
-        "void main() { "
-        "    float alpha = texture2D(u_Texture, v_TexCoord).a;"
-        "    gl_FragColor = vec4(u_Color.rgb, alpha * u_Color.a); "
-        "}";
-
-    // Update projection matrix for current screen size
-    ortho_proj[0] = 2.0f / dev->width;
-    ortho_proj[5] = -2.0f / dev->height;
-
-    text_program = createProgram(vertex_shader, fragment_shader);
-    if (text_program == 0) {
-        printf("Renderer Error: Failed to create shader program\n");
-        return 1;
-    }
+static void draw_fps_number(int number, float x, float y, float scale) {
+    if (number < 0) return;
 
-    text_pos_attrib = glGetAttribLocation(text_program, "a_Position");
-    text_uv_attrib = glGetAttribLocation(text_program, "a_TexCoord");
-    text_color_uniform = glGetUniformLocation(text_program, "u_Color");
-    text_tex_uniform = glGetUniformLocation(text_program, "u_Texture");
-    text_proj_uniform = glGetUniformLocation(text_program, "u_Proj");
+    const char *buf = frame_printf("%d", number);
+    if (buf)
+        text_draw(buf, x, y, 8 * scale, OVERLAY_YELLOW);
+}
 
-    // Create font texture - 10 digits in a row, each 8x8 pixels
-    glGenTextures(1, &text_texture);
-    glBindTexture(GL_TEXTURE_2D, text_texture);
+// Name and GPU ms of each profiled pass, in a row after the FPS number
+static void draw_pass_times(float x, float y, float size) {
+    const struct gpu_pass_time *passes;
+    unsigned int count = gpu_profiler_results(&passes);
+
+    for (unsigned int i = 0; i < count; i++) {
+        const char *buf = frame_printf("%s %.2f", passes[i].name, passes[i].ms);
+        if (!buf)
+            return;
+        text_draw(buf, x, y, size, OVERLAY_CYAN);
+        x += text_width(buf, size) + size;
+    }
+}
 
-    // Create 80x8 texture (10 digits × 8 pixels wide, 8 pixels tall)
-    unsigned char font_data[80 * 8];
-    memset(font_data, 0, sizeof(font_data));
+// Mode selection, VRR and render device settings, set before init_renderer
+static struct {
+    enum mode_policy policy;
+    unsigned int width, height, refresh;
+    int vrr;
+    char render_device[64];
+} mode_config = { MODE_PREFERRED, 0, 0, 0, 1, "" };
+
+// Looks up a KMS property by name, returns 1 if the object doesn't have it
+static int get_property(int fd, uint32_t object_id, uint32_t object_type, const char *name,
+        uint32_t *prop_id, uint64_t *value) {
+    drmModeObjectProperties *props = drmModeObjectGetProperties(fd, object_id, object_type);
+    if (!props)
+        return 1;
 
-    for(int digit = 0; digit < 10; digit++) {
-        for(int y = 0; y < 8; y++) {
-            for(int x = 0; x < 8; x++) {
-                int pixel_index = y * 80 + (digit * 8 + x); // Row-major order in 80x8 texture
-                font_data[pixel_index] = (digits_font[digit][y] & (1 << (7-x))) ? 255 : 0;
-            }
+    int ret = 1;
+    for (uint32_t i = 0; i < props->count_props && ret; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        if (!prop)
+            continue;
+        if (strcmp(prop->name, name) == 0) {
+            if (prop_id)
+                *prop_id = prop->prop_id;
+            if (value)
+                *value = props->prop_values[i];
+            ret = 0;
         }
+        drmModeFreeProperty(prop);
     }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 80, 8, 0, GL_ALPHA, GL_UNSIGNED_BYTE, font_data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    drmModeFreeObjectProperties(props);
+    return ret;
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return 0;
+// Exact refresh rate in mHz, vrefresh is rounded
+static unsigned int mode_refresh_mhz(const drmModeModeInfo *mode) {
+    if (!mode->htotal || !mode->vtotal)
+        return mode->vrefresh * 1000;
+
+    uint64_t mhz = (uint64_t)mode->clock * 1000000 / ((uint64_t)mode->htotal * mode->vtotal);
+    if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+        mhz *= 2;
+    return (unsigned int)mhz;
 }
 
-static void draw_fps_number(int number, float x, float y, float scale) {
-    if (number < 0) return;
+static const drmModeModeInfo *preferred_mode(const drmModeConnector *connector) {
+    for (int i = 0; i < connector->count_modes; i++) {
+        if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+            return &connector->modes[i];
+    }
+    return &connector->modes[0];
+}
 
-    char buf[16];
-    snprintf(buf, sizeof(buf), "%d", number);
-
-    glViewport(0, 0, dev->width, dev->height);
-    glUseProgram(text_program);
-
-    // Set uniforms
-    glUniformMatrix4fv(text_proj_uniform, 1, GL_FALSE, ortho_proj);
-    glUniform4f(text_color_uniform, 1.0f, 1.0f, 0.0f, 1.0f); // Yellow color
-
-    // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, text_texture);
-    glUniform1i(text_tex_uniform, 0);
-
-    // Enable blending for alpha
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    float cx = x;
-    for(int i = 0; buf[i]; i++) {
-        int digit = buf[i] - '0';
-        if (digit < 0 || digit > 9) continue;
-
-        // Calculate texture coordinates for this digit
-        float tex_left = digit / 10.0f;     // Each digit is 1/10th of texture width
-        float tex_right = (digit + 1) / 10.0f;
-        float tex_top = 0.0f;
-        float tex_bottom = 1.0f;
-
-        // Vertex data: position (x,y) + texture coords (u,v)
-        float vertices[] = {
-            // Triangle 1
-            cx, y, tex_left, tex_top,                    // Top-left
-            cx + 8*scale, y, tex_right, tex_top,         // Top-right
-            cx, y + 8*scale, tex_left, tex_bottom,       // Bottom-left
-
-            // Triangle 2
-            cx + 8*scale, y, tex_right, tex_top,         // Top-right
-            cx + 8*scale, y + 8*scale, tex_right, tex_bottom, // Bottom-right
-            cx, y + 8*scale, tex_left, tex_bottom        // Bottom-left
-        };
+static const drmModeModeInfo *select_mode(const drmModeConnector *connector) {
+    const drmModeModeInfo *preferred = preferred_mode(connector);
+    const drmModeModeInfo *best = NULL;
 
-        // Set vertex attributes
-        glVertexAttribPointer(text_pos_attrib, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), vertices);
-        glEnableVertexAttribArray(text_pos_attrib);
+    for (int i = 0; i < connector->count_modes; i++) {
+        const drmModeModeInfo *mode = &connector->modes[i];
+
+        switch (mode_config.policy) {
+        case MODE_MAX_REFRESH:
+            // Highest refresh rate at the panel's preferred resolution
+            if (mode->hdisplay == preferred->hdisplay && mode->vdisplay == preferred->vdisplay &&
+                    (!best || mode_refresh_mhz(mode) > mode_refresh_mhz(best)))
+                best = mode;
+            break;
+        case MODE_EXACT:
+            if (mode->hdisplay == mode_config.width && mode->vdisplay == mode_config.height &&
+                    (!mode_config.refresh || (mode_refresh_mhz(mode) + 500) / 1000 == mode_config.refresh) &&
+                    (!best || mode_refresh_mhz(mode) > mode_refresh_mhz(best)))
+                best = mode;
+            break;
+        case MODE_LOWEST_BANDWIDTH:
+            if (!best || mode->clock < best->clock)
+                best = mode;
+            break;
+        case MODE_PREFERRED:
+        default:
+            break;
+        }
+    }
 
-        glVertexAttribPointer(text_uv_attrib, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), vertices + 2);
-        glEnableVertexAttribArray(text_uv_attrib);
+    if (!best) {
+        if (mode_config.policy == MODE_EXACT)
+            printf("DRM Error: No %ux%u@%u mode, using the preferred mode\n",
+                    mode_config.width, mode_config.height, mode_config.refresh);
+        best = preferred;
+    }
+    return best;
+}
 
-        // Draw the character
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+// Result of probing one /dev/dri/card* node
+struct card_probe {
+    char path[300];
+    unsigned int index;
+    pthread_t thread;
+    int thread_started;
+    int fd;
+    drmModeRes *resources;
+    drmModeConnector *connector;
+};
 
-        // Move to next character position
-        cx += 8*scale + 2;
+// Opens the card and looks for a connected connector. Anything that doesn't lead to a usable
+// connector is closed again, so unused cards don't keep fds open.
+static void probe_connectors(struct card_probe *probe){
+    probe->fd = open(probe->path, O_RDWR | O_CLOEXEC);
+    if (probe->fd < 0)
+        return;
+
+    probe->resources = drmModeGetResources(probe->fd);
+    if (probe->resources) {
+        for (int i = 0; i < probe->resources->count_connectors; i++) {
+            drmModeConnector *connector = drmModeGetConnector(probe->fd, probe->resources->connectors[i]);
+            if (connector && connector->connection == DRM_MODE_CONNECTED && connector->count_modes > 0) {
+                probe->connector = connector;
+                return;
+            }
+            drmModeFreeConnector(connector);
+        }
+        drmModeFreeResources(probe->resources);
+        probe->resources = NULL;
     }
 
-    // Disable vertex arrays
-    glDisableVertexAttribArray(text_pos_attrib);
-    glDisableVertexAttribArray(text_uv_attrib);
+    close(probe->fd);
+    probe->fd = -1;
+}
 
-    glDisable(GL_BLEND);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glUseProgram(0);
+static void *probe_card(void *arg){
+    struct card_probe *probe = arg;
+    TRACE_THREAD_NAME("card probe");
+    TRACE_BEGIN("probe card");
+    probe_connectors(probe);
+    TRACE_END();
+    return NULL;
 }
 
-static int init_drm(){
-	const char* cards[] = {"/dev/dri/card0", "/dev/dri/card1"};
+#define MAX_CARDS 8
 
-	for(unsigned long int i=0; i<sizeof(cards)/sizeof(cards[0]); i++){
-		// Open the DRM device
-		dev->fd = open(cards[i], O_RDWR | O_CLOEXEC);
-		if (dev->fd <= 0) {
-			continue;
-		}
+// Primary plane of the selected CRTC, 0 if the driver doesn't expose planes
+static uint32_t find_primary_plane(){
+    int crtc_index = -1;
+    for (int i = 0; i < dev->resources->count_crtcs; i++) {
+        if (dev->resources->crtcs[i] == dev->crtc->crtc_id)
+            crtc_index = i;
+    }
+    if (crtc_index < 0 || drmSetClientCap(dev->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1))
+        return 0;
+
+    drmModePlaneRes *planes = drmModeGetPlaneResources(dev->fd);
+    if (!planes)
+        return 0;
+
+    uint32_t plane_id = 0;
+    for (uint32_t i = 0; i < planes->count_planes && !plane_id; i++) {
+        drmModePlane *plane = drmModeGetPlane(dev->fd, planes->planes[i]);
+        if (!plane)
+            continue;
+
+        uint64_t type;
+        if ((plane->possible_crtcs & (1u << crtc_index)) &&
+            !get_property(dev->fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", NULL, &type) &&
+            type == DRM_PLANE_TYPE_PRIMARY)
+            plane_id = plane->plane_id;
+        drmModeFreePlane(plane);
+    }
 
-		printf("Selected card: %s\n", cards[i]);
-	}
+    drmModeFreePlaneResources(planes);
+    return plane_id;
+}
 
-	if(dev->fd < 0){
-		printf("DRM Error: Couldn't find any card available\n");
-		return 1;
-	}
+static int init_drm(){
+    // Cards are probed in parallel, a slow driver (or one waiting on a connector) would
+    // otherwise hold up every card after it
+    struct card_probe probes[MAX_CARDS];
+    int count = 0;
+    DIR *dir = opendir("/dev/dri");
+    struct dirent *entry;
+    while (dir && count < MAX_CARDS && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "card", 4) != 0)
+            continue;
+
+        struct card_probe *probe = &probes[count];
+        memset(probe, 0, sizeof(*probe));
+        snprintf(probe->path, sizeof(probe->path), "/dev/dri/%s", entry->d_name);
+        probe->index = atoi(entry->d_name + 4);
+        if (pthread_create(&probe->thread, NULL, probe_card, probe))
+            probe_connectors(probe);
+        else
+            probe->thread_started = 1;
+        count++;
+    }
+    if (dir)
+        closedir(dir);
+
+    // Keep the lowest numbered card with a connected display, close the others
+    int selected = -1;
+    for (int i = 0; i < count; i++) {
+        if (probes[i].thread_started)
+            pthread_join(probes[i].thread, NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        if (probes[i].fd < 0)
+            continue;
+        if (selected < 0 || probes[i].index < probes[selected].index)
+            selected = i;
+    }
+    for (int i = 0; i < count; i++) {
+        if (i == selected || probes[i].fd < 0)
+            continue;
+        drmModeFreeConnector(probes[i].connector);
+        drmModeFreeResources(probes[i].resources);
+        close(probes[i].fd);
+    }
 
-    // Get DRM resources
-    dev->resources = drmModeGetResources(dev->fd);
-    if (!dev->resources) {
-        printf("DRM Error: Failed to get DRM resources\n");
-        close(dev->fd);
+    if (selected < 0) {
+        printf("DRM Error: Couldn't find any card with a connected display\n");
         return 1;
     }
 
-    // Select the first connected connector
-    dev->connector = NULL;
+    printf("Selected card: %s\n", probes[selected].path);
+    dev->fd = probes[selected].fd;
+    dev->resources = probes[selected].resources;
+    dev->connector = probes[selected].connector;
+    dev->connector_id = dev->connector->connector_id;
     dev->crtc = NULL;
-    dev->connector_id = -1;
-    for (int i = 0; i < dev->resources->count_connectors; i++) {
-        dev->connector = drmModeGetConnector(dev->fd, dev->resources->connectors[i]);
-        if (dev->connector && dev->connector->connection == DRM_MODE_CONNECTED) {
-            dev->connector_id = dev->connector->connector_id;
-            break;
-        }
-        drmModeFreeConnector(dev->connector);
-    }
-    if (!dev->connector_id) {
-        printf("DRM Error: No connected connector found\n");
-        drmModeFreeResources(dev->resources);
-        close(dev->fd);
-        return 1;
-    }
 
-    // Get the first valid mode
-    dev->mode = dev->connector->modes[0];
-    printf("Selected resolution: %dx%d\n", dev->mode.hdisplay, dev->mode.vdisplay);
+    dev->mode = *select_mode(dev->connector);
     dev->width = dev->mode.hdisplay;
     dev->height = dev->mode.vdisplay;
+    printf("Selected mode: %dx%d@%.2fHz\n", dev->mode.hdisplay, dev->mode.vdisplay, mode_refresh_mhz(&dev->mode) / 1000.0);
+
+    // Adaptive sync is enabled on the CRTC later, after the mode is set
+    uint64_t vrr_capable = 0;
+    dev->vrr = 0;
+    if (mode_config.vrr && !get_property(dev->fd, dev->connector_id, DRM_MODE_OBJECT_CONNECTOR, "vrr_capable", NULL, &vrr_capable))
+        dev->vrr = vrr_capable == 1;
 
     dev->encoder = drmModeGetEncoder(dev->fd, dev->connector->encoder_id);
     if (!dev->encoder) {
@@ -266,6 +435,8 @@ static int init_drm(){
     }
 
     dev->crtc = drmModeGetCrtc(dev->fd, dev->encoder->crtc_id);
+    if (dev->crtc)
+        dev->plane_id = find_primary_plane();
 
     return 0;
 }
@@ -277,6 +448,7 @@ static void free_drm(){
 	close(dev->fd);
 }
 
+// The surface itself is created by init_egl, once the format has been negotiated
 static int init_gbm(){
     // Create a GBM device
     dev->gbm = gbm_create_device(dev->fd);
@@ -285,26 +457,338 @@ static int init_gbm(){
         return 1;
     }
 
-    // Create a GBM surface
-    dev->gbm_surface = gbm_surface_create(dev->gbm, dev->width, dev->height,
-                                                     GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+    return 0;
+}
+
+#define MAX_MODIFIERS 32
+
+// Modifiers the primary plane can scan out in the surface format, from its IN_FORMATS blob
+static unsigned int get_plane_modifiers(uint64_t *modifiers){
+    uint64_t blob_id;
+    if (!dev->plane_id ||
+        get_property(dev->fd, dev->plane_id, DRM_MODE_OBJECT_PLANE, "IN_FORMATS", NULL, &blob_id) || !blob_id)
+        return 0;
+
+    drmModePropertyBlobRes *blob = drmModeGetPropertyBlob(dev->fd, blob_id);
+    if (!blob)
+        return 0;
+
+    const struct drm_format_modifier_blob *header = blob->data;
+    const uint32_t *formats = (const uint32_t *)((const char *)header + header->formats_offset);
+    const struct drm_format_modifier *mods =
+        (const struct drm_format_modifier *)((const char *)header + header->modifiers_offset);
+
+    unsigned int count = 0;
+    for (uint32_t f = 0; f < header->count_formats; f++) {
+        if (formats[f] != dev->format)
+            continue;
+
+        // Each modifier lists the formats it applies to as a 64 bit mask starting at offset
+        for (uint32_t m = 0; m < header->count_modifiers && count < MAX_MODIFIERS; m++) {
+            if (f >= mods[m].offset && f < mods[m].offset + 64 &&
+                (mods[m].formats & (1ull << (f - mods[m].offset))))
+                modifiers[count++] = mods[m].modifier;
+        }
+    }
+
+    drmModeFreePropertyBlob(blob);
+    return count;
+}
+
+// Creates the surface with the plane's modifiers so the driver can pick a tiled or compressed
+// layout. linear forces DRM_FORMAT_MOD_LINEAR, used when the display rejects the modifier.
+static int init_gbm_surface(int linear){
+    uint64_t modifiers[MAX_MODIFIERS];
+    unsigned int count = 0;
+    uint64_t cap = 0;
+
+    dev->modifiers = 0;
+    if (!drmGetCap(dev->fd, DRM_CAP_ADDFB2_MODIFIERS, &cap) && cap) {
+        if (linear) {
+            modifiers[0] = DRM_FORMAT_MOD_LINEAR;
+            count = 1;
+        }
+        else {
+            count = get_plane_modifiers(modifiers);
+        }
+    }
+
+    dev->gbm_surface = NULL;
+    if (count) {
+        dev->gbm_surface = gbm_surface_create_with_modifiers(dev->gbm, dev->width, dev->height,
+                                                             dev->format, modifiers, count);
+        dev->modifiers = dev->gbm_surface != NULL;
+    }
+    if (!dev->gbm_surface) {
+        dev->gbm_surface = gbm_surface_create(dev->gbm, dev->width, dev->height, dev->format,
+                                              GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING | (linear ? GBM_BO_USE_LINEAR : 0));
+    }
     if (!dev->gbm_surface) {
         printf("GBM Error: Failed to create GBM surface\n");
-        gbm_device_destroy(dev->gbm);
         return 1;
     }
 
     return 0;
 }
 
+// Adds a framebuffer for a GBM buffer, with its modifier when the surface was created with them
+static int add_framebuffer(struct gbm_bo *bo, uint32_t *fb){
+    uint32_t handles[4] = { 0 };
+    uint32_t strides[4] = { 0 };
+    uint32_t offsets[4] = { 0 };
+    uint64_t modifiers[4] = { 0 };
+
+    if (!dev->modifiers) {
+        handles[0] = gbm_bo_get_handle(bo).u32;
+        strides[0] = gbm_bo_get_stride(bo);
+        return drmModeAddFB2(dev->fd, dev->width, dev->height, dev->format, handles, strides, offsets, fb, 0);
+    }
+
+    int planes = gbm_bo_get_plane_count(bo);
+    for (int i = 0; i < planes && i < 4; i++) {
+        handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+        strides[i] = gbm_bo_get_stride_for_plane(bo, i);
+        offsets[i] = gbm_bo_get_offset(bo, i);
+        modifiers[i] = gbm_bo_get_modifier(bo);
+    }
+    return drmModeAddFB2WithModifiers(dev->fd, dev->width, dev->height, dev->format,
+                                      handles, strides, offsets, modifiers, fb, DRM_MODE_FB_MODIFIERS);
+}
+
 static void free_gbm(){
-	gbm_surface_destroy(dev->gbm_surface);
+	if (dev->gbm_surface)
+		gbm_surface_destroy(dev->gbm_surface);
+	dev->gbm_surface = NULL;
 	gbm_device_destroy(dev->gbm);
 }
 
+static void free_dumb(){
+	for (int i = 0; i < 2; i++) {
+		struct dumb_buffer *buf = &dev->dumb[i];
+		if (buf->map)
+			munmap(buf->map, buf->size);
+		if (buf->fb)
+			drmModeRmFB(dev->fd, buf->fb);
+		if (buf->handle) {
+			struct drm_mode_destroy_dumb destroy = { .handle = buf->handle };
+			drmIoctl(dev->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+		}
+		memset(buf, 0, sizeof(*buf));
+	}
+}
+
+static int init_dumb(){
+	uint64_t has_dumb = 0;
+	if (drmGetCap(dev->fd, DRM_CAP_DUMB_BUFFER, &has_dumb) || !has_dumb) {
+		printf("DRM Error: Device doesn't support dumb buffers\n");
+		return 1;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		struct dumb_buffer *buf = &dev->dumb[i];
+
+		struct drm_mode_create_dumb create = {
+			.width = dev->width,
+			.height = dev->height,
+			.bpp = 32,
+		};
+		if (drmIoctl(dev->fd, DRM_IOCTL_MODE_CREATE_DUMB, &create)) {
+			printf("DRM Error: Failed to create dumb buffer\n");
+			free_dumb();
+			return 1;
+		}
+		buf->handle = create.handle;
+		buf->pitch = create.pitch;
+		buf->size = create.size;
+
+		uint32_t handles[4] = { buf->handle };
+		uint32_t strides[4] = { buf->pitch };
+		uint32_t offsets[4] = { 0 };
+		if (drmModeAddFB2(dev->fd, dev->width, dev->height, DRM_FORMAT_XRGB8888,
+				handles, strides, offsets, &buf->fb, 0)) {
+			printf("DRM Error: Failed to create framebuffer\n");
+			free_dumb();
+			return 1;
+		}
+
+		struct drm_mode_map_dumb map = { .handle = buf->handle };
+		if (drmIoctl(dev->fd, DRM_IOCTL_MODE_MAP_DUMB, &map)) {
+			printf("DRM Error: Failed to map dumb buffer\n");
+			free_dumb();
+			return 1;
+		}
+		buf->map = mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, map.offset);
+		if (buf->map == MAP_FAILED) {
+			perror("mmap");
+			buf->map = NULL;
+			free_dumb();
+			return 1;
+		}
+	}
+
+	dev->back = 0;
+	dev->canvas.pixels = dev->dumb[0].map;
+	dev->canvas.width = dev->width;
+	dev->canvas.height = dev->height;
+	dev->canvas.stride = dev->dumb[0].pitch / sizeof(uint32_t);
+
+	// Scan out the cleared second buffer while the first one is drawn
+	struct sw_canvas front = dev->canvas;
+	front.pixels = dev->dumb[1].map;
+	front.stride = dev->dumb[1].pitch / sizeof(uint32_t);
+	sw_fill_rect(&front, 0, 0, dev->width, dev->height, 0xFF000000);
+
+	return 0;
+}
+
+// Offscreen rendering needs no DRM device, Mesa's surfaceless platform runs on any render
+// node or on llvmpipe
+static EGLDisplay get_offscreen_display() {
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (client_extensions && strstr(client_extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display)
+            return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// Offscreen and offload rendering don't draw into a GBM window surface
+static int uses_window_surface() {
+    return !dev->offscreen && !dev->offload;
+}
+
+static const struct {
+    uint32_t fourcc;
+    const char *name;
+    EGLint red, green, blue, alpha;
+} surface_formats[] = {
+    [SURFACE_XRGB8888]    = { DRM_FORMAT_XRGB8888,    "XRGB8888",    8,  8,  8,  0 },
+    [SURFACE_ARGB8888]    = { DRM_FORMAT_ARGB8888,    "ARGB8888",    8,  8,  8,  8 },
+    [SURFACE_RGB565]      = { DRM_FORMAT_RGB565,      "RGB565",      5,  6,  5,  0 },
+    [SURFACE_XRGB2101010] = { DRM_FORMAT_XRGB2101010, "XRGB2101010", 10, 10, 10, 0 },
+    [SURFACE_ARGB2101010] = { DRM_FORMAT_ARGB2101010, "ARGB2101010", 10, 10, 10, 2 },
+};
+
+// Formats tried for each requested format, in order
+#define FALLBACK_COUNT 5
+static const enum surface_format surface_fallbacks[][FALLBACK_COUNT] = {
+    [SURFACE_XRGB8888]    = { SURFACE_XRGB8888, SURFACE_ARGB8888, SURFACE_XRGB2101010, SURFACE_ARGB2101010, SURFACE_RGB565 },
+    [SURFACE_ARGB8888]    = { SURFACE_ARGB8888, SURFACE_XRGB8888, SURFACE_ARGB2101010, SURFACE_XRGB2101010, SURFACE_RGB565 },
+    [SURFACE_RGB565]      = { SURFACE_RGB565, SURFACE_XRGB8888, SURFACE_ARGB8888, SURFACE_XRGB2101010, SURFACE_ARGB2101010 },
+    [SURFACE_XRGB2101010] = { SURFACE_XRGB2101010, SURFACE_ARGB2101010, SURFACE_XRGB8888, SURFACE_ARGB8888, SURFACE_RGB565 },
+    [SURFACE_ARGB2101010] = { SURFACE_ARGB2101010, SURFACE_XRGB2101010, SURFACE_ARGB8888, SURFACE_XRGB8888, SURFACE_RGB565 },
+};
+
+static const struct surface_config default_surface = { SURFACE_XRGB8888, 24, 8, 4 };
+
+const char *renderer_surface_format_name(enum surface_format format){
+    if ((unsigned int)format >= sizeof(surface_formats) / sizeof(surface_formats[0]))
+        return "unknown";
+    return surface_formats[format].name;
+}
+
+// Finds the EGL config with exactly the format's channel sizes and sample count and the least
+// depth and stencil above the minimums. GBM window surfaces also need the config's native
+// visual to be the GBM format. Render offload takes any surface type: the GBM platform of a
+// render node has no pbuffers and export and import need no surface at all.
+static int find_egl_config(enum surface_format format, unsigned int depth, unsigned int stencil,
+                           unsigned int samples, EGLConfig *config){
+    EGLint attribs[] = {
+        EGL_SURFACE_TYPE, dev->offload ? 0 : dev->offscreen ? EGL_PBUFFER_BIT : EGL_WINDOW_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, surface_formats[format].red,
+        EGL_GREEN_SIZE, surface_formats[format].green,
+        EGL_BLUE_SIZE, surface_formats[format].blue,
+        EGL_ALPHA_SIZE, surface_formats[format].alpha,
+        EGL_DEPTH_SIZE, (EGLint)depth,
+        EGL_STENCIL_SIZE, (EGLint)stencil,
+        EGL_SAMPLE_BUFFERS, samples ? 1 : 0,
+        EGL_SAMPLES, (EGLint)samples,
+        EGL_NONE
+    };
+
+    EGLint count = 0;
+    if (!eglChooseConfig(dev->egl_display, attribs, NULL, 0, &count) || count < 1)
+        return 1;
+
+    EGLConfig *configs = malloc(count * sizeof(*configs));
+    if (!configs)
+        return 1;
+    eglChooseConfig(dev->egl_display, attribs, configs, count, &count);
+
+    int best = -1;
+    EGLint best_excess = 0;
+    for (int i = 0; i < count; i++) {
+        EGLint r, g, b, a, d, st, sa, visual;
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_RED_SIZE, &r);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_GREEN_SIZE, &g);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_BLUE_SIZE, &b);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_ALPHA_SIZE, &a);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_DEPTH_SIZE, &d);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_STENCIL_SIZE, &st);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_SAMPLES, &sa);
+        eglGetConfigAttrib(dev->egl_display, configs[i], EGL_NATIVE_VISUAL_ID, &visual);
+
+        if (r != surface_formats[format].red || g != surface_formats[format].green ||
+            b != surface_formats[format].blue || sa != (EGLint)samples)
+            continue;
+        if (uses_window_surface() ? (uint32_t)visual != surface_formats[format].fourcc : a < surface_formats[format].alpha)
+            continue;
+
+        EGLint excess = (d - (EGLint)depth) + (st - (EGLint)stencil);
+        if (best < 0 || excess < best_excess) {
+            best = i;
+            best_excess = excess;
+        }
+    }
+
+    if (best >= 0) {
+        *config = configs[best];
+        eglGetConfigAttrib(dev->egl_display, *config, EGL_DEPTH_SIZE, (EGLint *)&dev->surface.depth_bits);
+        eglGetConfigAttrib(dev->egl_display, *config, EGL_STENCIL_SIZE, (EGLint *)&dev->surface.stencil_bits);
+    }
+    free(configs);
+    return best < 0;
+}
+
+// Negotiates the surface: every format in the fallback order is tried with the requested
+// sample count halved down to none. Depth and stencil are never reduced.
+static int choose_surface(EGLConfig *config){
+    const struct surface_config want = dev->surface;
+    unsigned int samples = want.samples > 1 ? want.samples : 0;
+
+    for (int i = 0; i < FALLBACK_COUNT; i++) {
+        enum surface_format format = surface_fallbacks[want.format][i];
+        if (uses_window_surface() && !gbm_device_is_format_supported(dev->gbm, surface_formats[format].fourcc,
+                                                               GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING))
+            continue;
+
+        for (unsigned int s = samples; ; s = s > 2 ? s / 2 : 0) {
+            if (!find_egl_config(format, want.depth_bits, want.stencil_bits, s, config)) {
+                dev->surface.format = format;
+                dev->surface.samples = s;
+                dev->format = surface_formats[format].fourcc;
+                printf("Surface: %s, depth %u, stencil %u, %ux MSAA (requested %s, depth %u, stencil %u, %ux MSAA)\n",
+                       surface_formats[format].name, dev->surface.depth_bits, dev->surface.stencil_bits, s,
+                       surface_formats[want.format].name, want.depth_bits, want.stencil_bits, samples);
+                return 0;
+            }
+            if (!s)
+                break;
+        }
+    }
+
+    return 1;
+}
+
 static int init_egl() {
     // 1. Get EGL display
-    dev->egl_display = eglGetDisplay(dev->gbm);
+    if (dev->offload)
+        dev->egl_display = dev->render_gbm ? eglGetDisplay(dev->render_gbm) : get_offscreen_display();
+    else
+        dev->egl_display = dev->offscreen ? get_offscreen_display() : eglGetDisplay(dev->gbm);
     if (dev->egl_display == EGL_NO_DISPLAY) {
         printf("EGL Error: Failed to get EGL Display\n");
         return 1;
@@ -322,27 +806,15 @@ static int init_egl() {
         return 1;
     }
 
-    // 4. Choose EGL config
+    // 4. Choose EGL config and surface format
     EGLConfig config;
-    EGLint num_configs;
-    EGLint attribs[] = {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_RED_SIZE, 8,
-        EGL_GREEN_SIZE, 8,
-        EGL_BLUE_SIZE, 8,
-        EGL_ALPHA_SIZE, 8,
-        EGL_DEPTH_SIZE, 24,
-        EGL_STENCIL_SIZE, 8,
-        EGL_SAMPLE_BUFFERS, 1,
-        EGL_SAMPLES, 4,
-        EGL_NONE
-    };
-
-    if (!eglChooseConfig(dev->egl_display, attribs, &config, 1, &num_configs) || num_configs < 1) {
-        printf("EGL Error: No suitable EGL config found (0x%x)\n", eglGetError());
+    if (choose_surface(&config)) {
+        printf("EGL Error: No suitable EGL config found\n");
         return 1;
     }
+    if (uses_window_surface() && init_gbm_surface(0))
+        return 1;
+    dev->egl_config = config;
 
     // 5. Create EGL context
     EGLint contextAttribs[] = {
@@ -355,9 +827,25 @@ static int init_egl() {
         return 1;
     }
 
-    // 6. Create EGL surface
-    dev->egl_surface = eglCreateWindowSurface(dev->egl_display, config, (EGLNativeWindowType)dev->gbm_surface, NULL);
-    if (dev->egl_surface == EGL_NO_SURFACE) {
+    // 6. Create EGL surface. Render offload starts surfaceless if it can, only the copy path
+    // needs a pbuffer and init_offload_buffers creates it then.
+    const char *extensions = eglQueryString(dev->egl_display, EGL_EXTENSIONS);
+    int surfaceless = dev->offload && extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+    if (surfaceless) {
+        dev->egl_surface = EGL_NO_SURFACE;
+    }
+    else if (!uses_window_surface()) {
+        EGLint pbufferAttribs[] = {
+            EGL_WIDTH, (EGLint)dev->width,
+            EGL_HEIGHT, (EGLint)dev->height,
+            EGL_NONE
+        };
+        dev->egl_surface = eglCreatePbufferSurface(dev->egl_display, config, pbufferAttribs);
+    }
+    else {
+        dev->egl_surface = eglCreateWindowSurface(dev->egl_display, config, (EGLNativeWindowType)dev->gbm_surface, NULL);
+    }
+    if (dev->egl_surface == EGL_NO_SURFACE && !surfaceless) {
         printf("EGL Error: Failed to create window surface (0x%x)\n", eglGetError());
         eglDestroyContext(dev->egl_display, dev->context);
         return 1;
@@ -366,7 +854,8 @@ static int init_egl() {
     // 7. Make context current
     if (!eglMakeCurrent(dev->egl_display, dev->egl_surface, dev->egl_surface, dev->context)) {
         printf("EGL Error: Failed to make context current (0x%x)\n", eglGetError());
-        eglDestroySurface(dev->egl_display, dev->egl_surface);
+        if (dev->egl_surface != EGL_NO_SURFACE)
+            eglDestroySurface(dev->egl_display, dev->egl_surface);
         eglDestroyContext(dev->egl_display, dev->context);
         return 1;
     }
@@ -383,29 +872,105 @@ static int init_egl() {
 }
 
 static void free_egl(){
-	eglDestroySurface(dev->egl_display, dev->egl_surface);
+	if (dev->egl_surface != EGL_NO_SURFACE)
+		eglDestroySurface(dev->egl_display, dev->egl_surface);
 	eglDestroyContext(dev->egl_display, dev->context);
 	eglTerminate(dev->egl_display);
 }
 
-static int init_crtc(){
+// With adaptive sync a late frame is scanned out as soon as it is flipped instead of
+// waiting for the next fixed vblank
+static void enable_vrr(){
+	if (!dev->vrr)
+		return;
+
+	uint32_t prop_id;
+	if (get_property(dev->fd, dev->crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED", &prop_id, NULL) ||
+			drmModeObjectSetProperty(dev->fd, dev->crtc->crtc_id, DRM_MODE_OBJECT_CRTC, prop_id, 1)) {
+		printf("DRM Error: Failed to enable VRR\n");
+		dev->vrr = 0;
+		return;
+	}
+	printf("Variable refresh rate enabled\n");
+}
+
+static PFNEGLCREATESYNCKHRPROC egl_create_sync;
+static PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync;
+static PFNEGLDUPNATIVEFENCEFDANDROIDPROC egl_dup_native_fence_fd;
+
+// Picks how flips wait for the GPU. Legacy page flips of a GBM buffer on the same device
+// already wait for its rendering in the kernel, so they need neither a fence nor glFinish.
+static void init_sync(){
+    const char *extensions = eglQueryString(dev->egl_display, EGL_EXTENSIONS);
+    dev->kms_fence_fd = -1;
+
+    if (extensions && strstr(extensions, "EGL_KHR_fence_sync")) {
+        egl_create_sync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+        egl_destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+        dev->sync_khr = egl_create_sync && egl_destroy_sync;
+    }
+
+    if (dev->sync_khr && dev->plane_id && !dev->offload && strstr(extensions, "EGL_ANDROID_native_fence_sync")) {
+        egl_dup_native_fence_fd = (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)eglGetProcAddress("eglDupNativeFenceFDANDROID");
+        if (egl_dup_native_fence_fd && !drmSetClientCap(dev->fd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+            dev->atomic =
+                !get_property(dev->fd, dev->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID", &dev->fb_prop, NULL) &&
+                !get_property(dev->fd, dev->plane_id, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD", &dev->in_fence_prop, NULL) &&
+                !get_property(dev->fd, dev->crtc->crtc_id, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR", &dev->out_fence_prop, NULL);
+            if (!dev->atomic)
+                drmSetClientCap(dev->fd, DRM_CLIENT_CAP_ATOMIC, 0);
+        }
+    }
+
+    if (dev->atomic)
+        printf("Sync: atomic flips with IN_FENCE_FD/OUT_FENCE_PTR\n");
+    else if (dev->offload)
+        printf("Sync: glFinish\n");
+    else
+        printf("Sync: implicit\n");
+}
+
+static int first_frame = 1;
+
+// Waits until the last queued flip is on screen
+static void wait_for_flip(){
+    TRACE_BEGIN("wait for flip");
+    if (dev->atomic) {
+        if (dev->kms_fence_fd >= 0) {
+            struct pollfd pfd = { dev->kms_fence_fd, POLLIN, 0 };
+            poll(&pfd, 1, -1);
+            close(dev->kms_fence_fd);
+            dev->kms_fence_fd = -1;
+        }
+    }
+    else if (!first_frame) {
+        char buf[256];
+        read(dev->fd, buf, sizeof(buf));
+    }
+    first_frame = 0;
+    TRACE_END();
+}
+
+// Presents the first frame of the GBM surface with a modeset
+static int set_crtc_gbm(){
 	eglSwapBuffers(dev->egl_display, dev->egl_surface);
 
 	dev->previous_bo = gbm_surface_lock_front_buffer(dev->gbm_surface);
+	if (!dev->previous_bo) {
+		printf("GBM Error: Failed to lock front buffer\n");
+		return 1;
+	}
 
-	uint32_t handles[4] = { gbm_bo_get_handle(dev->previous_bo).u32 };
-	uint32_t strides[4] = { gbm_bo_get_stride(dev->previous_bo) };
-	uint32_t offsets[4] = { 0 };
-
-	if (drmModeAddFB2(dev->fd, dev->width, dev->height, GBM_FORMAT_XRGB8888,
-			handles, strides, offsets, &dev->previous_fb, 0)) {
+	if (add_framebuffer(dev->previous_bo, &dev->previous_fb)) {
 		printf("DRM Error: Failed to create framebuffer\n");
 		return 1;
 	}
 
-	// Set initial CRTC (only once!)
-	if (drmModeSetCrtc(dev->fd, dev->crtc->crtc_id, dev->previous_fb, 0, 0,
-			&dev->connector_id, 1, &dev->mode)) {
+	TRACE_BEGIN("drmModeSetCrtc");
+	int ret = drmModeSetCrtc(dev->fd, dev->crtc->crtc_id, dev->previous_fb, 0, 0,
+			&dev->connector_id, 1, &dev->mode);
+	TRACE_END();
+	if (ret) {
 		printf("DRM Error: Failed to set CRTC\n");
 		return 1;
 	}
@@ -413,40 +978,170 @@ static int init_crtc(){
 	return 0;
 }
 
-static int first_frame = 1;
+// The display rejected the tiled/compressed buffers: recreate the GBM and EGL surfaces with a
+// linear layout and set the mode again. The old buffers stay on screen until the new one is.
+static int fallback_to_linear(){
+	if (dev->linear) {
+		printf("DRM Error: Linear scanout failed too\n");
+		return 1;
+	}
+	dev->linear = 1;
+
+	printf("DRM: Scanout with modifier 0x%llx failed, falling back to linear\n",
+	       dev->previous_bo ? (unsigned long long)gbm_bo_get_modifier(dev->previous_bo) : 0ull);
+
+	wait_for_flip();
+	first_frame = 1;
+
+	struct gbm_surface *old_surface = dev->gbm_surface;
+	struct gbm_bo *old_bo = dev->previous_bo;
+	uint32_t old_fb = dev->previous_fb;
+	dev->previous_bo = NULL;
+	dev->previous_fb = 0;
+
+	eglMakeCurrent(dev->egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroySurface(dev->egl_display, dev->egl_surface);
+
+	int ret = init_gbm_surface(1);
+	if (!ret) {
+		dev->egl_surface = eglCreateWindowSurface(dev->egl_display, dev->egl_config,
+		                                          (EGLNativeWindowType)dev->gbm_surface, NULL);
+		ret = dev->egl_surface == EGL_NO_SURFACE ||
+		      !eglMakeCurrent(dev->egl_display, dev->egl_surface, dev->egl_surface, dev->context);
+		if (ret)
+			printf("EGL Error: Failed to recreate window surface (0x%x)\n", eglGetError());
+	}
+	if (!ret) {
+		glClearColor(0, 0, 0, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+		ret = set_crtc_gbm();
+	}
+
+	if (old_fb)
+		drmModeRmFB(dev->fd, old_fb);
+	if (old_bo)
+		gbm_surface_release_buffer(old_surface, old_bo);
+	gbm_surface_destroy(old_surface);
+	return ret;
+}
+
+static int init_crtc(){
+	if (dev->software || dev->offload) {
+		uint32_t fb = dev->offload ? dev->offload_buffers[1].fb : dev->dumb[1].fb;
+		if (drmModeSetCrtc(dev->fd, dev->crtc->crtc_id, fb, 0, 0, &dev->connector_id, 1, &dev->mode)) {
+			printf("DRM Error: Failed to set CRTC\n");
+			return 1;
+		}
+		first_frame = 1;
+		enable_vrr();
+		return 0;
+	}
+
+	// Set initial CRTC (only once!)
+	first_frame = 1;
+	if (set_crtc_gbm() && (!dev->modifiers || fallback_to_linear()))
+		return 1;
+	enable_vrr();
+
+	return 0;
+}
+
+// Queues the flip with an atomic commit. The kernel waits for the GPU fence itself, so the CPU
+// only blocks when the previous flip hasn't completed yet.
+static int commit_atomic(uint32_t fb, int gpu_fence_fd){
+	drmModeAtomicReq *req = drmModeAtomicAlloc();
+	if (!req)
+		return 1;
+
+	drmModeAtomicAddProperty(req, dev->plane_id, dev->fb_prop, fb);
+	if (gpu_fence_fd >= 0)
+		drmModeAtomicAddProperty(req, dev->plane_id, dev->in_fence_prop, gpu_fence_fd);
+	drmModeAtomicAddProperty(req, dev->crtc->crtc_id, dev->out_fence_prop, (uint64_t)(uintptr_t)&dev->kms_fence_fd);
+
+	int ret = drmModeAtomicCommit(dev->fd, req, DRM_MODE_ATOMIC_NONBLOCK, NULL);
+	drmModeAtomicFree(req);
+	if (ret)
+		dev->kms_fence_fd = -1;
+	return ret;
+}
+
+// Fence signalled when the GPU has finished everything submitted so far, -1 if unavailable
+static int gpu_fence_fd(){
+	EGLint attribs[] = { EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID, EGL_NONE };
+	EGLSyncKHR sync = egl_create_sync(dev->egl_display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+	if (sync == EGL_NO_SYNC_KHR)
+		return -1;
+
+	glFlush(); // The fd exists once the fence has been submitted
+	int fd = egl_dup_native_fence_fd(dev->egl_display, sync);
+	egl_destroy_sync(dev->egl_display, sync);
+	return fd;
+}
+
 static int swap_buffers() {
-	glFinish();
+	int ret;
+	TRACE_BEGIN("eglSwapBuffers");
 	eglSwapBuffers(dev->egl_display, dev->egl_surface);
+	TRACE_END();
+
+	// eglSwapBuffers flushed the frame, a legacy flip waits for it in the kernel
+	int fence_fd = dev->atomic ? gpu_fence_fd() : -1;
 
 	struct gbm_bo *bo = gbm_surface_lock_front_buffer(dev->gbm_surface);
 	if(!bo){
 		printf("GBM Error: Failed to lock front buffer\n");
+		if (fence_fd >= 0)
+			close(fence_fd);
 		return 1;
 	}
 
 	uint32_t fb;
-	uint32_t handles[4] = { gbm_bo_get_handle(bo).u32 };
-	uint32_t strides[4] = { gbm_bo_get_stride(bo) };
-	uint32_t offsets[4] = { 0 };
-
-	if (drmModeAddFB2(dev->fd, dev->width, dev->height, GBM_FORMAT_XRGB8888,
-			handles, strides, offsets, &fb, 0)) {
+	TRACE_BEGIN("drmModeAddFB2");
+	ret = add_framebuffer(bo, &fb);
+	TRACE_END();
+	if (ret) {
 		gbm_surface_release_buffer(dev->gbm_surface, bo);
+		if (fence_fd >= 0)
+			close(fence_fd);
+		if (dev->modifiers)
+			return fallback_to_linear();
 		printf("DRM Error: Failed to create framebuffer\n");
 		return 1;
 	}
 
-	if (first_frame) {
-		first_frame = 0;
+	// The GPU keeps rendering while the previous flip completes
+	wait_for_flip();
+
+	if (dev->atomic) {
+		TRACE_BEGIN("drmModeAtomicCommit");
+		ret = commit_atomic(fb, fence_fd);
+		TRACE_END();
+		if (ret) {
+			// Some drivers reject atomic flips on a CRTC set up with the legacy API
+			printf("DRM: Atomic flip failed, falling back to legacy page flips\n");
+			dev->atomic = 0;
+			drmSetClientCap(dev->fd, DRM_CLIENT_CAP_ATOMIC, 0);
+			if (fence_fd >= 0) {
+				struct pollfd pfd = { fence_fd, POLLIN, 0 };
+				poll(&pfd, 1, -1);
+			}
+			ret = drmModePageFlip(dev->fd, dev->crtc->crtc_id, fb, DRM_MODE_PAGE_FLIP_EVENT, NULL);
+		}
+		if (fence_fd >= 0)
+			close(fence_fd);
 	}
 	else {
-		char buf[256];
-		read(dev->fd, buf, sizeof(buf));
+		// Page Flipping
+		TRACE_BEGIN("drmModePageFlip");
+		ret = drmModePageFlip(dev->fd, dev->crtc->crtc_id, fb, DRM_MODE_PAGE_FLIP_EVENT, NULL);
+		TRACE_END();
 	}
-
-	// Page Flipping
-	if (drmModePageFlip(dev->fd, dev->crtc->crtc_id, fb, DRM_MODE_PAGE_FLIP_EVENT, NULL)) {
+	if (ret) {
 		drmModeRmFB(dev->fd, fb);
+		gbm_surface_release_buffer(dev->gbm_surface, bo);
+		first_frame = 1; // Nothing queued
+		if (dev->modifiers)
+			return fallback_to_linear();
 		printf("DRM Error: Failed to page flip\n");
 		return 1;
 	}
@@ -459,114 +1154,877 @@ static int swap_buffers() {
 	return 0;
 }
 
-static void update_fps() {
-    // For fps calculation
-    static unsigned int frame_count = 0;
-    static float fps = 0.0f;
-    static struct timeval last_time = {0};
+// Double buffered dumb buffers: the buffer that was just replaced by the flip is drawn next,
+// so the flip has to complete before returning.
+static int swap_dumb_buffers() {
+	struct dumb_buffer *buf = &dev->dumb[dev->back];
 
-    struct timeval current_time;
-    gettimeofday(&current_time, NULL);
+	TRACE_BEGIN("drmModePageFlip");
+	int ret = drmModePageFlip(dev->fd, dev->crtc->crtc_id, buf->fb, DRM_MODE_PAGE_FLIP_EVENT, NULL);
+	TRACE_END();
+	if (ret) {
+		printf("DRM Error: Failed to page flip\n");
+		return 1;
+	}
 
-    // Calculate the time difference in seconds
-    float time_diff = (current_time.tv_sec - last_time.tv_sec) +
-                      (current_time.tv_usec - last_time.tv_usec) / 1000000.0f;
+	TRACE_BEGIN("wait for flip");
+	char event[256];
+	read(dev->fd, event, sizeof(event));
+	TRACE_END();
 
-    // Increment frame count
-    frame_count++;
+	dev->back ^= 1;
+	dev->canvas.pixels = dev->dumb[dev->back].map;
+	dev->canvas.stride = dev->dumb[dev->back].pitch / sizeof(uint32_t);
 
-    // If 0.5 second has passed, update the FPS
-    if (time_diff >= 0.5f) {
-        fps = frame_count / time_diff;
-        // Reset for the next second
-        frame_count = 0;
-        last_time = current_time;
-    }
-	draw_fps_number((int)fps, 10, 10, 3.0f);
+	return 0;
 }
 
-int init_renderer(func_t init_f, func_t draw_f, func_t clean_f){
-	if(dev){
-		printf("Renderer Error: Renderer have already initialized\n");
-		return 1;
-	}
-	else if(!init_f){
-		printf("Renderer Error: Invalid init function\n");
+// Nothing is displayed, but the frame has to be finished to be measured
+static int swap_offscreen() {
+	TRACE_BEGIN("eglSwapBuffers");
+	eglSwapBuffers(dev->egl_display, dev->egl_surface);
+	TRACE_END();
+	TRACE_BEGIN("glFinish");
+	glFinish();
+	TRACE_END();
+	return 0;
+}
+
+// Render offload: the GL context runs on another device than the display card, e.g. a discrete
+// GPU, the GPU of a board whose display controller can't render, or llvmpipe. Frames are drawn
+// straight into one of two scanout buffers shared with the display card through PRIME and
+// flipped like the dumb buffers of the software renderer.
+
+#define MAX_RENDER_NODES 16
+
+// First render node that belongs to another device than the display card
+static int open_other_render_node(){
+	drmDevicePtr display = NULL;
+	if (drmGetDevice2(dev->fd, 0, &display))
+		return -1;
+
+	int found = -1;
+	for (int i = 0; i < MAX_RENDER_NODES && found < 0; i++) {
+		char path[32];
+		snprintf(path, sizeof(path), "/dev/dri/renderD%d", 128 + i);
+		int fd = open(path, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		drmDevicePtr device = NULL;
+		if (!drmGetDevice2(fd, 0, &device) && !drmDevicesEqual(device, display)) {
+			printf("Offload: Using %s\n", path);
+			found = fd;
+		}
+		else {
+			close(fd);
+		}
+		if (device)
+			drmFreeDevice(&device);
+	}
+
+	drmFreeDevice(&display);
+	return found;
+}
+
+// Opens the render device: a DRM node path, "auto" for a render node of another device, or
+// "surfaceless" for Mesa's surfaceless platform (llvmpipe with LIBGL_ALWAYS_SOFTWARE=1)
+static int open_render_device(const char *name){
+	dev->render_fd = -1;
+	if (!strcmp(name, "surfaceless"))
+		return 0;
+
+	dev->render_fd = !strcmp(name, "auto") ? open_other_render_node() : open(name, O_RDWR | O_CLOEXEC);
+	if (dev->render_fd < 0) {
+		printf("Offload Error: No render device %s\n", name);
+		return 1;
+	}
+
+	dev->render_gbm = gbm_create_device(dev->render_fd);
+	if (!dev->render_gbm) {
+		printf("Offload Error: Failed to create GBM device on %s\n", name);
+		close(dev->render_fd);
+		dev->render_fd = -1;
+		return 1;
+	}
+	return 0;
+}
+
+static void close_render_device(){
+	if (dev->render_gbm)
+		gbm_device_destroy(dev->render_gbm);
+	dev->render_gbm = NULL;
+	if (dev->render_fd >= 0)
+		close(dev->render_fd);
+	dev->render_fd = -1;
+}
+
+static PFNEGLCREATEIMAGEKHRPROC egl_create_image;
+static PFNEGLDESTROYIMAGEKHRPROC egl_destroy_image;
+static PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC gl_image_target_renderbuffer;
+
+static void free_offload_buffers(){
+	for (int i = 0; i < 2; i++) {
+		struct offload_buffer *buf = &dev->offload_buffers[i];
+		if (buf->framebuffer)
+			glDeleteFramebuffers(1, &buf->framebuffer);
+		if (buf->renderbuffer)
+			glDeleteRenderbuffers(1, &buf->renderbuffer);
+		if (buf->image != EGL_NO_IMAGE_KHR)
+			egl_destroy_image(dev->egl_display, buf->image);
+
+		// Dumb buffer framebuffers belong to free_dumb
+		if (buf->bo) {
+			if (buf->fb)
+				drmModeRmFB(dev->fd, buf->fb);
+			if (buf->handle) {
+				struct drm_gem_close close_handle = { .handle = buf->handle };
+				drmIoctl(dev->fd, DRM_IOCTL_GEM_CLOSE, &close_handle);
+			}
+			gbm_bo_destroy(buf->bo);
+		}
+		memset(buf, 0, sizeof(*buf));
+	}
+}
+
+static void free_offload(){
+	free_offload_buffers();
+	if (dev->offload_stencil && dev->offload_stencil != dev->offload_depth)
+		glDeleteRenderbuffers(1, &dev->offload_stencil);
+	dev->offload_stencil = 0;
+	if (dev->offload_depth)
+		glDeleteRenderbuffers(1, &dev->offload_depth);
+	dev->offload_depth = 0;
+	if (dev->offload_framebuffer)
+		glDeleteFramebuffers(1, &dev->offload_framebuffer);
+	dev->offload_framebuffer = 0;
+	if (dev->offload_texture)
+		glDeleteTextures(1, &dev->offload_texture);
+	dev->offload_texture = 0;
+	if (dev->offload_program)
+		glDeleteProgram(dev->offload_program);
+	dev->offload_program = 0;
+	free(dev->offload_staging);
+	dev->offload_staging = NULL;
+
+	// The next DRM master expects the plane unrotated
+	if (dev->offload_reflected)
+		drmModeObjectSetProperty(dev->fd, dev->plane_id, DRM_MODE_OBJECT_PLANE, dev->rotation_prop, DRM_MODE_ROTATE_0);
+	dev->offload_reflected = 0;
+}
+
+// Makes an XRGB8888 dma-buf the color buffer of a framebuffer on the render device. The
+// EGLImage holds its own reference, the caller still closes fd.
+static int bind_offload_buffer(struct offload_buffer *buf, int fd, uint32_t stride){
+	EGLint attribs[] = {
+		EGL_WIDTH, (EGLint)dev->width,
+		EGL_HEIGHT, (EGLint)dev->height,
+		EGL_LINUX_DRM_FOURCC_EXT, DRM_FORMAT_XRGB8888,
+		EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+		EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+		EGL_DMA_BUF_PLANE0_PITCH_EXT, (EGLint)stride,
+		EGL_NONE
+	};
+	buf->image = egl_create_image(dev->egl_display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+	if (buf->image == EGL_NO_IMAGE_KHR)
+		return 1;
+
+	glGenRenderbuffers(1, &buf->renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, buf->renderbuffer);
+	gl_image_target_renderbuffer(GL_RENDERBUFFER, (GLeglImageOES)buf->image);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &buf->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, buf->framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, buf->renderbuffer);
+	int ret = glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE;
+	if (!ret) {
+		glClearColor(0, 0, 0, 1);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return ret;
+}
+
+// Linear buffers allocated on the render device and imported into the display card. Fails
+// when the display can't scan them out, e.g. a display controller that needs contiguous memory.
+static int export_offload_buffers(){
+	for (int i = 0; i < 2; i++) {
+		struct offload_buffer *buf = &dev->offload_buffers[i];
+		buf->bo = gbm_bo_create(dev->render_gbm, dev->width, dev->height, GBM_FORMAT_XRGB8888,
+		                        GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+		if (!buf->bo)
+			return 1;
+
+		int fd = gbm_bo_get_fd(buf->bo);
+		if (fd < 0)
+			return 1;
+
+		uint32_t handles[4] = { 0 };
+		uint32_t strides[4] = { gbm_bo_get_stride(buf->bo) };
+		uint32_t offsets[4] = { 0 };
+		int ret = drmPrimeFDToHandle(dev->fd, fd, &buf->handle);
+		if (!ret) {
+			handles[0] = buf->handle;
+			ret = drmModeAddFB2(dev->fd, dev->width, dev->height, DRM_FORMAT_XRGB8888,
+			                    handles, strides, offsets, &buf->fb, 0);
+		}
+		if (!ret)
+			ret = bind_offload_buffer(buf, fd, strides[0]);
+		close(fd);
+		if (ret)
+			return 1;
+	}
+	return 0;
+}
+
+// The display card's dumb buffers exported and imported into the render device
+static int import_offload_buffers(){
+	if (!dev->dumb[0].map && init_dumb())
+		return 1;
+
+	for (int i = 0; i < 2; i++) {
+		int fd;
+		if (drmPrimeHandleToFD(dev->fd, dev->dumb[i].handle, DRM_CLOEXEC | DRM_RDWR, &fd))
+			return 1;
+		dev->offload_buffers[i].fb = dev->dumb[i].fb;
+		int ret = bind_offload_buffer(&dev->offload_buffers[i], fd, dev->dumb[i].pitch);
+		close(fd);
+		if (ret)
+			return 1;
+	}
+	return 0;
+}
+
+// Draws the offload texture into the shared buffers upside down, GL rows start at the bottom
+static int init_offload_program(){
+	const char *vertex_shader =
+		"attribute vec2 a_Position;"
+		"varying vec2 v_TexCoord;"
+		"void main() {"
+		"    v_TexCoord = vec2(a_Position.x + 1.0, 1.0 - a_Position.y) * 0.5;"
+		"    gl_Position = vec4(a_Position, 0.0, 1.0);"
+		"}";
+	const char *fragment_shader =
+		"precision mediump float;"
+		"uniform sampler2D u_Texture;"
+		"varying vec2 v_TexCoord;"
+		"void main() { gl_FragColor = texture2D(u_Texture, v_TexCoord); }";
+
+	dev->offload_program = createProgram(vertex_shader, fragment_shader);
+	if (!dev->offload_program)
+		return 1;
+	dev->offload_pos_attrib = glGetAttribLocation(dev->offload_program, "a_Position");
+	dev->offload_tex_uniform = glGetUniformLocation(dev->offload_program, "u_Texture");
+
+	glGenTextures(1, &dev->offload_texture);
+	glBindTexture(GL_TEXTURE_2D, dev->offload_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, dev->width, dev->height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &dev->offload_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, dev->offload_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dev->offload_texture, 0);
+	return 0;
+}
+
+// Framebuffer the frame is drawn into: the back buffer, or the texture it is flipped from
+static GLuint offload_target(){
+	return dev->offload_framebuffer ? dev->offload_framebuffer : dev->offload_buffers[dev->back].framebuffer;
+}
+
+static GLuint create_offload_renderbuffer(GLenum format){
+	GLuint renderbuffer;
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, format, dev->width, dev->height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	return renderbuffer;
+}
+
+// Gives the bound framebuffer the depth and stencil buffers of the surface
+static int attach_offload_depth(){
+	if (dev->offload_depth)
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, dev->offload_depth);
+	if (dev->offload_stencil)
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, dev->offload_stencil);
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE;
+}
+
+// Scanout buffers drawn by GL are bottom-up. Reflecting the primary plane turns them the right
+// way up for free; planes that can't do it get the frames through a texture drawn upside down.
+static int reflect_plane(){
+	if (!dev->plane_id ||
+			get_property(dev->fd, dev->plane_id, DRM_MODE_OBJECT_PLANE, "rotation", &dev->rotation_prop, NULL))
+		return 1;
+	return drmModeObjectSetProperty(dev->fd, dev->plane_id, DRM_MODE_OBJECT_PLANE, dev->rotation_prop,
+	                                DRM_MODE_ROTATE_0 | DRM_MODE_REFLECT_Y) != 0;
+}
+
+// Sets up rendering into the shared buffers of export and import. The surface's depth and
+// stencil become renderbuffers; MSAA would need a resolve copy again, so there is none.
+static int init_offload_framebuffers(){
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	int depth = dev->surface.depth_bits > 0, stencil = dev->surface.stencil_bits > 0;
+	if ((depth || stencil) && extensions && strstr(extensions, "GL_OES_packed_depth_stencil")) {
+		dev->offload_depth = create_offload_renderbuffer(GL_DEPTH24_STENCIL8_OES);
+		dev->offload_stencil = dev->offload_depth;
+		dev->surface.depth_bits = 24;
+		dev->surface.stencil_bits = 8;
+	}
+	else {
+		if (depth)
+			dev->offload_depth = create_offload_renderbuffer(GL_DEPTH_COMPONENT16);
+		if (stencil)
+			dev->offload_stencil = create_offload_renderbuffer(GL_STENCIL_INDEX8);
+		dev->surface.depth_bits = depth ? 16 : 0;
+		dev->surface.stencil_bits = stencil ? 8 : 0;
+	}
+	if (dev->surface.samples)
+		printf("Offload: No MSAA when rendering into the scanout buffers\n");
+	dev->surface.format = SURFACE_XRGB8888;
+	dev->surface.samples = 0;
+	dev->format = DRM_FORMAT_XRGB8888;
+
+	dev->offload_reflected = !reflect_plane();
+	if (!dev->offload_reflected && init_offload_program())
+		return 1;
+
+	int ret = dev->offload_framebuffer && attach_offload_depth();
+	for (int i = 0; i < 2 && !dev->offload_framebuffer && !ret; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, dev->offload_buffers[i].framebuffer);
+		ret = attach_offload_depth();
+	}
+
+	// A surfaceless context starts with an empty viewport
+	glBindFramebuffer(GL_FRAMEBUFFER, offload_target());
+	glViewport(0, 0, dev->width, dev->height);
+	glFinish();
+	printf("Offload: Rendering into the scanout buffers, %s\n",
+	       dev->offload_reflected ? "reflected by the plane" : "flipped through a texture");
+	return ret;
+}
+
+// The copy path reads frames back from a pbuffer
+static int create_offload_pbuffer(){
+	if (dev->egl_surface != EGL_NO_SURFACE)
+		return 0;
+
+	EGLint attribs[] = {
+		EGL_WIDTH, (EGLint)dev->width,
+		EGL_HEIGHT, (EGLint)dev->height,
+		EGL_NONE
+	};
+	dev->egl_surface = eglCreatePbufferSurface(dev->egl_display, dev->egl_config, attribs);
+	if (dev->egl_surface == EGL_NO_SURFACE ||
+			!eglMakeCurrent(dev->egl_display, dev->egl_surface, dev->egl_surface, dev->context)) {
+		printf("Offload Error: The render device has no pbuffer for the copy path (0x%x)\n", eglGetError());
+		return 1;
+	}
+	return 0;
+}
+
+// Picks the cheapest way to share frames with the display card: buffers of the render device
+// scanned out directly, dumb buffers rendered to by the render device, or a CPU copy into dumb
+// buffers when neither side can import the other's buffers. Needs the render context current.
+static int init_offload_buffers(){
+	const char *extensions = eglQueryString(dev->egl_display, EGL_EXTENSIONS);
+	egl_create_image = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
+	egl_destroy_image = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress("eglDestroyImageKHR");
+	gl_image_target_renderbuffer =
+		(PFNGLEGLIMAGETARGETRENDERBUFFERSTORAGEOESPROC)eglGetProcAddress("glEGLImageTargetRenderbufferStorageOES");
+	int shared = extensions && strstr(extensions, "EGL_EXT_image_dma_buf_import") &&
+	             egl_create_image && egl_destroy_image && gl_image_target_renderbuffer;
+
+	if (shared && dev->render_gbm) {
+		if (!export_offload_buffers()) {
+			dev->offload = OFFLOAD_EXPORT;
+			return init_offload_framebuffers();
+		}
+		printf("Offload: The display card can't import the render device's buffers\n");
+		free_offload_buffers();
+	}
+	if (shared) {
+		if (!import_offload_buffers()) {
+			dev->offload = OFFLOAD_IMPORT;
+			return init_offload_framebuffers();
+		}
+		printf("Offload: The render device can't import the display card's buffers\n");
+		free_offload_buffers();
+	}
+
+	if (create_offload_pbuffer() || (!dev->dumb[0].map && init_dumb()))
+		return 1;
+	dev->offload_staging = malloc((size_t)dev->width * dev->height * 4);
+	if (!dev->offload_staging) {
+		printf("Offload Error: Malloc failed\n");
+		return 1;
+	}
+	for (int i = 0; i < 2; i++)
+		dev->offload_buffers[i].fb = dev->dumb[i].fb;
+	dev->offload = OFFLOAD_COPY;
+	return 0;
+}
+
+// SIMPLE_DRM_RENDER_DEVICE overrides renderer_set_render_device. Returns 1 when rendering
+// stays on the display card.
+static int init_offload(){
+	const char *device = getenv("SIMPLE_DRM_RENDER_DEVICE");
+	if (!device || !*device)
+		device = mode_config.render_device;
+	if (!*device || open_render_device(device))
+		return 1;
+
+	// Any device can use the copy path, init_offload_buffers picks a better one if it can
+	dev->offload = OFFLOAD_COPY;
+	int ret = init_egl();
+	if (ret) {
+		if (dev->egl_display != EGL_NO_DISPLAY)
+			eglTerminate(dev->egl_display);
+	}
+	else if ((ret = init_offload_buffers())) {
+		free_offload();
+		free_egl();
+	}
+	if (ret) {
+		free_dumb();
+		close_render_device();
+		dev->offload = OFFLOAD_NONE;
+		printf("Offload: Failed, rendering on the display card\n");
+		return 1;
+	}
+
+	printf("Offload: %s, %ux%u scanout buffers shared by %s\n", eglQueryString(dev->egl_display, EGL_VENDOR),
+	       dev->width, dev->height, offload_mode_names[dev->offload]);
+	init_sync();
+	return 0;
+}
+
+// Draws the frame from the offload texture into a shared buffer when the plane can't reflect
+// it. The state the user may have enabled for the whole program is restored afterwards.
+static void draw_offload_frame(struct offload_buffer *buf){
+	static const GLenum caps[] = { GL_BLEND, GL_DEPTH_TEST, GL_STENCIL_TEST, GL_SCISSOR_TEST, GL_CULL_FACE };
+	static const float quad[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+	GLboolean enabled[sizeof(caps) / sizeof(caps[0])];
+	for (unsigned int i = 0; i < sizeof(caps) / sizeof(caps[0]); i++) {
+		enabled[i] = glIsEnabled(caps[i]);
+		glDisable(caps[i]);
+	}
+
+	TRACE_BEGIN("flip frame");
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, dev->offload_texture);
+	glBindFramebuffer(GL_FRAMEBUFFER, buf->framebuffer);
+	glViewport(0, 0, dev->width, dev->height);
+	glUseProgram(dev->offload_program);
+	glUniform1i(dev->offload_tex_uniform, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glVertexAttribPointer(dev->offload_pos_attrib, 2, GL_FLOAT, GL_FALSE, 0, quad);
+	glEnableVertexAttribArray(dev->offload_pos_attrib);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glDisableVertexAttribArray(dev->offload_pos_attrib);
+	TRACE_END();
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+	for (unsigned int i = 0; i < sizeof(caps) / sizeof(caps[0]); i++) {
+		if (enabled[i])
+			glEnable(caps[i]);
+	}
+}
+
+// Copy path: the whole frame is read back once, then written row by row into the write
+// combined dumb buffer, bottom row first and with R and B swapped for XRGB8888
+static void copy_offload_frame(struct dumb_buffer *dst){
+	unsigned int row = dev->width * 4;
+
+	TRACE_BEGIN("glReadPixels");
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, dev->width, dev->height, GL_RGBA, GL_UNSIGNED_BYTE, dev->offload_staging);
+	TRACE_END();
+
+	TRACE_BEGIN("copy to scanout");
+	for (unsigned int y = 0; y < dev->height; y++) {
+		convert_rgba_bgra((uint8_t *)dst->map + (size_t)(dev->height - 1 - y) * dst->pitch, dst->pitch,
+		                  dev->offload_staging + (size_t)y * row, row, dev->width, 1);
+	}
+	TRACE_END();
+}
+
+// Stands for the screen, 0 unless export or import draw into the scanout buffers
+static GLuint screen_framebuffer(){
+	return dev->offload == OFFLOAD_EXPORT || dev->offload == OFFLOAD_IMPORT ? offload_target() : 0;
+}
+
+// Export and import draw into the back buffer when the plane reflects it. It was on screen
+// until the last flip completed, so that flip is waited for before draw().
+static void begin_offload_frame(){
+	if (dev->offload != OFFLOAD_EXPORT && dev->offload != OFFLOAD_IMPORT)
+		return;
+
+	if (!dev->offload_framebuffer)
+		wait_for_flip();
+	glBindFramebuffer(GL_FRAMEBUFFER, offload_target());
+}
+
+// The other modes wait for the last flip here, before the frame goes into the back buffer.
+// Buffers shared with another device aren't covered by the flip's implicit fencing on every
+// driver, so the render device has to finish before flipping. That is a full CPU wait either
+// way, waiting on an EGL fence here would gain nothing over glFinish.
+static int swap_offload() {
+	struct offload_buffer *buf = &dev->offload_buffers[dev->back];
+	if (dev->offload == OFFLOAD_COPY) {
+		wait_for_flip();
+		copy_offload_frame(&dev->dumb[dev->back]);
+	}
+	else {
+		if (dev->offload_framebuffer) {
+			wait_for_flip();
+			draw_offload_frame(buf);
+		}
+		TRACE_BEGIN("glFinish");
+		glFinish();
+		TRACE_END();
+	}
+
+	TRACE_BEGIN("drmModePageFlip");
+	int ret = drmModePageFlip(dev->fd, dev->crtc->crtc_id, buf->fb, DRM_MODE_PAGE_FLIP_EVENT, NULL);
+	TRACE_END();
+	if (ret) {
+		first_frame = 1; // Nothing queued
+		printf("DRM Error: Failed to page flip\n");
+		return 1;
+	}
+
+	dev->back ^= 1;
+	return 0;
+}
+
+static void update_fps() {
+    // For fps calculation
+    static unsigned int frame_count = 0;
+    static float fps = 0.0f;
+    static struct timeval last_time = {0};
+
+    struct timeval current_time;
+    gettimeofday(&current_time, NULL);
+
+    // Calculate the time difference in seconds
+    float time_diff = (current_time.tv_sec - last_time.tv_sec) +
+                      (current_time.tv_usec - last_time.tv_usec) / 1000000.0f;
+
+    // Increment frame count
+    frame_count++;
+
+    // If 0.5 second has passed, update the FPS
+    if (time_diff >= 0.5f) {
+        fps = frame_count / time_diff;
+        TRACE_COUNTER("fps", (int64_t)fps);
+        // Reset for the next second
+        frame_count = 0;
+        last_time = current_time;
+    }
+	if (overlay_enabled) {
+		// 24 pixel glyphs up to 1080 lines, growing with the panel beyond that
+		float size = dev->height > 1080 ? 24.0f * dev->height / 1080 : 24.0f;
+		const char *buf = frame_printf("%d", (int)fps);
+		if (!buf)
+			return;
+		text_draw(buf, 10, 10, size, OVERLAY_YELLOW);
+		draw_pass_times(10 + text_width(buf, size) + size, 10 + size / 6, size * 2 / 3);
+	}
+}
+
+// Startup trace, every phase of init_renderer up to the first presented frame is printed
+// with its own duration and the time since init_renderer was called
+static struct {
+	int active;
+	struct timespec start, last;
+} startup;
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to) {
+	return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+static void startup_begin() {
+	clock_gettime(CLOCK_MONOTONIC, &startup.start);
+	startup.last = startup.start;
+	startup.active = 1;
+}
+
+static void startup_phase(const char *phase) {
+	if (!startup.active)
+		return;
+
+	TRACE_INSTANT(phase);
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	printf("Startup: %-12s %8.2f ms (total %.2f ms)\n", phase, elapsed_ms(&startup.last, &now), elapsed_ms(&startup.start, &now));
+	startup.last = now;
+}
+
+// SIMPLE_DRM_TRACE=file records a trace until free_renderer
+static void start_trace_from_env(){
+	const char *path = getenv("SIMPLE_DRM_TRACE");
+	if (path && *path && !trace_active())
+		trace_start(path);
+}
+
+// SIMPLE_DRM_IPC=socket lets other processes submit layers, see Ipc_helpers.h
+static void start_ipc_from_env(){
+	const char *path = getenv("SIMPLE_DRM_IPC");
+	if (path && *path)
+		ipc_server_start(path);
+}
+
+static int check_callbacks(func_t init_f, func_t draw_f){
+	if(dev){
+		printf("Renderer Error: Renderer have already initialized\n");
+		return 1;
+	}
+	else if(!init_f){
+		printf("Renderer Error: Invalid init function\n");
 		return 1;
 	}
 	else if (!draw_f) {
 		printf("Renderer Error: Invalid draw function\n");
 		return 1;
 	}
-	int ret = 0;
+	return 0;
+}
 
+static int check_surface_config(const struct surface_config *config){
+	if (config && (unsigned int)config->format >= sizeof(surface_formats) / sizeof(surface_formats[0])) {
+		printf("Renderer Error: Invalid surface format\n");
+		return 1;
+	}
+	return 0;
+}
 
-	dev = malloc(sizeof(*dev));
+int init_renderer_offscreen(func_t init_f, func_t draw_f, func_t clean_f, unsigned int width, unsigned int height,
+		const struct surface_config *config){
+	if (check_callbacks(init_f, draw_f) || check_surface_config(config))
+		return 1;
+	if (!width || !height) {
+		printf("Renderer Error: Invalid offscreen size\n");
+		return 1;
+	}
+
+	start_trace_from_env();
+
+	dev = calloc(1, sizeof(*dev));
 	if(!dev){
 		printf("Renderer Error: Malloc failed\n");
 		return 1;
 	}
+	dev->offscreen = 1;
+	dev->fd = -1;
+	dev->width = width;
+	dev->height = height;
+	dev->surface = config ? *config : default_surface;
 
-	ret = init_drm();
-	if(ret){
+	int ret = init_frame_arena();
+	if (ret) {
 		free(dev);
 		dev = NULL;
 		return ret;
 	}
 
-	ret = init_gbm();
+	ret = init_egl();
 	if (ret) {
-		free_drm();
+		free_frame_arena();
 		free(dev);
 		dev = NULL;
 		return ret;
 	}
 
-	ret = init_egl();
-	if (ret) {
-		free_gbm();
-		free_drm();
+	dev->init = init_f;
+	dev->draw = draw_f;
+	dev->clean = clean_f;
+
+	printf("Offscreen Renderer Initialized (%ux%u)\n\n", width, height);
+	return 0;
+}
+
+int init_renderer(func_t init_f, func_t draw_f, func_t clean_f, const struct surface_config *config){
+	if (check_callbacks(init_f, draw_f) || check_surface_config(config))
+		return 1;
+	int ret = 0;
+
+	start_trace_from_env();
+	startup_begin();
+
+	dev = calloc(1, sizeof(*dev));
+	if(!dev){
+		printf("Renderer Error: Malloc failed\n");
+		return 1;
+	}
+
+	ret = init_frame_arena();
+	if(ret){
 		free(dev);
 		dev = NULL;
 		return ret;
 	}
 
-    ret = init_fps_renderer();
+	ret = init_drm();
 	if(ret){
-		free_egl();
-		free_gbm();
-		free_drm();
+		free_frame_arena();
 		free(dev);
 		dev = NULL;
 		return ret;
 	}
+	startup_phase("drm");
+
+	// The input device scan runs alongside the GBM/EGL setup
+	prefetch_input_devices();
+
+	dev->surface = config ? *config : default_surface;
+
+	// SIMPLE_DRM_SOFTWARE forces the CPU path, e.g. to test it on vkms
+	dev->software = getenv("SIMPLE_DRM_SOFTWARE") != NULL;
+	if (!dev->software && !init_offload())
+		startup_phase("offload");
+	if (!dev->software && !dev->offload) {
+		ret = init_gbm();
+		if (!ret) {
+			startup_phase("gbm");
+			ret = init_egl();
+			if (ret) {
+				if (dev->egl_display != EGL_NO_DISPLAY)
+					eglTerminate(dev->egl_display);
+				free_gbm();
+			}
+		}
+		if (ret) {
+			printf("Renderer: GPU initialization failed, falling back to software rendering\n");
+			dev->software = 1;
+		}
+		else {
+			startup_phase("egl");
+			init_sync();
+		}
+	}
+
+	if (dev->software) {
+		dev->surface = (struct surface_config){ SURFACE_XRGB8888, 0, 0, 0 };
+		dev->format = DRM_FORMAT_XRGB8888;
+		ret = init_dumb();
+		if (ret) {
+			finish_input_prefetch();
+			free_drm();
+			free_frame_arena();
+			free(dev);
+			dev = NULL;
+			return ret;
+		}
+		printf("Software rendering: %ux%u dumb buffers, %s kernels\n", dev->width, dev->height, sw_kernel_isa());
+		startup_phase("dumb buffers");
+	}
 
 	dev->init = init_f;
 	dev->draw = draw_f;
 	dev->clean = clean_f;
 
+	start_ipc_from_env();
+
 	printf("Renderer Initialized\n\n");
 	return 0;
 }
 
+// Runs the user init function and sets the mode on the first call
+static int start_rendering(){
+	if (dev->started)
+		return 0;
+
+	dev->init();
+	startup_phase("user init");
+
+	if(!dev->offscreen && init_crtc()){
+		return 1;
+	}
+	startup_phase("mode set");
+
+	dev->started = 1;
+	return 0;
+}
+
+static int render_frame(){
+	TRACE_BEGIN("frame");
+	process_ipc();
+	begin_offload_frame();
+	TRACE_BEGIN("draw");
+	dev->draw();
+	TRACE_END();
+	if (!dev->software)
+		glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer());
+	draw_ipc_layers();
+	TRACE_BEGIN("overlay");
+	update_fps();
+	draw_text_overlay();
+	TRACE_END();
+
+	int ret;
+	TRACE_BEGIN("swap");
+	if (dev->software)
+		ret = swap_dumb_buffers();
+	else if (dev->offload)
+		ret = swap_offload();
+	else if (dev->offscreen)
+		ret = swap_offscreen();
+	else
+		ret = swap_buffers();
+	TRACE_END();
+	if (ret) {
+		TRACE_END();
+		return 1;
+	}
+
+	// Frame submitted, its scratch memory goes back to the arena once no job can write to it
+	job_wait_frame();
+	reset_frame_arena();
+	ipc_frame_end();
+	text_frame_end();
+	if (!dev->software) {
+		gpu_profiler_frame_end();
+		target_pool_frame_end();
+		process_texture_uploads();
+	}
+
+	if (startup.active) {
+		startup_phase("first frame");
+		startup.active = 0;
+	}
+
+	if (!dev->software) {
+		TRACE_BEGIN("shader reloads");
+		processProgramReloads(RELOAD_BUDGET_US);
+		TRACE_END();
+	}
+	TRACE_END();
+	return 0;
+}
+
 int render_loop(){
 	if(!dev){
 		printf("Renderer Error: Renderer haven't been initialized\n");
 		return 1;
 	}
-	dev->init();
-
-	if(init_crtc()){
+	if (start_rendering())
 		return 1;
-	}
 
 	printf("Render Loop\n------------------------------------------------------------------------\n");
 	while(1){
-		if(process_inputs())
+		TRACE_BEGIN("inputs");
+		int stop = process_inputs();
+		TRACE_END();
+		if(stop)
 			break;
-		dev->draw();
-		update_fps();
-		if(swap_buffers()){
+		if(render_frame()){
 			return 1;
 		}
 	}
@@ -574,6 +2032,37 @@ int render_loop(){
 	return 0;
 }
 
+int render_frames(unsigned int count){
+	if(!dev){
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return 1;
+	}
+	if (start_rendering())
+		return 1;
+
+	for (unsigned int i = 0; i < count; i++) {
+		TRACE_BEGIN("inputs");
+		int stop = process_inputs();
+		TRACE_END();
+		if(stop)
+			break;
+		if(render_frame()){
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void renderer_draw_number(int number, float x, float y, float scale){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return;
+	}
+
+	draw_fps_number(number, x, y, scale);
+}
+
 unsigned int renderer_get_width(){
 	if(!dev){
 		printf("Renderer Error: Renderer haven't been initialized\n");
@@ -592,34 +2081,167 @@ unsigned int renderer_get_height(){
 	return dev->height;
 }
 
+void renderer_set_mode_policy(enum mode_policy policy, unsigned int width, unsigned int height, unsigned int refresh){
+	if (dev) {
+		printf("Renderer Error: Mode policy must be set before init_renderer\n");
+		return;
+	}
+
+	mode_config.policy = policy;
+	mode_config.width = width;
+	mode_config.height = height;
+	mode_config.refresh = refresh;
+}
+
+void renderer_set_vrr(int enable){
+	if (dev) {
+		printf("Renderer Error: VRR must be configured before init_renderer\n");
+		return;
+	}
+
+	mode_config.vrr = enable;
+}
+
+unsigned int renderer_get_refresh_rate(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return 0;
+	}
+
+	return mode_refresh_mhz(&dev->mode);
+}
+
+int renderer_vrr_enabled(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return 0;
+	}
+
+	return dev->vrr;
+}
+
+int renderer_is_software(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return 0;
+	}
+
+	return dev->software;
+}
+
+const struct surface_config *renderer_get_surface_config(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return NULL;
+	}
+
+	return &dev->surface;
+}
+
+void renderer_set_render_device(const char *device){
+	if (dev) {
+		printf("Renderer Error: The render device must be set before init_renderer\n");
+		return;
+	}
+	if (device && strlen(device) >= sizeof(mode_config.render_device)) {
+		printf("Renderer Error: Render device name too long\n");
+		return;
+	}
+
+	strcpy(mode_config.render_device, device ? device : "");
+}
+
+unsigned int renderer_get_framebuffer(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return 0;
+	}
+
+	return screen_framebuffer();
+}
+
+const char *renderer_get_offload_mode(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return NULL;
+	}
+
+	return dev->offload ? offload_mode_names[dev->offload] : NULL;
+}
+
+void renderer_set_overlay(int enable){
+	overlay_enabled = enable;
+}
+
+struct sw_canvas *renderer_get_canvas(){
+	if (!dev) {
+		printf("Renderer Error: Renderer haven't been initialized\n");
+		return NULL;
+	}
+
+	return dev->software ? &dev->canvas : NULL;
+}
+
 void free_renderer(){
 	if(!dev){
 		printf("Renderer Error: Renderer haven't been initialized\n");
 		return;
 	}
 
-	if(dev->previous_fb)
+	// Apps without input never join the keyboard scan themselves
+	finish_input_prefetch();
+
+	if (dev->software) {
+		if (dev->clean)
+			dev->clean();
+
+		free_ipc_server();
+		free_text();
+		free_dumb();
+		free_drm();
+		free_frame_arena();
+		free(dev);
+		dev = NULL;
+		trace_stop();
+		return;
+	}
+
+	if(!dev->offscreen && dev->kms_fence_fd >= 0)
+		close(dev->kms_fence_fd);
+
+	if(!dev->offscreen && dev->previous_fb)
 		drmModeRmFB(dev->fd, dev->previous_fb);
 
-	if(dev->previous_bo)
+	if(!dev->offscreen && dev->previous_bo)
 		gbm_surface_release_buffer(dev->gbm_surface, dev->previous_bo);
 
 	if (dev->clean)
 		dev->clean();
 
-	if (text_texture) {
-		glDeleteTextures(1, &text_texture);
-		text_texture = 0;
-	}
+	freeProgramWatches();
+	free_text();
+	free_ipc_server();
+	free_meshes();
+	free_target_pool();
+	free_texture_cache();
+	freeDmabufCache();
+	free_gpu_profiler();
 
-	if (text_program) {
-		glDeleteProgram(text_program);
-		text_program = 0;
-	}
+	if (dev->offload)
+		free_offload();
 
 	free_egl();
-	free_gbm();
-	free_drm();
+	if (dev->offload) {
+		free_dumb();
+		close_render_device();
+		free_drm();
+	}
+	else if (!dev->offscreen) {
+		free_gbm();
+		free_drm();
+	}
+	free_frame_arena();
 	free(dev);
 	dev = NULL;
+	trace_stop();
 }
@@ -1,16 +1,108 @@
 #ifndef INCLUDE_RENDER_UTILS_H_
 #define INCLUDE_RENDER_UTILS_H_
 
+struct sw_canvas;
+
 // Function pointer type: takes no args, returns void
 typedef void (*func_t)(void);
 
+// Display mode selection, see renderer_set_mode_policy
+enum mode_policy {
+    MODE_PREFERRED,        // Mode the connector flags as preferred (default)
+    MODE_MAX_REFRESH,      // Highest refresh rate at the preferred resolution
+    MODE_EXACT,            // width x height @ refresh Hz, refresh 0 matches any rate
+    MODE_LOWEST_BANDWIDTH, // Lowest pixel clock
+};
+
+// Color formats of the scanout surface, in DRM fourcc channel order
+enum surface_format {
+    SURFACE_XRGB8888,
+    SURFACE_ARGB8888,
+    SURFACE_RGB565,
+    SURFACE_XRGB2101010,
+    SURFACE_ARGB2101010,
+};
+
+// Requested surface. depth_bits and stencil_bits are minimums, 0 means no buffer; samples is
+// the MSAA sample count, 0 or 1 for none. If the format isn't available the renderer tries the
+// same channel depth with alpha toggled, then deeper formats, then shallower ones (RGB565
+// last), and for each format halves the sample count down to none before moving on. Depth and
+// stencil are never reduced. Passing NULL to init_renderer requests XRGB8888 with 24 bit
+// depth, 8 bit stencil and 4x MSAA.
+struct surface_config {
+    enum surface_format format;
+    unsigned int depth_bits;
+    unsigned int stencil_bits;
+    unsigned int samples;
+};
+
+// Must be called before init_renderer. width, height and refresh are only used by MODE_EXACT,
+// which falls back to the preferred mode if the connector doesn't offer a match.
+void renderer_set_mode_policy(enum mode_policy policy, unsigned int width, unsigned int height, unsigned int refresh);
+
+// Adaptive sync is enabled by default on connectors that report vrr_capable. Must be called
+// before init_renderer.
+void renderer_set_vrr(int enable);
+
+// Renders on another device than the display card and scans the frames out through PRIME:
+// a DRM node path such as "/dev/dri/renderD129", "auto" for the first render node of another
+// device, or "surfaceless" for Mesa's surfaceless platform (llvmpipe, or the device Mesa
+// picks). NULL renders on the display card (default). The SIMPLE_DRM_RENDER_DEVICE environment
+// variable overrides it. If the device can't be used the renderer falls back to the display
+// card. Must be called before init_renderer.
+void renderer_set_render_device(const char *device);
+
+// "export", "import" or "copy" when rendering on another device (see README), NULL otherwise
+const char *renderer_get_offload_mode();
+
+// Framebuffer object of the screen, bound when draw() is called. It is 0 except with the
+// "export" and "import" offload modes, which draw straight into the scanout buffers and may
+// change it every frame: bind it instead of 0 to draw to the screen again after a framebuffer
+// of your own.
+unsigned int renderer_get_framebuffer();
+
+// Refresh rate of the selected mode in mHz
+unsigned int renderer_get_refresh_rate();
+
+int renderer_vrr_enabled();
+
 unsigned int renderer_get_width();
 unsigned int renderer_get_height();
 
-int init_renderer(func_t init_f, func_t draw_f, func_t clean_f);
+// Returns 1 when EGL couldn't be initialized and the renderer scans out CPU drawn dumb buffers.
+// GL calls must not be used in that mode; draw into renderer_get_canvas() with the
+// Software_helpers kernels instead.
+int renderer_is_software();
+
+// Back buffer of the software renderer, NULL when rendering with GL.
+struct sw_canvas *renderer_get_canvas();
+
+// Surface that was actually created after negotiation. The software renderer always
+// reports XRGB8888 without depth, stencil or MSAA.
+const struct surface_config *renderer_get_surface_config();
+
+const char *renderer_surface_format_name(enum surface_format format);
+
+int init_renderer(func_t init_f, func_t draw_f, func_t clean_f, const struct surface_config *config);
+
+// Renders into a width x height pbuffer without a display, e.g. on Mesa's surfaceless
+// platform with llvmpipe. Used by benchmarks; render with render_frames().
+int init_renderer_offscreen(func_t init_f, func_t draw_f, func_t clean_f, unsigned int width, unsigned int height,
+        const struct surface_config *config);
 
 int render_loop();
 
+// Renders count frames and returns. The init function runs before the first frame.
+int render_frames(unsigned int count);
+
+// Shows or hides the FPS counter (shown by default). It is drawn with Text_helpers, whose
+// atlas is created on the first frame that draws text, so a hidden counter costs nothing at
+// startup.
+void renderer_set_overlay(int enable);
+
+// Draws a number with the overlay's font in the current frame, 8 * scale pixels tall.
+void renderer_draw_number(int number, float x, float y, float scale);
+
 void free_renderer();
 
 #endif /* INCLUDE_RENDER_UTILS_H_ */
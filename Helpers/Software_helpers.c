@@ -0,0 +1,329 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "Software_helpers.h"
+
+// Span kernels. Dumb buffers are usually mapped write-combined, so the x86 fill and copy
+// kernels use streaming stores for long spans, and nothing but the blend kernel reads the
+// destination back.
+struct sw_kernels {
+	const char *isa;
+	void (*fill)(uint32_t *dst, uint32_t color, unsigned int n);
+	void (*copy)(uint32_t *dst, const uint32_t *src, unsigned int n);
+	void (*blend)(uint32_t *dst, const uint32_t *src, unsigned int n);
+};
+
+static struct sw_kernels kernels;
+
+#define STREAM_THRESHOLD 64
+
+// Alpha blend of one channel, (s * a + d * (255 - a)) / 255 rounded
+static inline uint32_t blend_channel(uint32_t s, uint32_t d, uint32_t a) {
+	uint32_t t = s * a + d * (255 - a) + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t blend_pixel(uint32_t s, uint32_t d) {
+	uint32_t a = s >> 24;
+	if (a == 255)
+		return s;
+	if (a == 0)
+		return d | 0xFF000000;
+
+	return 0xFF000000 |
+			(blend_channel((s >> 16) & 0xFF, (d >> 16) & 0xFF, a) << 16) |
+			(blend_channel((s >> 8) & 0xFF, (d >> 8) & 0xFF, a) << 8) |
+			blend_channel(s & 0xFF, d & 0xFF, a);
+}
+
+static void fill_scalar(uint32_t *dst, uint32_t color, unsigned int n) {
+	for (unsigned int i = 0; i < n; i++)
+		dst[i] = color;
+}
+
+static void copy_scalar(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	memcpy(dst, src, n * sizeof(uint32_t));
+}
+
+static void blend_scalar(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	for (unsigned int i = 0; i < n; i++)
+		dst[i] = blend_pixel(src[i], dst[i]);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef __SSE2__
+static void fill_sse2(uint32_t *dst, uint32_t color, unsigned int n) {
+	unsigned int i = 0;
+	__m128i c = _mm_set1_epi32((int)color);
+
+	if (n >= STREAM_THRESHOLD) {
+		for (; ((uintptr_t)(dst + i) & 15) && i < n; i++)
+			dst[i] = color;
+		for (; i + 4 <= n; i += 4)
+			_mm_stream_si128((__m128i *)(dst + i), c);
+		_mm_sfence();
+	}
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + i), c);
+	for (; i < n; i++)
+		dst[i] = color;
+}
+
+static void copy_sse2(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+
+	if (n >= STREAM_THRESHOLD) {
+		for (; ((uintptr_t)(dst + i) & 15) && i < n; i++)
+			dst[i] = src[i];
+		for (; i + 4 <= n; i += 4)
+			_mm_stream_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i)));
+		_mm_sfence();
+	}
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_loadu_si128((const __m128i *)(src + i)));
+	for (; i < n; i++)
+		dst[i] = src[i];
+}
+
+// Blends two pixels held as 16 bit lanes
+static inline __m128i blend_lanes_sse2(__m128i s, __m128i d) {
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	__m128i ia = _mm_xor_si128(a, _mm_set1_epi16(0xFF));
+	__m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void blend_sse2(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+	unsigned int i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i lo = blend_lanes_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = blend_lanes_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+	}
+	for (; i < n; i++)
+		dst[i] = blend_pixel(src[i], dst[i]);
+}
+#endif /* __SSE2__ */
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint32_t *dst, uint32_t color, unsigned int n) {
+	unsigned int i = 0;
+	__m256i c = _mm256_set1_epi32((int)color);
+
+	if (n >= STREAM_THRESHOLD) {
+		for (; ((uintptr_t)(dst + i) & 31) && i < n; i++)
+			dst[i] = color;
+		for (; i + 8 <= n; i += 8)
+			_mm256_stream_si256((__m256i *)(dst + i), c);
+		_mm_sfence();
+	}
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i *)(dst + i), c);
+	for (; i < n; i++)
+		dst[i] = color;
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+
+	if (n >= STREAM_THRESHOLD) {
+		for (; ((uintptr_t)(dst + i) & 31) && i < n; i++)
+			dst[i] = src[i];
+		for (; i + 8 <= n; i += 8)
+			_mm256_stream_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+		_mm_sfence();
+	}
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+	for (; i < n; i++)
+		dst[i] = src[i];
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_lanes_avx2(__m256i s, __m256i d) {
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+	__m256i ia = _mm256_xor_si256(a, _mm256_set1_epi16(0xFF));
+	__m256i t = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia)),
+			_mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blend_avx2(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+	unsigned int i = 0;
+
+	// unpack and pack both work per 128 bit lane, so pixel order is preserved
+	for (; i + 8 <= n; i += 8) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+		__m256i lo = blend_lanes_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = blend_lanes_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+	}
+	for (; i < n; i++)
+		dst[i] = blend_pixel(src[i], dst[i]);
+}
+#endif /* x86 */
+
+#ifdef __ARM_NEON
+static void fill_neon(uint32_t *dst, uint32_t color, unsigned int n) {
+	uint32x4_t c = vdupq_n_u32(color);
+	unsigned int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		vst1q_u32(dst + i, c);
+		vst1q_u32(dst + i + 4, c);
+	}
+	for (; i < n; i++)
+		dst[i] = color;
+}
+
+static void copy_neon(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		vst1q_u32(dst + i, vld1q_u32(src + i));
+		vst1q_u32(dst + i + 4, vld1q_u32(src + i + 4));
+	}
+	for (; i < n; i++)
+		dst[i] = src[i];
+}
+
+static inline uint8x8_t blend_channel_neon(uint8x8_t s, uint8x8_t d, uint8x8_t a, uint8x8_t ia) {
+	uint16x8_t t = vaddq_u16(vmlal_u8(vmull_u8(s, a), d, ia), vdupq_n_u16(128));
+	return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+static void blend_neon(uint32_t *dst, const uint32_t *src, unsigned int n) {
+	unsigned int i = 0;
+
+	// vld4 deinterleaves 8 pixels into B, G, R, A planes
+	for (; i + 8 <= n; i += 8) {
+		uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+		uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+		uint8x8_t ia = vmvn_u8(s.val[3]);
+		d.val[0] = blend_channel_neon(s.val[0], d.val[0], s.val[3], ia);
+		d.val[1] = blend_channel_neon(s.val[1], d.val[1], s.val[3], ia);
+		d.val[2] = blend_channel_neon(s.val[2], d.val[2], s.val[3], ia);
+		d.val[3] = vdup_n_u8(0xFF);
+		vst4_u8((uint8_t *)(dst + i), d);
+	}
+	for (; i < n; i++)
+		dst[i] = blend_pixel(src[i], dst[i]);
+}
+#endif /* __ARM_NEON */
+
+static void select_kernels() {
+	struct sw_kernels selected = { "scalar", fill_scalar, copy_scalar, blend_scalar };
+
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef __SSE2__
+	selected = (struct sw_kernels){ "sse2", fill_sse2, copy_sse2, blend_sse2 };
+#endif
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		selected = (struct sw_kernels){ "avx2", fill_avx2, copy_avx2, blend_avx2 };
+#elif defined(__ARM_NEON)
+	selected = (struct sw_kernels){ "neon", fill_neon, copy_neon, blend_neon };
+#endif
+
+	kernels = selected;
+}
+
+static inline const struct sw_kernels *get_kernels() {
+	if (!kernels.isa)
+		select_kernels();
+	return &kernels;
+}
+
+// Clips the rectangle against the canvas. Returns 0 if nothing is left to draw.
+static int clip_rect(const struct sw_canvas *canvas, int *x, int *y, int *w, int *h, int *skip_x, int *skip_y) {
+	*skip_x = *x < 0 ? -*x : 0;
+	*skip_y = *y < 0 ? -*y : 0;
+	*x += *skip_x;
+	*y += *skip_y;
+	*w -= *skip_x;
+	*h -= *skip_y;
+
+	if (*x >= (int)canvas->width || *y >= (int)canvas->height)
+		return 0;
+	if (*x + *w > (int)canvas->width)
+		*w = canvas->width - *x;
+	if (*y + *h > (int)canvas->height)
+		*h = canvas->height - *y;
+
+	return *w > 0 && *h > 0;
+}
+
+void sw_fill_rect(struct sw_canvas *canvas, int x, int y, int w, int h, uint32_t color) {
+	int skip_x, skip_y;
+	if (!canvas || !canvas->pixels || !clip_rect(canvas, &x, &y, &w, &h, &skip_x, &skip_y))
+		return;
+
+	const struct sw_kernels *k = get_kernels();
+	uint32_t *row = canvas->pixels + (size_t)y * canvas->stride + x;
+	for (int j = 0; j < h; j++, row += canvas->stride)
+		k->fill(row, color, w);
+}
+
+void sw_blit(struct sw_canvas *canvas, int x, int y, const uint32_t *src, int w, int h, unsigned int src_stride) {
+	int skip_x, skip_y;
+	if (!canvas || !canvas->pixels || !src || !clip_rect(canvas, &x, &y, &w, &h, &skip_x, &skip_y))
+		return;
+
+	const struct sw_kernels *k = get_kernels();
+	uint32_t *row = canvas->pixels + (size_t)y * canvas->stride + x;
+	src += (size_t)skip_y * src_stride + skip_x;
+	for (int j = 0; j < h; j++, row += canvas->stride, src += src_stride)
+		k->copy(row, src, w);
+}
+
+void sw_blend(struct sw_canvas *canvas, int x, int y, const uint32_t *src, int w, int h, unsigned int src_stride) {
+	int skip_x, skip_y;
+	if (!canvas || !canvas->pixels || !src || !clip_rect(canvas, &x, &y, &w, &h, &skip_x, &skip_y))
+		return;
+
+	const struct sw_kernels *k = get_kernels();
+	uint32_t *row = canvas->pixels + (size_t)y * canvas->stride + x;
+	src += (size_t)skip_y * src_stride + skip_x;
+	for (int j = 0; j < h; j++, row += canvas->stride, src += src_stride)
+		k->blend(row, src, w);
+}
+
+void sw_draw_glyph(struct sw_canvas *canvas, int x, int y, const unsigned char glyph[8], int scale, uint32_t color) {
+	if (!canvas || !canvas->pixels || !glyph || scale <= 0)
+		return;
+
+	// Each run of set bits becomes one scaled rectangle so the fill kernel gets long spans
+	for (int row = 0; row < 8; row++) {
+		unsigned char bits = glyph[row];
+		int col = 0;
+		while (bits && col < 8) {
+			if (!(bits & (0x80 >> col))) {
+				col++;
+				continue;
+			}
+			int start = col;
+			while (col < 8 && (bits & (0x80 >> col)))
+				col++;
+			sw_fill_rect(canvas, x + start * scale, y + row * scale, (col - start) * scale, scale, color);
+		}
+	}
+}
+
+const char *sw_kernel_isa() {
+	return get_kernels()->isa;
+}
@@ -0,0 +1,28 @@
+#ifndef HELPERS_SOFTWARE_HELPERS_H_
+#define HELPERS_SOFTWARE_HELPERS_H_
+
+#include <stdint.h>
+
+// 32 bit XRGB8888/ARGB8888 pixel target. Stride is in pixels.
+struct sw_canvas {
+	uint32_t *pixels;
+	unsigned int width, height;
+	unsigned int stride;
+};
+
+// Colors are 0xAARRGGBB. All drawing is clipped to the canvas.
+void sw_fill_rect(struct sw_canvas *canvas, int x, int y, int w, int h, uint32_t color);
+
+// Copies an opaque w x h image to (x, y).
+void sw_blit(struct sw_canvas *canvas, int x, int y, const uint32_t *src, int w, int h, unsigned int src_stride);
+
+// Blends a non-premultiplied ARGB8888 w x h image over the canvas at (x, y).
+void sw_blend(struct sw_canvas *canvas, int x, int y, const uint32_t *src, int w, int h, unsigned int src_stride);
+
+// Draws an 8x8 1bpp glyph (MSB is the leftmost pixel), each bit scaled to a scale x scale block.
+void sw_draw_glyph(struct sw_canvas *canvas, int x, int y, const unsigned char glyph[8], int scale, uint32_t color);
+
+// Name of the instruction set selected for the kernels ("avx2", "sse2", "neon" or "scalar").
+const char *sw_kernel_isa();
+
+#endif /* HELPERS_SOFTWARE_HELPERS_H_ */
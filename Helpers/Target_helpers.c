@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <string.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include "Target_helpers.h"
+#include "Renderer_helpers.h"
+#include "GL_helpers.h"
+
+struct target {
+	int used;   // Slot holds a target
+	int in_use; // Acquired, not in the pool
+	unsigned int width, height;
+	enum target_format format;
+	unsigned int attachments;
+	GLuint fbo, texture;
+	GLuint depth, stencil; // depth is a packed depth/stencil buffer when stencil is 0 and both were asked for
+	size_t bytes;
+	unsigned long last_used; // Frame it was last released or acquired
+};
+
+static struct {
+	struct target targets[MAX_TARGETS];
+	unsigned int evict_frames;
+	unsigned long frame;
+	unsigned long created, evicted;
+	int packed_depth_stencil; // 0 not checked, 1 supported, -1 unsupported
+
+	GLuint program;
+	GLint pos_attrib, uv_attrib, tex_uniform, size_uniform;
+	int program_failed;
+} pool = { .evict_frames = TARGET_DEFAULT_EVICT_FRAMES };
+
+static const struct {
+	GLenum format, type;
+	unsigned int bytes_per_pixel;
+	const char *name;
+} target_formats[] = {
+	[TARGET_RGBA8888] = { GL_RGBA, GL_UNSIGNED_BYTE, 4, "RGBA8888" },
+	[TARGET_RGB565] = { GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 2, "RGB565" },
+	[TARGET_RGBA4444] = { GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, 2, "RGBA4444" },
+};
+
+void target_pool_configure(unsigned int evict_frames) {
+	pool.evict_frames = evict_frames ? evict_frames : TARGET_DEFAULT_EVICT_FRAMES;
+}
+
+static struct target *get_target(int id) {
+	if (id < 0 || id >= MAX_TARGETS || !pool.targets[id].used)
+		return NULL;
+	return &pool.targets[id];
+}
+
+static void destroy_target(struct target *target) {
+	glDeleteFramebuffers(1, &target->fbo);
+	glDeleteTextures(1, &target->texture);
+	if (target->depth)
+		glDeleteRenderbuffers(1, &target->depth);
+	if (target->stencil)
+		glDeleteRenderbuffers(1, &target->stencil);
+	memset(target, 0, sizeof(*target));
+}
+
+static GLuint create_renderbuffer(GLenum format, unsigned int width, unsigned int height) {
+	GLuint renderbuffer;
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	return renderbuffer;
+}
+
+static int create_target(struct target *target, unsigned int width, unsigned int height,
+		enum target_format format, unsigned int attachments) {
+	if (!pool.packed_depth_stencil) {
+		const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+		pool.packed_depth_stencil = extensions && strstr(extensions, "GL_OES_packed_depth_stencil") ? 1 : -1;
+	}
+
+	target->width = width;
+	target->height = height;
+	target->format = format;
+	target->attachments = attachments;
+	target->bytes = (size_t)width * height * target_formats[format].bytes_per_pixel;
+
+	glGenTextures(1, &target->texture);
+	glBindTexture(GL_TEXTURE_2D, target->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, target_formats[format].format, width, height, 0,
+			target_formats[format].format, target_formats[format].type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previous;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture, 0);
+
+	int depth = attachments & TARGET_DEPTH, stencil = attachments & TARGET_STENCIL;
+	if (depth && stencil && pool.packed_depth_stencil == 1) {
+		target->depth = create_renderbuffer(GL_DEPTH24_STENCIL8_OES, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+		target->bytes += (size_t)width * height * 4;
+	} else {
+		if (depth) {
+			target->depth = create_renderbuffer(GL_DEPTH_COMPONENT16, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+			target->bytes += (size_t)width * height * 2;
+		}
+		if (stencil) {
+			target->stencil = create_renderbuffer(GL_STENCIL_INDEX8, width, height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->stencil);
+			target->bytes += (size_t)width * height;
+		}
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Target Error: Incomplete framebuffer for %ux%u %s (0x%x)\n", width, height,
+				target_formats[format].name, status);
+		destroy_target(target);
+		return 1;
+	}
+
+	target->used = 1;
+	pool.created++;
+	return 0;
+}
+
+int acquire_target(unsigned int width, unsigned int height, enum target_format format, unsigned int attachments) {
+	if (renderer_is_software()) {
+		printf("Target Error: Render targets need the GL renderer\n");
+		return -1;
+	}
+	if (!width || !height || (unsigned int)format >= sizeof(target_formats) / sizeof(target_formats[0])) {
+		printf("Target Error: Invalid target %ux%u\n", width, height);
+		return -1;
+	}
+	attachments &= TARGET_DEPTH | TARGET_STENCIL;
+
+	int free_slot = -1, oldest = -1;
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		struct target *target = &pool.targets[i];
+		if (!target->used) {
+			if (free_slot < 0)
+				free_slot = i;
+			continue;
+		}
+		if (target->in_use)
+			continue;
+
+		if (target->width == width && target->height == height && target->format == format &&
+				target->attachments == attachments) {
+			target->in_use = 1;
+			target->last_used = pool.frame;
+			return i;
+		}
+		if (oldest < 0 || target->last_used < pool.targets[oldest].last_used)
+			oldest = i;
+	}
+
+	// Pool full, make room by dropping the least recently used pooled target
+	if (free_slot < 0 && oldest >= 0) {
+		destroy_target(&pool.targets[oldest]);
+		pool.evicted++;
+		free_slot = oldest;
+	}
+	if (free_slot < 0) {
+		printf("Target Error: More than %d targets in use\n", MAX_TARGETS);
+		return -1;
+	}
+
+	struct target *target = &pool.targets[free_slot];
+	if (create_target(target, width, height, format, attachments))
+		return -1;
+	target->in_use = 1;
+	target->last_used = pool.frame;
+	return free_slot;
+}
+
+void release_target(int id) {
+	struct target *target = get_target(id);
+	if (!target)
+		return;
+
+	target->in_use = 0;
+	target->last_used = pool.frame;
+}
+
+void bind_target(int id) {
+	struct target *target = get_target(id);
+	if (!target) {
+		glBindFramebuffer(GL_FRAMEBUFFER, renderer_get_framebuffer());
+		glViewport(0, 0, renderer_get_width(), renderer_get_height());
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glViewport(0, 0, target->width, target->height);
+}
+
+unsigned int target_texture(int id) {
+	struct target *target = get_target(id);
+	return target ? target->texture : 0;
+}
+
+static int init_quad_program() {
+	const char *vertex_shader =
+		"attribute vec2 a_Position;"
+		"attribute vec2 a_TexCoord;"
+		"uniform vec2 u_Screen;"
+		"varying vec2 v_TexCoord;"
+		"void main() {"
+		"    v_TexCoord = a_TexCoord;"
+		"    gl_Position = vec4(a_Position.x / u_Screen.x * 2.0 - 1.0, 1.0 - a_Position.y / u_Screen.y * 2.0, 0.0, 1.0);"
+		"}";
+
+	const char *fragment_shader =
+		"precision mediump float;"
+		"uniform sampler2D u_Texture;"
+		"varying vec2 v_TexCoord;"
+		"void main() { gl_FragColor = texture2D(u_Texture, v_TexCoord); }";
+
+	pool.program = createProgram(vertex_shader, fragment_shader);
+	if (!pool.program) {
+		printf("Target Error: Failed to create the quad program\n");
+		return 1;
+	}
+
+	pool.pos_attrib = glGetAttribLocation(pool.program, "a_Position");
+	pool.uv_attrib = glGetAttribLocation(pool.program, "a_TexCoord");
+	pool.tex_uniform = glGetUniformLocation(pool.program, "u_Texture");
+	pool.size_uniform = glGetUniformLocation(pool.program, "u_Screen");
+	return 0;
+}
+
+void draw_target(int id, float x, float y, float width, float height) {
+	struct target *target = get_target(id);
+	if (!target || pool.program_failed)
+		return;
+	if (!pool.program && init_quad_program()) {
+		pool.program_failed = 1;
+		return;
+	}
+
+	// Texture rows start at the bottom, the quad's at the top
+	const float quad[] = {
+		x, y, 0.0f, 1.0f,
+		x + width, y, 1.0f, 1.0f,
+		x, y + height, 0.0f, 0.0f,
+		x + width, y + height, 1.0f, 0.0f,
+	};
+
+	// The caller's state is put back afterwards, draw_target() can go anywhere in a pass
+	GLint viewport[4], program, active_texture, texture, array_buffer;
+	GLint blend_src_rgb, blend_dst_rgb, blend_src_alpha, blend_dst_alpha;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &array_buffer);
+	glGetIntegerv(GL_BLEND_SRC_RGB, &blend_src_rgb);
+	glGetIntegerv(GL_BLEND_DST_RGB, &blend_dst_rgb);
+	glGetIntegerv(GL_BLEND_SRC_ALPHA, &blend_src_alpha);
+	glGetIntegerv(GL_BLEND_DST_ALPHA, &blend_dst_alpha);
+	GLboolean blend = glIsEnabled(GL_BLEND), depth_test = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+	glViewport(0, 0, renderer_get_width(), renderer_get_height());
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_SCISSOR_TEST);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(pool.program);
+	glUniform2f(pool.size_uniform, renderer_get_width(), renderer_get_height());
+	glBindTexture(GL_TEXTURE_2D, target->texture);
+	glUniform1i(pool.tex_uniform, 0);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // Targets hold premultiplied alpha
+
+	glVertexAttribPointer(pool.pos_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), quad);
+	glEnableVertexAttribArray(pool.pos_attrib);
+	glVertexAttribPointer(pool.uv_attrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), quad + 2);
+	glEnableVertexAttribArray(pool.uv_attrib);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glDisableVertexAttribArray(pool.pos_attrib);
+	glDisableVertexAttribArray(pool.uv_attrib);
+
+	glBlendFuncSeparate(blend_src_rgb, blend_dst_rgb, blend_src_alpha, blend_dst_alpha);
+	if (!blend)
+		glDisable(GL_BLEND);
+	if (depth_test)
+		glEnable(GL_DEPTH_TEST);
+	if (scissor_test)
+		glEnable(GL_SCISSOR_TEST);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glActiveTexture(active_texture);
+	glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+	glUseProgram(program);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void target_pool_stats(struct target_pool_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		struct target *target = &pool.targets[i];
+		if (!target->used)
+			continue;
+		stats->bytes += target->bytes;
+		stats->targets++;
+		if (target->in_use)
+			stats->in_use++;
+	}
+	stats->created = pool.created;
+	stats->evicted = pool.evicted;
+}
+
+void target_pool_report() {
+	struct target_pool_stats stats;
+	target_pool_stats(&stats);
+	printf("Target pool: %u targets (%u in use), %.1f MB, %lu created, %lu evicted\n", stats.targets,
+			stats.in_use, stats.bytes / (1024.0 * 1024.0), stats.created, stats.evicted);
+
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		struct target *target = &pool.targets[i];
+		if (!target->used)
+			continue;
+		printf("  %d: %ux%u %s%s%s, %.1f KB, %s\n", i, target->width, target->height,
+				target_formats[target->format].name,
+				target->attachments & TARGET_DEPTH ? " +depth" : "",
+				target->attachments & TARGET_STENCIL ? " +stencil" : "",
+				target->bytes / 1024.0, target->in_use ? "in use" : "pooled");
+	}
+}
+
+// Called by the renderer after each swap, drops targets that have been pooled for too long.
+void target_pool_frame_end() {
+	pool.frame++;
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		struct target *target = &pool.targets[i];
+		if (target->used && !target->in_use && pool.frame - target->last_used > pool.evict_frames) {
+			destroy_target(target);
+			pool.evicted++;
+		}
+	}
+}
+
+// Called by the renderer before the EGL context goes away.
+void free_target_pool() {
+	for (int i = 0; i < MAX_TARGETS; i++) {
+		if (pool.targets[i].used)
+			destroy_target(&pool.targets[i]);
+	}
+	if (pool.program)
+		glDeleteProgram(pool.program);
+
+	unsigned int evict_frames = pool.evict_frames;
+	memset(&pool, 0, sizeof(pool));
+	pool.evict_frames = evict_frames;
+}
@@ -0,0 +1,62 @@
+#ifndef HELPERS_TARGET_HELPERS_H_
+#define HELPERS_TARGET_HELPERS_H_
+
+#include <stddef.h>
+
+// Pool of offscreen render targets (an FBO with a color texture and optional depth/stencil
+// renderbuffers). Creating framebuffers is slow on many drivers, so released targets are
+// kept and handed out again to the next request with the same size, format and attachments.
+// Targets nobody asked for in evict_frames frames are deleted.
+//
+// Release a target in the frame it was acquired for per-frame effects (post-processing), or
+// keep it acquired across frames to cache something, e.g. a static UI panel rendered once
+// and then drawn with draw_target() every frame.
+
+enum target_format {
+	TARGET_RGBA8888,
+	TARGET_RGB565,
+	TARGET_RGBA4444,
+};
+
+// Attachment flags
+#define TARGET_DEPTH 1
+#define TARGET_STENCIL 2
+
+#define MAX_TARGETS 32
+#define TARGET_DEFAULT_EVICT_FRAMES 120
+
+struct target_pool_stats {
+	size_t bytes;           // GPU memory of all targets, in use or pooled
+	unsigned int targets;
+	unsigned int in_use;
+	unsigned long created;  // Since start, a steady count means targets are being reused
+	unsigned long evicted;
+};
+
+// Frames an unused target stays pooled. Call before the first acquire_target().
+void target_pool_configure(unsigned int evict_frames);
+
+// Returns a target id, reusing a pooled target when one matches, -1 on failure. The
+// contents of a reused target are undefined.
+int acquire_target(unsigned int width, unsigned int height, enum target_format format, unsigned int attachments);
+
+// Returns the target to the pool.
+void release_target(int target);
+
+// Renders into the target with a viewport covering it, -1 renders to the screen again.
+void bind_target(int target);
+
+// Color texture of the target, e.g. to sample it in a post-processing shader.
+unsigned int target_texture(int target);
+
+// Draws the target's color texture as a quad, in pixels from the top left of the screen,
+// blended as premultiplied alpha. The viewport, program, blending, depth and scissor tests,
+// texture and array buffer bindings are restored afterwards.
+void draw_target(int target, float x, float y, float width, float height);
+
+void target_pool_stats(struct target_pool_stats *stats);
+
+// Prints the pool's targets and memory use
+void target_pool_report();
+
+#endif /* HELPERS_TARGET_HELPERS_H_ */
@@ -0,0 +1,666 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <GLES2/gl2.h>
+#include "Text_helpers.h"
+#include "Renderer_helpers.h"
+#include "Software_helpers.h"
+#include "GL_helpers.h"
+#include "Trace_helpers.h"
+
+// Printable ASCII, one 8x8 glyph each (MSB is the leftmost pixel)
+#define FIRST_GLYPH 32
+#define GLYPH_COUNT 95
+
+// Atlas layout: each glyph's 8x8 pixels become 24x24 texels in a 32x32 cell, the padding
+// holds the distances outside the glyph. Distances are stored in texels, SPREAD either
+// side of the edge, with the edge at 128.
+#define CELL 32
+#define TEXELS_PER_PIXEL 3
+#define PADDING ((CELL - 8 * TEXELS_PER_PIXEL) / 2)
+#define SPREAD 4.0f
+#define ATLAS_COLUMNS 16
+#define ATLAS_ROWS ((GLYPH_COUNT + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS)
+#define ATLAS_WIDTH (ATLAS_COLUMNS * CELL)
+#define ATLAS_HEIGHT (ATLAS_ROWS * CELL)
+
+#define CACHE_MAGIC 0x41464453 // "SDFA"
+#define CACHE_VERSION 1
+
+// Glyph images kept by the software renderer, one per glyph, size and color
+#define MAX_SW_GLYPHS 128
+
+static const unsigned char ascii_font[GLYPH_COUNT][8] = {
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // space
+	{0x18,0x18,0x18,0x18,0x00,0x00,0x18,0x00}, // !
+	{0x66,0x66,0x66,0x00,0x00,0x00,0x00,0x00}, // "
+	{0x66,0x66,0xFF,0x66,0xFF,0x66,0x66,0x00}, // #
+	{0x18,0x3E,0x60,0x3C,0x06,0x7C,0x18,0x00}, // $
+	{0x62,0x66,0x0C,0x18,0x30,0x66,0x46,0x00}, // %
+	{0x3C,0x66,0x3C,0x38,0x67,0x66,0x3F,0x00}, // &
+	{0x0C,0x18,0x30,0x00,0x00,0x00,0x00,0x00}, // '
+	{0x0C,0x18,0x30,0x30,0x30,0x18,0x0C,0x00}, // (
+	{0x30,0x18,0x0C,0x0C,0x0C,0x18,0x30,0x00}, // )
+	{0x00,0x66,0x3C,0xFF,0x3C,0x66,0x00,0x00}, // *
+	{0x00,0x18,0x18,0x7E,0x18,0x18,0x00,0x00}, // +
+	{0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x30}, // ,
+	{0x00,0x00,0x00,0x7E,0x00,0x00,0x00,0x00}, // -
+	{0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x00}, // .
+	{0x00,0x03,0x06,0x0C,0x18,0x30,0x60,0x00}, // /
+	{0x3C,0x66,0x6E,0x76,0x66,0x66,0x3C,0x00}, // 0
+	{0x18,0x38,0x18,0x18,0x18,0x18,0x7E,0x00}, // 1
+	{0x3C,0x66,0x06,0x0C,0x18,0x30,0x7E,0x00}, // 2
+	{0x3C,0x66,0x06,0x1C,0x06,0x66,0x3C,0x00}, // 3
+	{0x0C,0x1C,0x3C,0x6C,0x7E,0x0C,0x1E,0x00}, // 4
+	{0x7E,0x60,0x7C,0x06,0x06,0x66,0x3C,0x00}, // 5
+	{0x1C,0x30,0x60,0x7C,0x66,0x66,0x3C,0x00}, // 6
+	{0x7E,0x66,0x0C,0x18,0x18,0x18,0x18,0x00}, // 7
+	{0x3C,0x66,0x66,0x3C,0x66,0x66,0x3C,0x00}, // 8
+	{0x3C,0x66,0x66,0x3E,0x06,0x0C,0x38,0x00}, // 9
+	{0x00,0x00,0x18,0x18,0x00,0x18,0x18,0x00}, // :
+	{0x00,0x00,0x18,0x18,0x00,0x18,0x18,0x30}, // ;
+	{0x0E,0x18,0x30,0x60,0x30,0x18,0x0E,0x00}, // <
+	{0x00,0x00,0x7E,0x00,0x7E,0x00,0x00,0x00}, // =
+	{0x70,0x18,0x0C,0x06,0x0C,0x18,0x70,0x00}, // >
+	{0x3C,0x66,0x06,0x0C,0x18,0x00,0x18,0x00}, // ?
+	{0x3C,0x66,0x6E,0x6E,0x60,0x62,0x3C,0x00}, // @
+	{0x18,0x3C,0x66,0x7E,0x66,0x66,0x66,0x00}, // A
+	{0x7C,0x66,0x66,0x7C,0x66,0x66,0x7C,0x00}, // B
+	{0x3C,0x66,0x60,0x60,0x60,0x66,0x3C,0x00}, // C
+	{0x78,0x6C,0x66,0x66,0x66,0x6C,0x78,0x00}, // D
+	{0x7E,0x60,0x60,0x78,0x60,0x60,0x7E,0x00}, // E
+	{0x7E,0x60,0x60,0x78,0x60,0x60,0x60,0x00}, // F
+	{0x3C,0x66,0x60,0x6E,0x66,0x66,0x3C,0x00}, // G
+	{0x66,0x66,0x66,0x7E,0x66,0x66,0x66,0x00}, // H
+	{0x3C,0x18,0x18,0x18,0x18,0x18,0x3C,0x00}, // I
+	{0x1E,0x0C,0x0C,0x0C,0x0C,0x6C,0x38,0x00}, // J
+	{0x66,0x6C,0x78,0x70,0x78,0x6C,0x66,0x00}, // K
+	{0x60,0x60,0x60,0x60,0x60,0x60,0x7E,0x00}, // L
+	{0x63,0x77,0x7F,0x6B,0x63,0x63,0x63,0x00}, // M
+	{0x66,0x76,0x7E,0x7E,0x6E,0x66,0x66,0x00}, // N
+	{0x3C,0x66,0x66,0x66,0x66,0x66,0x3C,0x00}, // O
+	{0x7C,0x66,0x66,0x7C,0x60,0x60,0x60,0x00}, // P
+	{0x3C,0x66,0x66,0x66,0x66,0x3C,0x0E,0x00}, // Q
+	{0x7C,0x66,0x66,0x7C,0x78,0x6C,0x66,0x00}, // R
+	{0x3C,0x66,0x60,0x3C,0x06,0x66,0x3C,0x00}, // S
+	{0x7E,0x18,0x18,0x18,0x18,0x18,0x18,0x00}, // T
+	{0x66,0x66,0x66,0x66,0x66,0x66,0x3C,0x00}, // U
+	{0x66,0x66,0x66,0x66,0x66,0x3C,0x18,0x00}, // V
+	{0x63,0x63,0x63,0x6B,0x7F,0x77,0x63,0x00}, // W
+	{0x66,0x66,0x3C,0x18,0x3C,0x66,0x66,0x00}, // X
+	{0x66,0x66,0x66,0x3C,0x18,0x18,0x18,0x00}, // Y
+	{0x7E,0x06,0x0C,0x18,0x30,0x60,0x7E,0x00}, // Z
+	{0x3C,0x30,0x30,0x30,0x30,0x30,0x3C,0x00}, // [
+	{0x00,0x60,0x30,0x18,0x0C,0x06,0x03,0x00}, // backslash
+	{0x3C,0x0C,0x0C,0x0C,0x0C,0x0C,0x3C,0x00}, // ]
+	{0x18,0x3C,0x66,0x00,0x00,0x00,0x00,0x00}, // ^
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFF}, // _
+	{0x30,0x18,0x0C,0x00,0x00,0x00,0x00,0x00}, // `
+	{0x00,0x00,0x3C,0x06,0x3E,0x66,0x3E,0x00}, // a
+	{0x00,0x60,0x60,0x7C,0x66,0x66,0x7C,0x00}, // b
+	{0x00,0x00,0x3C,0x60,0x60,0x60,0x3C,0x00}, // c
+	{0x00,0x06,0x06,0x3E,0x66,0x66,0x3E,0x00}, // d
+	{0x00,0x00,0x3C,0x66,0x7E,0x60,0x3C,0x00}, // e
+	{0x00,0x0E,0x18,0x3E,0x18,0x18,0x18,0x00}, // f
+	{0x00,0x00,0x3E,0x66,0x66,0x3E,0x06,0x7C}, // g
+	{0x00,0x60,0x60,0x7C,0x66,0x66,0x66,0x00}, // h
+	{0x00,0x18,0x00,0x38,0x18,0x18,0x3C,0x00}, // i
+	{0x00,0x06,0x00,0x06,0x06,0x06,0x06,0x3C}, // j
+	{0x00,0x60,0x60,0x6C,0x78,0x6C,0x66,0x00}, // k
+	{0x00,0x38,0x18,0x18,0x18,0x18,0x3C,0x00}, // l
+	{0x00,0x00,0x66,0x7F,0x7F,0x6B,0x63,0x00}, // m
+	{0x00,0x00,0x7C,0x66,0x66,0x66,0x66,0x00}, // n
+	{0x00,0x00,0x3C,0x66,0x66,0x66,0x3C,0x00}, // o
+	{0x00,0x00,0x7C,0x66,0x66,0x7C,0x60,0x60}, // p
+	{0x00,0x00,0x3E,0x66,0x66,0x3E,0x06,0x06}, // q
+	{0x00,0x00,0x7C,0x66,0x60,0x60,0x60,0x00}, // r
+	{0x00,0x00,0x3E,0x60,0x3C,0x06,0x7C,0x00}, // s
+	{0x00,0x18,0x7E,0x18,0x18,0x18,0x0E,0x00}, // t
+	{0x00,0x00,0x66,0x66,0x66,0x66,0x3E,0x00}, // u
+	{0x00,0x00,0x66,0x66,0x66,0x3C,0x18,0x00}, // v
+	{0x00,0x00,0x63,0x6B,0x7F,0x3E,0x36,0x00}, // w
+	{0x00,0x00,0x66,0x3C,0x18,0x3C,0x66,0x00}, // x
+	{0x00,0x00,0x66,0x66,0x66,0x3E,0x0C,0x78}, // y
+	{0x00,0x00,0x7E,0x0C,0x18,0x30,0x7E,0x00}, // z
+	{0x0E,0x18,0x18,0x70,0x18,0x18,0x0E,0x00}, // {
+	{0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x00}, // |
+	{0x70,0x18,0x18,0x0E,0x18,0x18,0x70,0x00}, // }
+	{0x00,0x00,0x76,0xDC,0x00,0x00,0x00,0x00}, // ~
+};
+
+struct cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t hash; // Of the font and the layout, a changed font makes the cache stale
+};
+
+struct text_vertex {
+	float x, y, u, v;
+	uint8_t color[4]; // RGBA
+	float smoothing;  // Half the width of the antialiased edge, in atlas values
+};
+
+// A glyph rendered from the atlas for the software renderer, drawn with the sw_blend kernel
+struct sw_glyph {
+	int used;
+	int glyph;
+	float size;
+	uint32_t color;
+	unsigned int width, height;
+	unsigned long last_used;
+	uint32_t *pixels; // Non-premultiplied ARGB8888, the color with the coverage as alpha
+};
+
+static struct {
+	int initialized, failed;
+	uint8_t *atlas;   // Kept by the software renderer, freed after the upload otherwise
+	char cache_path[PATH_MAX];
+	int cache_path_set;
+
+	GLuint program, texture, index_buffer;
+	GLint pos_attrib, uv_attrib, color_attrib, smoothing_attrib, tex_uniform, size_uniform;
+
+	struct text_vertex vertices[MAX_TEXT_GLYPHS * 4];
+	unsigned int queued;
+
+	struct sw_glyph sw_glyphs[MAX_SW_GLYPHS];
+	unsigned long sw_uses;
+
+	unsigned int glyphs, draws; // In the current frame
+	struct text_stats stats;
+} text;
+
+static uint32_t layout_hash() {
+	const uint32_t layout[] = { CELL, TEXELS_PER_PIXEL, (uint32_t)(SPREAD * 256), ATLAS_COLUMNS };
+
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeof(ascii_font); i++)
+		hash = (hash ^ ((const unsigned char *)ascii_font)[i]) * 16777619u;
+	for (size_t i = 0; i < sizeof(layout); i++)
+		hash = (hash ^ ((const unsigned char *)layout)[i]) * 16777619u;
+	return hash;
+}
+
+static int font_pixel(int glyph, int x, int y) {
+	if (x < 0 || y < 0 || x > 7 || y > 7)
+		return 0;
+	return (ascii_font[glyph][y] >> (7 - x)) & 1;
+}
+
+// Exact distances to the edge of the glyph's squares: for a texel inside the glyph the
+// nearest square that is off, for one outside the nearest that is on
+static void build_glyph(int glyph, uint8_t *cell, unsigned int stride) {
+	for (int ty = 0; ty < CELL; ty++) {
+		for (int tx = 0; tx < CELL; tx++) {
+			float px = (tx + 0.5f - PADDING) / TEXELS_PER_PIXEL;
+			float py = (ty + 0.5f - PADDING) / TEXELS_PER_PIXEL;
+			int inside = font_pixel(glyph, (int)floorf(px), (int)floorf(py));
+
+			// The ring of pixels around the glyph is off, so inside texels find an edge
+			float nearest = 1e9f;
+			for (int y = -1; y <= 8; y++) {
+				for (int x = -1; x <= 8; x++) {
+					if (font_pixel(glyph, x, y) == inside)
+						continue;
+					float dx = fmaxf(fmaxf(x - px, px - (x + 1)), 0.0f);
+					float dy = fmaxf(fmaxf(y - py, py - (y + 1)), 0.0f);
+					float d = dx * dx + dy * dy;
+					if (d < nearest)
+						nearest = d;
+				}
+			}
+
+			float distance = sqrtf(nearest) * TEXELS_PER_PIXEL;
+			if (nearest >= 1e9f)
+				distance = SPREAD; // Blank glyph
+			float value = 128.0f + (inside ? distance : -distance) * 127.0f / SPREAD;
+			cell[ty * stride + tx] = value < 0.0f ? 0 : value > 255.0f ? 255 : (uint8_t)(value + 0.5f);
+		}
+	}
+}
+
+static void build_atlas(uint8_t *atlas) {
+	memset(atlas, 0, ATLAS_WIDTH * ATLAS_HEIGHT);
+	for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+		int column = glyph % ATLAS_COLUMNS, row = glyph / ATLAS_COLUMNS;
+		build_glyph(glyph, atlas + row * CELL * ATLAS_WIDTH + column * CELL, ATLAS_WIDTH);
+	}
+}
+
+static const char *cache_path() {
+	if (!text.cache_path_set) {
+		const char *path = getenv("SIMPLE_DRM_FONT_CACHE");
+		const char *xdg = getenv("XDG_CACHE_HOME");
+		const char *home = getenv("HOME");
+		if (path)
+			snprintf(text.cache_path, sizeof(text.cache_path), "%s", path);
+		else if (xdg && *xdg)
+			snprintf(text.cache_path, sizeof(text.cache_path), "%s/simple-drm/sdf_font.bin", xdg);
+		else if (home && *home)
+			snprintf(text.cache_path, sizeof(text.cache_path), "%s/.cache/simple-drm/sdf_font.bin", home);
+		text.cache_path_set = 1;
+	}
+	return text.cache_path[0] ? text.cache_path : NULL;
+}
+
+static int read_cache(const char *path, uint8_t *atlas) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 1;
+
+	struct cache_header header;
+	int ret = fread(&header, sizeof(header), 1, f) != 1 || header.magic != CACHE_MAGIC ||
+			header.version != CACHE_VERSION || header.width != ATLAS_WIDTH ||
+			header.height != ATLAS_HEIGHT || header.hash != layout_hash() ||
+			fread(atlas, ATLAS_WIDTH * ATLAS_HEIGHT, 1, f) != 1;
+	fclose(f);
+	return ret;
+}
+
+// Creates the missing directories of path, like mkdir -p of its dirname
+static void create_parent_directories(const char *path) {
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%s", path);
+	for (char *p = dir + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		mkdir(dir, 0755);
+		*p = '/';
+	}
+}
+
+// Written to a temporary file and renamed, so a process reading the cache never sees half of it
+static void write_cache(const char *path, const uint8_t *atlas) {
+	char temporary[PATH_MAX + 16];
+	snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+	create_parent_directories(path);
+
+	FILE *f = fopen(temporary, "wb");
+	if (!f) {
+		printf("Text Error: Failed to write the font cache %s (%s)\n", path, strerror(errno));
+		return;
+	}
+
+	const struct cache_header header = { CACHE_MAGIC, CACHE_VERSION, ATLAS_WIDTH, ATLAS_HEIGHT, layout_hash() };
+	int failed = fwrite(&header, sizeof(header), 1, f) != 1 ||
+			fwrite(atlas, ATLAS_WIDTH * ATLAS_HEIGHT, 1, f) != 1;
+	if (fclose(f) || failed || rename(temporary, path)) {
+		printf("Text Error: Failed to write the font cache %s\n", path);
+		unlink(temporary);
+	}
+}
+
+static int init_text_program() {
+	const char *vertex_shader =
+		"attribute vec2 a_Position;"
+		"attribute vec2 a_TexCoord;"
+		"attribute vec4 a_Color;"
+		"attribute float a_Smoothing;"
+		"uniform vec2 u_Screen;"
+		"varying vec2 v_TexCoord;"
+		"varying vec4 v_Color;"
+		"varying float v_Smoothing;"
+		"void main() {"
+		"    v_TexCoord = a_TexCoord;"
+		"    v_Color = a_Color;"
+		"    v_Smoothing = a_Smoothing;"
+		"    gl_Position = vec4(a_Position.x / u_Screen.x * 2.0 - 1.0, 1.0 - a_Position.y / u_Screen.y * 2.0, 0.0, 1.0);"
+		"}";
+
+	// 0.5 is the glyph's edge, the antialiased band around it is about a pixel wide at any size
+	const char *fragment_shader =
+		"precision mediump float;"
+		"uniform sampler2D u_Atlas;"
+		"varying vec2 v_TexCoord;"
+		"varying vec4 v_Color;"
+		"varying float v_Smoothing;"
+		"void main() {"
+		"    float distance = texture2D(u_Atlas, v_TexCoord).a;"
+		"    float alpha = smoothstep(0.5 - v_Smoothing, 0.5 + v_Smoothing, distance);"
+		"    gl_FragColor = vec4(v_Color.rgb, v_Color.a * alpha);"
+		"}";
+
+	text.program = createProgram(vertex_shader, fragment_shader);
+	if (!text.program) {
+		printf("Text Error: Failed to create the text program\n");
+		return 1;
+	}
+
+	text.pos_attrib = glGetAttribLocation(text.program, "a_Position");
+	text.uv_attrib = glGetAttribLocation(text.program, "a_TexCoord");
+	text.color_attrib = glGetAttribLocation(text.program, "a_Color");
+	text.smoothing_attrib = glGetAttribLocation(text.program, "a_Smoothing");
+	text.tex_uniform = glGetUniformLocation(text.program, "u_Atlas");
+	text.size_uniform = glGetUniformLocation(text.program, "u_Screen");
+
+	// Two triangles per glyph, the indices never change
+	GLushort *indices = malloc(MAX_TEXT_GLYPHS * 6 * sizeof(GLushort));
+	if (!indices) {
+		printf("Text Error: Out of memory\n");
+		return 1;
+	}
+	for (unsigned int i = 0; i < MAX_TEXT_GLYPHS; i++) {
+		const GLushort quad[6] = { i * 4, i * 4 + 1, i * 4 + 2, i * 4 + 1, i * 4 + 3, i * 4 + 2 };
+		memcpy(&indices[i * 6], quad, sizeof(quad));
+	}
+	glGenBuffers(1, &text.index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, text.index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_TEXT_GLYPHS * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	free(indices);
+
+	// Linear filtering is what makes the edges smooth when the atlas is magnified
+	glGenTextures(1, &text.texture);
+	glBindTexture(GL_TEXTURE_2D, text.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_ALPHA, GL_UNSIGNED_BYTE, text.atlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return 0;
+}
+
+static int init_text() {
+	TRACE_BEGIN("text atlas");
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	text.atlas = malloc(ATLAS_WIDTH * ATLAS_HEIGHT);
+	if (!text.atlas) {
+		printf("Text Error: Out of memory\n");
+		TRACE_END();
+		return 1;
+	}
+
+	const char *path = cache_path();
+	text.stats.from_cache = path && !read_cache(path, text.atlas);
+	if (!text.stats.from_cache) {
+		build_atlas(text.atlas);
+		if (path)
+			write_cache(path, text.atlas);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	text.stats.build_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+	text.stats.atlas_bytes = ATLAS_WIDTH * ATLAS_HEIGHT;
+	TRACE_END();
+
+	if (renderer_is_software())
+		return 0;
+
+	int ret = init_text_program();
+	free(text.atlas);
+	text.atlas = NULL;
+	return ret;
+}
+
+// Edge band for text drawn at size: about half a screen pixel either side of the edge
+static float edge_smoothing(float size) {
+	float texels_per_pixel = 8 * TEXELS_PER_PIXEL / size;
+	return 0.5f * texels_per_pixel * 127.0f / (SPREAD * 255.0f);
+}
+
+static int glyph_index(char c) {
+	return c >= FIRST_GLYPH && c < FIRST_GLYPH + GLYPH_COUNT ? c - FIRST_GLYPH : -1;
+}
+
+static float atlas_sample(float u, float v) {
+	int x0 = (int)floorf(u), y0 = (int)floorf(v);
+	float fx = u - x0, fy = v - y0;
+	int x1 = x0 + 1 < ATLAS_WIDTH ? x0 + 1 : x0, y1 = y0 + 1 < ATLAS_HEIGHT ? y0 + 1 : y0;
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+
+	const uint8_t *row0 = text.atlas + y0 * ATLAS_WIDTH, *row1 = text.atlas + y1 * ATLAS_WIDTH;
+	float top = row0[x0] + (row0[x1] - row0[x0]) * fx;
+	float bottom = row1[x0] + (row1[x1] - row1[x0]) * fx;
+	return (top + (bottom - top) * fy) / 255.0f;
+}
+
+// Samples the atlas once per pixel of the glyph at this size
+static void render_sw_glyph(struct sw_glyph *image) {
+	float texels_per_pixel = 8.0f * TEXELS_PER_PIXEL / image->size, smoothing = edge_smoothing(image->size);
+	float cell_x = (image->glyph % ATLAS_COLUMNS) * CELL, cell_y = (image->glyph / ATLAS_COLUMNS) * CELL;
+	uint32_t rgb = image->color & 0xFFFFFF, alpha = image->color >> 24;
+
+	for (unsigned int py = 0; py < image->height; py++) {
+		float v = (py + 0.5f) * texels_per_pixel;
+		for (unsigned int px = 0; px < image->width; px++) {
+			float u = (px + 0.5f) * texels_per_pixel;
+			float coverage = 0.0f;
+			if (u < CELL && v < CELL)
+				coverage = (atlas_sample(cell_x + u - 0.5f, cell_y + v - 0.5f) - 0.5f + smoothing) / (2.0f * smoothing);
+			coverage = coverage < 0.0f ? 0.0f : coverage > 1.0f ? 1.0f : coverage;
+			image->pixels[py * image->width + px] = (uint32_t)(coverage * alpha + 0.5f) << 24 | rgb;
+		}
+	}
+}
+
+// Returns the glyph's image, rendering it into the least recently used slot when it isn't
+// cached. NULL if it can't be allocated.
+static const struct sw_glyph *get_sw_glyph(int glyph, float size, uint32_t color) {
+	struct sw_glyph *image = NULL, *oldest = &text.sw_glyphs[0];
+	for (int i = 0; i < MAX_SW_GLYPHS && !image; i++) {
+		struct sw_glyph *slot = &text.sw_glyphs[i];
+		if (slot->used && slot->glyph == glyph && slot->size == size && slot->color == color)
+			image = slot;
+		else if (slot->last_used < oldest->last_used)
+			oldest = slot;
+	}
+
+	if (!image) {
+		unsigned int side = (unsigned int)ceilf(size * CELL / (8 * TEXELS_PER_PIXEL));
+		if (!oldest->pixels || oldest->width != side) {
+			free(oldest->pixels);
+			oldest->pixels = malloc((size_t)side * side * sizeof(uint32_t));
+			if (!oldest->pixels) {
+				printf("Text Error: Malloc failed\n");
+				oldest->used = 0;
+				return NULL;
+			}
+		}
+		image = oldest;
+		image->used = 1;
+		image->glyph = glyph;
+		image->size = size;
+		image->color = color;
+		image->width = image->height = side;
+		render_sw_glyph(image);
+	}
+	image->last_used = ++text.sw_uses;
+	return image;
+}
+
+static void draw_glyph_software(int glyph, float x, float y, float size, uint32_t color) {
+	const struct sw_glyph *image = get_sw_glyph(glyph, size, color);
+	if (image)
+		sw_blend(renderer_get_canvas(), (int)lroundf(x), (int)lroundf(y), image->pixels, image->width, image->height,
+				image->width);
+}
+
+void text_set_cache_path(const char *path) {
+	if (text.initialized) {
+		printf("Text Error: The cache path must be set before text is drawn\n");
+		return;
+	}
+
+	snprintf(text.cache_path, sizeof(text.cache_path), "%s", path ? path : "");
+	text.cache_path_set = 1;
+}
+
+void text_draw(const char *string, float x, float y, float size, uint32_t color) {
+	if (!string || size <= 0.0f)
+		return;
+	if (!text.initialized) {
+		text.initialized = 1;
+		text.failed = init_text();
+	}
+	if (text.failed)
+		return;
+
+	int software = renderer_is_software();
+	float pad = size * PADDING / (8 * TEXELS_PER_PIXEL), cell_size = size * CELL / (8 * TEXELS_PER_PIXEL);
+	float smoothing = edge_smoothing(size);
+	const uint8_t rgba[4] = { (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, color >> 24 };
+
+	float cx = x, cy = y;
+	for (const char *c = string; *c; c++) {
+		if (*c == '\n') {
+			cx = x;
+			cy += size * 1.25f;
+			continue;
+		}
+
+		int glyph = glyph_index(*c);
+		if (glyph > 0) { // Space draws nothing
+			if (software) {
+				draw_glyph_software(glyph, cx - pad, cy - pad, size, color);
+				text.glyphs++;
+			} else {
+				if (text.queued == MAX_TEXT_GLYPHS)
+					text_flush();
+
+				float u0 = (float)(glyph % ATLAS_COLUMNS * CELL) / ATLAS_WIDTH;
+				float v0 = (float)(glyph / ATLAS_COLUMNS * CELL) / ATLAS_HEIGHT;
+				float u1 = u0 + (float)CELL / ATLAS_WIDTH, v1 = v0 + (float)CELL / ATLAS_HEIGHT;
+				float left = cx - pad, top = cy - pad;
+
+				struct text_vertex *quad = &text.vertices[text.queued++ * 4];
+				quad[0] = (struct text_vertex){ left, top, u0, v0, { rgba[0], rgba[1], rgba[2], rgba[3] }, smoothing };
+				quad[1] = quad[0];
+				quad[1].x = left + cell_size;
+				quad[1].u = u1;
+				quad[2] = quad[0];
+				quad[2].y = top + cell_size;
+				quad[2].v = v1;
+				quad[3] = quad[1];
+				quad[3].y = top + cell_size;
+				quad[3].v = v1;
+			}
+		}
+		cx += size;
+	}
+}
+
+float text_width(const char *string, float size) {
+	unsigned int longest = 0, length = 0;
+	for (const char *c = string; c && *c; c++) {
+		length = *c == '\n' ? 0 : length + 1;
+		if (length > longest)
+			longest = length;
+	}
+	return longest * size;
+}
+
+void text_flush() {
+	if (!text.queued)
+		return;
+
+	TRACE_BEGIN("text");
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST), scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+	GLboolean cull_face = glIsEnabled(GL_CULL_FACE), blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glUseProgram(text.program);
+	glUniform2f(text.size_uniform, viewport[2], viewport[3]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, text.texture);
+	glUniform1i(text.tex_uniform, 0);
+
+	const struct text_vertex *vertices = text.vertices;
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glVertexAttribPointer(text.pos_attrib, 2, GL_FLOAT, GL_FALSE, sizeof(*vertices), &vertices->x);
+	glEnableVertexAttribArray(text.pos_attrib);
+	glVertexAttribPointer(text.uv_attrib, 2, GL_FLOAT, GL_FALSE, sizeof(*vertices), &vertices->u);
+	glEnableVertexAttribArray(text.uv_attrib);
+	glVertexAttribPointer(text.color_attrib, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(*vertices), vertices->color);
+	glEnableVertexAttribArray(text.color_attrib);
+	glVertexAttribPointer(text.smoothing_attrib, 1, GL_FLOAT, GL_FALSE, sizeof(*vertices), &vertices->smoothing);
+	glEnableVertexAttribArray(text.smoothing_attrib);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, text.index_buffer);
+	glDrawElements(GL_TRIANGLES, text.queued * 6, GL_UNSIGNED_SHORT, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	glDisableVertexAttribArray(text.pos_attrib);
+	glDisableVertexAttribArray(text.uv_attrib);
+	glDisableVertexAttribArray(text.color_attrib);
+	glDisableVertexAttribArray(text.smoothing_attrib);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+
+	if (depth_test)
+		glEnable(GL_DEPTH_TEST);
+	if (scissor_test)
+		glEnable(GL_SCISSOR_TEST);
+	if (cull_face)
+		glEnable(GL_CULL_FACE);
+	if (!blend)
+		glDisable(GL_BLEND);
+
+	text.glyphs += text.queued;
+	text.draws++;
+	text.queued = 0;
+	TRACE_END();
+}
+
+void text_stats(struct text_stats *stats) {
+	*stats = text.stats;
+}
+
+// Called by the renderer with the overlay: the text queued in the frame goes over all of it
+void draw_text_overlay() {
+	if (!text.queued)
+		return;
+
+	glViewport(0, 0, renderer_get_width(), renderer_get_height());
+	text_flush();
+}
+
+// Called by the renderer after the swap
+void text_frame_end() {
+	text.stats.glyphs = text.glyphs;
+	text.stats.draws = text.draws;
+	text.glyphs = 0;
+	text.draws = 0;
+}
+
+void free_text() {
+	if (text.program)
+		glDeleteProgram(text.program);
+	if (text.texture)
+		glDeleteTextures(1, &text.texture);
+	if (text.index_buffer)
+		glDeleteBuffers(1, &text.index_buffer);
+	free(text.atlas);
+	for (int i = 0; i < MAX_SW_GLYPHS; i++) {
+		free(text.sw_glyphs[i].pixels);
+		memset(&text.sw_glyphs[i], 0, sizeof(text.sw_glyphs[i]));
+	}
+
+	text.program = 0;
+	text.texture = 0;
+	text.index_buffer = 0;
+	text.atlas = NULL;
+	text.queued = 0;
+	text.initialized = 0;
+	text.failed = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef HELPERS_TEXT_HELPERS_H_
+#define HELPERS_TEXT_HELPERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Signed distance field text. The printable ASCII glyphs of an 8x8 bitmap font are turned into
+// one atlas of distances to the glyph edges, so a single 512x192 alpha texture draws crisp text
+// at any size: edges are found per pixel instead of magnifying texels. The atlas is generated
+// on the first text draw and cached on disk, later runs only read it back.
+//
+// Text is queued and every glyph of a frame is drawn in one draw call when the renderer draws
+// the overlay, over the application's frame and the IPC layers. Call text_flush() to draw the
+// queued text earlier, e.g. into a render target. The software renderer draws text right away:
+// each glyph is rendered from the same atlas once per size and color and then blended with
+// the Software_helpers kernels.
+
+#define MAX_TEXT_GLYPHS 8192 // Per draw call, more glyphs are drawn in several
+
+struct text_stats {
+	unsigned int glyphs; // Drawn in the last frame
+	unsigned int draws;  // Draw calls of the last frame
+	size_t atlas_bytes;
+	int from_cache;      // The atlas was read from the cache file instead of generated
+	double build_ms;     // Generating or loading the atlas
+};
+
+// File the atlas is cached in, NULL or "" disables the cache. The default is
+// $XDG_CACHE_HOME/simple-drm/sdf_font.bin (~/.cache when unset); the SIMPLE_DRM_FONT_CACHE
+// environment variable overrides both. Must be called before the first text is drawn.
+void text_set_cache_path(const char *path);
+
+// Queues text with its top left corner at (x, y) in screen pixels. size is the height of a
+// line of glyphs in pixels, which is also the advance of every character; '\n' starts a new
+// line. color is 0xAARRGGBB.
+void text_draw(const char *text, float x, float y, float size, uint32_t color);
+
+// Width in pixels of the longest line of text drawn at size.
+float text_width(const char *text, float size);
+
+// Draws the queued text now, to the framebuffer that is bound.
+void text_flush();
+
+void text_stats(struct text_stats *stats);
+
+#endif /* HELPERS_TEXT_HELPERS_H_ */
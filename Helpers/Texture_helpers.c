@@ -0,0 +1,675 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <GLES2/gl2.h>
+#include "Texture_helpers.h"
+#include "Renderer_helpers.h"
+#include "Trace_helpers.h"
+
+// Largest width or height accepted from a file
+#define MAX_IMAGE_SIZE 16384
+
+enum texture_state {
+	TEXTURE_FREE,
+	TEXTURE_UNLOADED,  // Not loaded yet or evicted
+	TEXTURE_QUEUED,    // Waiting for or being decoded by the worker
+	TEXTURE_DECODED,   // Pixels ready, waiting for the upload
+	TEXTURE_UPLOADING,
+	TEXTURE_RESIDENT,
+	TEXTURE_FAILED,
+};
+
+struct texture {
+	enum texture_state state;
+	unsigned int generation; // Bumped when the slot is released, drops decodes of the old image
+	char *path;
+	unsigned int raw_width, raw_height; // Raw RGBA8888 file when not 0
+
+	unsigned int width, height, levels;
+	unsigned char *pixels; // Decoded mip chain, level after level
+	size_t bytes;          // Size of the mip chain, which is also its GPU size
+
+	GLuint name;
+	unsigned int upload_level, upload_row;
+	unsigned long last_used;
+};
+
+static struct {
+	pthread_mutex_t lock; // Guards the textures and the queue against the worker
+	pthread_cond_t wake;
+	pthread_t worker;
+	int worker_running;
+	int quit;
+
+	struct texture textures[MAX_TEXTURES];
+	int queue[MAX_TEXTURES]; // Slots waiting to be decoded
+	unsigned int queue_head, queue_count;
+
+	size_t budget, upload_bytes;
+	size_t resident_bytes;
+	unsigned long frame;
+	unsigned long loads, evictions;
+	int npot_mipmaps; // 0 not checked, 1 NPOT textures can have mipmaps, -1 they can't
+} cache = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+		.budget = TEXTURE_DEFAULT_BUDGET, .upload_bytes = TEXTURE_DEFAULT_UPLOAD_BYTES };
+
+void texture_cache_configure(size_t budget, size_t upload_bytes_per_frame) {
+	cache.budget = budget ? budget : TEXTURE_DEFAULT_BUDGET;
+	cache.upload_bytes = upload_bytes_per_frame ? upload_bytes_per_frame : TEXTURE_DEFAULT_UPLOAD_BYTES;
+}
+
+/* Decoding, runs on the worker */
+
+static unsigned int mip_levels(unsigned int width, unsigned int height) {
+	unsigned int levels = 1;
+	while (width > 1 || height > 1) {
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		levels++;
+	}
+	return levels;
+}
+
+static size_t mip_chain_bytes(unsigned int width, unsigned int height, unsigned int levels) {
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < levels; i++) {
+		bytes += (size_t)width * height * 4;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return bytes;
+}
+
+// Fills the levels after the first with 2x2 box filtered copies of the previous one
+static void build_mips(unsigned char *pixels, unsigned int width, unsigned int height, unsigned int levels) {
+	unsigned char *src = pixels;
+	for (unsigned int level = 1; level < levels; level++) {
+		unsigned int w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+		unsigned char *dst = src + (size_t)width * height * 4;
+
+		for (unsigned int y = 0; y < h; y++) {
+			unsigned int y0 = y * 2, y1 = y * 2 + 1 < height ? y * 2 + 1 : y0;
+			for (unsigned int x = 0; x < w; x++) {
+				unsigned int x0 = x * 2, x1 = x * 2 + 1 < width ? x * 2 + 1 : x0;
+				const unsigned char *a = &src[((size_t)y0 * width + x0) * 4], *b = &src[((size_t)y0 * width + x1) * 4];
+				const unsigned char *c = &src[((size_t)y1 * width + x0) * 4], *d = &src[((size_t)y1 * width + x1) * 4];
+				unsigned char *out = &dst[((size_t)y * w + x) * 4];
+				for (int i = 0; i < 4; i++)
+					out[i] = (a[i] + b[i] + c[i] + d[i] + 2) / 4;
+			}
+		}
+
+		src = dst;
+		width = w;
+		height = h;
+	}
+}
+
+// Reads the next number of a PPM header, skipping whitespace and comments
+static int ppm_number(const unsigned char *data, size_t size, size_t *pos, unsigned int *value) {
+	while (*pos < size) {
+		if (data[*pos] == '#') {
+			while (*pos < size && data[*pos] != '\n')
+				(*pos)++;
+		} else if (data[*pos] == ' ' || data[*pos] == '\t' || data[*pos] == '\r' || data[*pos] == '\n') {
+			(*pos)++;
+		} else {
+			break;
+		}
+	}
+
+	if (*pos >= size || data[*pos] < '0' || data[*pos] > '9')
+		return 1;
+	*value = 0;
+	while (*pos < size && data[*pos] >= '0' && data[*pos] <= '9') {
+		*value = *value * 10 + (data[*pos] - '0');
+		if (*value > 1000000)
+			return 1;
+		(*pos)++;
+	}
+	return 0;
+}
+
+static int ppm_header(const unsigned char *data, size_t size, unsigned int *width, unsigned int *height,
+		unsigned int *channels, size_t *pixels) {
+	size_t pos = 2;
+	unsigned int maxval;
+	*channels = data[1] == '6' ? 3 : 1;
+	if (ppm_number(data, size, &pos, width) || ppm_number(data, size, &pos, height) ||
+			ppm_number(data, size, &pos, &maxval) || pos >= size)
+		return 1;
+	if (maxval == 0 || maxval > 255)
+		return 1; // 16 bit samples aren't supported
+
+	*pixels = pos + 1; // A single whitespace ends the header
+	return *pixels + (size_t)*width * *height * *channels > size;
+}
+
+static void ppm_decode(const unsigned char *src, unsigned int count, unsigned int channels, unsigned char *dst) {
+	for (unsigned int i = 0; i < count; i++, dst += 4) {
+		if (channels == 3) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			src += 3;
+		} else {
+			dst[0] = dst[1] = dst[2] = *src++;
+		}
+		dst[3] = 255;
+	}
+}
+
+static unsigned int read_be32(const unsigned char *p) {
+	return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// QOI, see qoiformat.org. Returns 1 if the data ends early.
+static int qoi_decode(const unsigned char *data, size_t size, unsigned int count, unsigned char *dst) {
+	unsigned char index[64][4];
+	unsigned char px[4] = { 0, 0, 0, 255 };
+	memset(index, 0, sizeof(index));
+
+	size_t pos = 14, end = size - 8; // 8 byte end marker
+	unsigned int run = 0;
+	for (unsigned int i = 0; i < count; i++, dst += 4) {
+		if (run) {
+			run--;
+		} else {
+			if (pos >= end)
+				return 1;
+			unsigned char b1 = data[pos++];
+			if (b1 == 0xfe) {
+				if (pos + 3 > end)
+					return 1;
+				memcpy(px, &data[pos], 3);
+				pos += 3;
+			} else if (b1 == 0xff) {
+				if (pos + 4 > end)
+					return 1;
+				memcpy(px, &data[pos], 4);
+				pos += 4;
+			} else if ((b1 & 0xc0) == 0x00) {
+				memcpy(px, index[b1], 4);
+			} else if ((b1 & 0xc0) == 0x40) {
+				px[0] += ((b1 >> 4) & 3) - 2;
+				px[1] += ((b1 >> 2) & 3) - 2;
+				px[2] += (b1 & 3) - 2;
+			} else if ((b1 & 0xc0) == 0x80) {
+				if (pos >= end)
+					return 1;
+				unsigned char b2 = data[pos++];
+				int vg = (b1 & 0x3f) - 32;
+				px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+				px[1] += vg;
+				px[2] += vg - 8 + (b2 & 0x0f);
+			} else {
+				run = b1 & 0x3f;
+			}
+			memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+		}
+		memcpy(dst, px, 4);
+	}
+	return 0;
+}
+
+// Maps an image file read only. Returns NULL on failure.
+static unsigned char *map_image(const char *path, size_t *size) {
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("Texture Error: Failed to open %s\n", path);
+		return NULL;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size == 0) {
+		printf("Texture Error: Failed to read %s\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	unsigned char *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+	// Decoding reads the file front to back once
+	madvise(data, *size, MADV_SEQUENTIAL);
+	return data;
+}
+
+struct decode {
+	char path[PATH_MAX];
+	unsigned int raw_width, raw_height;
+	int npot_mipmaps;
+
+	// Results
+	unsigned int width, height, levels;
+	unsigned char *pixels;
+	size_t bytes;
+};
+
+static int decode_image(struct decode *job) {
+	size_t size;
+	unsigned char *data = map_image(job->path, &size);
+	if (!data)
+		return 1;
+
+	enum { IMAGE_RAW, IMAGE_PPM, IMAGE_QOI } type;
+	unsigned int channels = 4;
+	size_t offset = 0;
+	int ret = 1;
+
+	if (job->raw_width) {
+		type = IMAGE_RAW;
+		job->width = job->raw_width;
+		job->height = job->raw_height;
+		if ((size_t)job->width * job->height * 4 != size) {
+			printf("Texture Error: %s isn't %ux%u RGBA8888\n", job->path, job->width, job->height);
+			goto out;
+		}
+	} else if (size >= 22 && memcmp(data, "qoif", 4) == 0) {
+		type = IMAGE_QOI;
+		job->width = read_be32(data + 4);
+		job->height = read_be32(data + 8);
+	} else if (size >= 3 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+		type = IMAGE_PPM;
+		if (ppm_header(data, size, &job->width, &job->height, &channels, &offset)) {
+			printf("Texture Error: Invalid PPM file %s\n", job->path);
+			goto out;
+		}
+	} else {
+		printf("Texture Error: %s isn't a PPM, PGM or QOI file\n", job->path);
+		goto out;
+	}
+
+	if (!job->width || !job->height || job->width > MAX_IMAGE_SIZE || job->height > MAX_IMAGE_SIZE) {
+		printf("Texture Error: Invalid image size %ux%u in %s\n", job->width, job->height, job->path);
+		goto out;
+	}
+
+	int power_of_two = (job->width & (job->width - 1)) == 0 && (job->height & (job->height - 1)) == 0;
+	job->levels = power_of_two || job->npot_mipmaps ? mip_levels(job->width, job->height) : 1;
+	job->bytes = mip_chain_bytes(job->width, job->height, job->levels);
+	job->pixels = malloc(job->bytes);
+	if (!job->pixels) {
+		printf("Texture Error: Malloc failed\n");
+		goto out;
+	}
+
+	unsigned int count = job->width * job->height;
+	if (type == IMAGE_RAW) {
+		memcpy(job->pixels, data, (size_t)count * 4);
+	} else if (type == IMAGE_PPM) {
+		ppm_decode(data + offset, count, channels, job->pixels);
+	} else if (qoi_decode(data, size, count, job->pixels)) {
+		printf("Texture Error: Truncated QOI file %s\n", job->path);
+		free(job->pixels);
+		job->pixels = NULL;
+		goto out;
+	}
+
+	build_mips(job->pixels, job->width, job->height, job->levels);
+	ret = 0;
+
+out:
+	munmap(data, size);
+	return ret;
+}
+
+static void *decode_worker(void *arg) {
+	(void)arg;
+	TRACE_THREAD_NAME("texture decode");
+	struct decode *job = malloc(sizeof(*job));
+	if (!job) {
+		printf("Texture Error: Malloc failed\n");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache.lock);
+	while (1) {
+		while (!cache.queue_count && !cache.quit)
+			pthread_cond_wait(&cache.wake, &cache.lock);
+		if (cache.quit)
+			break;
+
+		int slot = cache.queue[cache.queue_head];
+		cache.queue_head = (cache.queue_head + 1) % MAX_TEXTURES;
+		cache.queue_count--;
+
+		// The slot may be released while decoding, work on a copy
+		struct texture *texture = &cache.textures[slot];
+		unsigned int generation = texture->generation;
+		snprintf(job->path, sizeof(job->path), "%s", texture->path);
+		job->raw_width = texture->raw_width;
+		job->raw_height = texture->raw_height;
+		job->npot_mipmaps = cache.npot_mipmaps == 1;
+		job->pixels = NULL;
+		cache.loads++;
+		pthread_mutex_unlock(&cache.lock);
+
+		TRACE_BEGIN("decode texture");
+		int failed = decode_image(job);
+		TRACE_END();
+
+		pthread_mutex_lock(&cache.lock);
+		if (texture->generation != generation || texture->state != TEXTURE_QUEUED) {
+			free(job->pixels);
+			continue;
+		}
+		if (failed) {
+			texture->state = TEXTURE_FAILED;
+			continue;
+		}
+		texture->width = job->width;
+		texture->height = job->height;
+		texture->levels = job->levels;
+		texture->bytes = job->bytes;
+		texture->pixels = job->pixels;
+		texture->state = TEXTURE_DECODED;
+	}
+	pthread_mutex_unlock(&cache.lock);
+
+	free(job);
+	return NULL;
+}
+
+/* Cache, runs on the render thread */
+
+// Call with the lock held
+static void queue_decode(int slot) {
+	cache.textures[slot].state = TEXTURE_QUEUED;
+	cache.queue[(cache.queue_head + cache.queue_count) % MAX_TEXTURES] = slot;
+	cache.queue_count++;
+	pthread_cond_signal(&cache.wake);
+}
+
+// Call with the lock held
+static void unqueue_decode(int slot) {
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < cache.queue_count; i++) {
+		int queued = cache.queue[(cache.queue_head + i) % MAX_TEXTURES];
+		if (queued != slot)
+			cache.queue[(cache.queue_head + kept++) % MAX_TEXTURES] = queued;
+	}
+	cache.queue_count = kept;
+}
+
+static int add_texture(const char *path, unsigned int raw_width, unsigned int raw_height) {
+	if (renderer_is_software()) {
+		printf("Texture Error: Textures need the GL renderer\n");
+		return -1;
+	}
+	if (!path) {
+		printf("Texture Error: Invalid path\n");
+		return -1;
+	}
+
+	if (!cache.npot_mipmaps) {
+		const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+		const char *version = (const char *)glGetString(GL_VERSION);
+		int npot = (extensions && strstr(extensions, "GL_OES_texture_npot")) ||
+				(version && strncmp(version, "OpenGL ES 3", 11) == 0);
+		cache.npot_mipmaps = npot ? 1 : -1;
+	}
+
+	if (!cache.worker_running) {
+		cache.quit = 0;
+		if (pthread_create(&cache.worker, NULL, decode_worker, NULL)) {
+			printf("Texture Error: Failed to start the decode thread\n");
+			return -1;
+		}
+		cache.worker_running = 1;
+	}
+
+	pthread_mutex_lock(&cache.lock);
+	int slot = -1;
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		if (cache.textures[i].state == TEXTURE_FREE) {
+			slot = i;
+			break;
+		}
+	}
+	if (slot < 0) {
+		pthread_mutex_unlock(&cache.lock);
+		printf("Texture Error: More than %d textures\n", MAX_TEXTURES);
+		return -1;
+	}
+
+	struct texture *texture = &cache.textures[slot];
+	unsigned int generation = texture->generation;
+	memset(texture, 0, sizeof(*texture));
+	texture->generation = generation;
+	texture->path = strdup(path);
+	if (!texture->path) {
+		pthread_mutex_unlock(&cache.lock);
+		printf("Texture Error: Malloc failed\n");
+		return -1;
+	}
+	texture->raw_width = raw_width;
+	texture->raw_height = raw_height;
+	texture->last_used = cache.frame;
+	queue_decode(slot);
+	pthread_mutex_unlock(&cache.lock);
+	return slot;
+}
+
+int load_texture(const char *path) {
+	return add_texture(path, 0, 0);
+}
+
+int load_raw_texture(const char *path, unsigned int width, unsigned int height) {
+	if (!width || !height || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE) {
+		printf("Texture Error: Invalid raw image size %ux%u\n", width, height);
+		return -1;
+	}
+	return add_texture(path, width, height);
+}
+
+static struct texture *get_texture(int id) {
+	if (id < 0 || id >= MAX_TEXTURES || cache.textures[id].state == TEXTURE_FREE)
+		return NULL;
+	return &cache.textures[id];
+}
+
+unsigned int texture_get(int id) {
+	pthread_mutex_lock(&cache.lock);
+	struct texture *texture = get_texture(id);
+	GLuint name = 0;
+	if (texture) {
+		texture->last_used = cache.frame;
+		if (texture->state == TEXTURE_RESIDENT)
+			name = texture->name;
+		else if (texture->state == TEXTURE_UNLOADED)
+			queue_decode(id);
+	}
+	pthread_mutex_unlock(&cache.lock);
+	return name;
+}
+
+void texture_size(int id, unsigned int *width, unsigned int *height) {
+	pthread_mutex_lock(&cache.lock);
+	struct texture *texture = get_texture(id);
+	*width = texture ? texture->width : 0;
+	*height = texture ? texture->height : 0;
+	pthread_mutex_unlock(&cache.lock);
+}
+
+// Deletes the GL texture and the pixels, call with the lock held
+static void unload(struct texture *texture) {
+	if (texture->name) {
+		glDeleteTextures(1, &texture->name);
+		texture->name = 0;
+	}
+	if (texture->state == TEXTURE_RESIDENT)
+		cache.resident_bytes -= texture->bytes;
+	free(texture->pixels);
+	texture->pixels = NULL;
+
+	// A texture paged back in is uploaded from the start again
+	texture->upload_level = 0;
+	texture->upload_row = 0;
+}
+
+void release_texture(int id) {
+	pthread_mutex_lock(&cache.lock);
+	struct texture *texture = get_texture(id);
+	if (texture) {
+		if (texture->state == TEXTURE_QUEUED)
+			unqueue_decode(id);
+		unload(texture);
+		free(texture->path);
+		texture->path = NULL;
+		texture->generation++;
+		texture->state = TEXTURE_FREE;
+	}
+	pthread_mutex_unlock(&cache.lock);
+}
+
+// Uploads rows of the texture until it is done or budget runs out. Returns the bytes uploaded.
+static size_t upload_rows(struct texture *texture, size_t budget) {
+	if (!texture->name) {
+		glGenTextures(1, &texture->name);
+		glBindTexture(GL_TEXTURE_2D, texture->name);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		// Allocate every level up front, the rows are filled in over the next frames
+		unsigned int w = texture->width, h = texture->height;
+		for (unsigned int level = 0; level < texture->levels; level++) {
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	} else {
+		glBindTexture(GL_TEXTURE_2D, texture->name);
+	}
+
+	size_t uploaded = 0;
+	while (texture->upload_level < texture->levels && uploaded < budget) {
+		unsigned int level = texture->upload_level;
+		unsigned int w = texture->width >> level ? texture->width >> level : 1;
+		unsigned int h = texture->height >> level ? texture->height >> level : 1;
+		const unsigned char *pixels = texture->pixels + mip_chain_bytes(texture->width, texture->height, level);
+
+		size_t row_bytes = (size_t)w * 4;
+		unsigned int rows = (budget - uploaded) / row_bytes;
+		if (rows == 0)
+			rows = 1; // Rows wider than the budget still move forward
+		if (rows > h - texture->upload_row)
+			rows = h - texture->upload_row;
+
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, texture->upload_row, w, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+				pixels + texture->upload_row * row_bytes);
+		uploaded += rows * row_bytes;
+
+		texture->upload_row += rows;
+		if (texture->upload_row == h) {
+			texture->upload_row = 0;
+			texture->upload_level++;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return uploaded;
+}
+
+// Drops the least recently used textures until the cache fits its budget. Textures used in
+// the current frame are kept even if that means going over. Call with the lock held.
+static void evict_textures() {
+	while (cache.resident_bytes > cache.budget) {
+		struct texture *oldest = NULL;
+		for (int i = 0; i < MAX_TEXTURES; i++) {
+			struct texture *texture = &cache.textures[i];
+			if (texture->state == TEXTURE_RESIDENT && texture->last_used < cache.frame &&
+					(!oldest || texture->last_used < oldest->last_used))
+				oldest = texture;
+		}
+		if (!oldest)
+			return;
+
+		unload(oldest);
+		oldest->state = TEXTURE_UNLOADED;
+		cache.evictions++;
+	}
+}
+
+// Called by the renderer after each frame. Uploads decoded textures within the per-frame
+// budget and evicts textures over the memory budget.
+void process_texture_uploads() {
+	size_t uploaded = 0;
+
+	pthread_mutex_lock(&cache.lock);
+	for (int i = 0; i < MAX_TEXTURES && uploaded < cache.upload_bytes; i++) {
+		struct texture *texture = &cache.textures[i];
+		if (texture->state == TEXTURE_DECODED)
+			texture->state = TEXTURE_UPLOADING;
+		if (texture->state != TEXTURE_UPLOADING)
+			continue;
+
+		TRACE_BEGIN("upload texture");
+		uploaded += upload_rows(texture, cache.upload_bytes - uploaded);
+		TRACE_END();
+
+		if (texture->upload_level == texture->levels) {
+			free(texture->pixels);
+			texture->pixels = NULL;
+			texture->state = TEXTURE_RESIDENT;
+			cache.resident_bytes += texture->bytes;
+		}
+	}
+
+	evict_textures();
+	cache.frame++;
+	pthread_mutex_unlock(&cache.lock);
+}
+
+void texture_cache_stats(struct texture_cache_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&cache.lock);
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		enum texture_state state = cache.textures[i].state;
+		if (state == TEXTURE_FREE)
+			continue;
+		stats->textures++;
+		if (state == TEXTURE_RESIDENT)
+			stats->resident++;
+		else if (state == TEXTURE_QUEUED || state == TEXTURE_DECODED || state == TEXTURE_UPLOADING)
+			stats->loading++;
+	}
+	stats->bytes = cache.resident_bytes;
+	stats->budget = cache.budget;
+	stats->loads = cache.loads;
+	stats->evictions = cache.evictions;
+	pthread_mutex_unlock(&cache.lock);
+}
+
+// Stops the decode thread and deletes every texture. Called by the renderer before the EGL
+// context goes away.
+void free_texture_cache() {
+	if (cache.worker_running) {
+		pthread_mutex_lock(&cache.lock);
+		cache.quit = 1;
+		pthread_cond_broadcast(&cache.wake);
+		pthread_mutex_unlock(&cache.lock);
+		pthread_join(cache.worker, NULL);
+		cache.worker_running = 0;
+	}
+
+	for (int i = 0; i < MAX_TEXTURES; i++)
+		release_texture(i);
+
+	cache.queue_head = cache.queue_count = 0;
+	cache.resident_bytes = 0;
+	cache.frame = cache.loads = cache.evictions = 0;
+	cache.npot_mipmaps = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef HELPERS_TEXTURE_HELPERS_H_
+#define HELPERS_TEXTURE_HELPERS_H_
+
+#include <stddef.h>
+
+// Streaming texture loader. Image files (binary PPM/PGM, QOI or raw RGBA8888) are mmapped and
+// decoded on a worker thread into RGBA buffers holding the whole mip chain. The renderer
+// uploads decoded images between frames, a few rows at a time within a per-frame byte
+// budget, so loading never blocks draw().
+//
+// Loaded textures form an LRU cache with a memory budget. When the resident textures go
+// over it, the ones used least recently (and not in the current frame) are deleted. Their
+// handles stay valid: the next texture_get() loads them again, so large image sets page in
+// and out as they are used.
+
+#define MAX_TEXTURES 256
+#define TEXTURE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define TEXTURE_DEFAULT_UPLOAD_BYTES (4 * 1024 * 1024)
+
+struct texture_cache_stats {
+	size_t bytes;           // GPU memory of the resident textures
+	size_t budget;
+	unsigned int textures;  // Handles
+	unsigned int resident;
+	unsigned int loading;   // Queued, decoding or uploading
+	unsigned long loads;    // Decodes since start, more than textures means paging
+	unsigned long evictions;
+};
+
+// Memory budget of the cache and the most bytes uploaded per frame, 0 keeps the default.
+void texture_cache_configure(size_t budget, size_t upload_bytes_per_frame);
+
+// Starts loading a .ppm/.pgm or .qoi file. Returns a handle, -1 on failure.
+int load_texture(const char *path);
+
+// Starts loading a file of width x height RGBA8888 pixels. Returns a handle, -1 on failure.
+int load_raw_texture(const char *path, unsigned int width, unsigned int height);
+
+// Returns the GL texture, or 0 while it is still loading (a texture that was evicted starts
+// loading again). Call it in every frame the texture is drawn in, that is what keeps it in
+// the cache.
+unsigned int texture_get(int texture);
+
+// Image size, 0 until the file has been decoded once.
+void texture_size(int texture, unsigned int *width, unsigned int *height);
+
+// Deletes the texture and frees the handle.
+void release_texture(int texture);
+
+void texture_cache_stats(struct texture_cache_stats *stats);
+
+#endif /* HELPERS_TEXTURE_HELPERS_H_ */
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "Trace_helpers.h"
+
+// Events per chunk, a thread's buffer grows by whole chunks
+#define TRACE_CHUNK_EVENTS 16384
+
+struct trace_event {
+	const char *name;
+	uint64_t ts;   // ns, CLOCK_MONOTONIC
+	int64_t value; // Counters only
+	char phase;    // Chrome trace phase: B, E, i or C
+};
+
+struct trace_chunk {
+	struct trace_chunk *next;
+	unsigned int count;
+	struct trace_event events[TRACE_CHUNK_EVENTS];
+};
+
+struct trace_buffer {
+	struct trace_buffer *next;
+	pid_t tid;
+	const char *thread_name;
+	struct trace_chunk *first, *last;
+};
+
+static struct {
+	int active;
+	unsigned int generation; // Bumped on every start so threads drop stale buffers
+	char *path;
+	pthread_mutex_t lock;    // Guards the buffer list, only taken when a thread's first event arrives
+	struct trace_buffer *buffers;
+} trace = { 0, 0, NULL, PTHREAD_MUTEX_INITIALIZER, NULL };
+
+static __thread struct trace_buffer *local_buffer;
+static __thread unsigned int local_generation;
+
+static struct trace_chunk *new_chunk() {
+	struct trace_chunk *chunk = malloc(sizeof(*chunk));
+	if (chunk) {
+		chunk->next = NULL;
+		chunk->count = 0;
+	}
+	return chunk;
+}
+
+static struct trace_buffer *thread_buffer() {
+	unsigned int generation = __atomic_load_n(&trace.generation, __ATOMIC_ACQUIRE);
+	if (local_buffer && local_generation == generation)
+		return local_buffer;
+
+	struct trace_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (!buffer)
+		return NULL;
+	buffer->tid = syscall(SYS_gettid);
+	buffer->first = buffer->last = new_chunk();
+	if (!buffer->first) {
+		free(buffer);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&trace.lock);
+	buffer->next = trace.buffers;
+	trace.buffers = buffer;
+	pthread_mutex_unlock(&trace.lock);
+
+	local_buffer = buffer;
+	local_generation = generation;
+	return buffer;
+}
+
+static void record(const char *name, char phase, int64_t value) {
+	if (!__atomic_load_n(&trace.active, __ATOMIC_RELAXED))
+		return;
+
+	struct trace_buffer *buffer = thread_buffer();
+	if (!buffer)
+		return;
+
+	struct trace_chunk *chunk = buffer->last;
+	if (chunk->count == TRACE_CHUNK_EVENTS) {
+		chunk = new_chunk();
+		if (!chunk)
+			return;
+		buffer->last->next = chunk;
+		buffer->last = chunk;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	struct trace_event *event = &chunk->events[chunk->count++];
+	event->name = name;
+	event->ts = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+	event->value = value;
+	event->phase = phase;
+}
+
+void trace_begin(const char *name) {
+	record(name, 'B', 0);
+}
+
+void trace_end() {
+	record(NULL, 'E', 0);
+}
+
+void trace_instant(const char *name) {
+	record(name, 'i', 0);
+}
+
+void trace_counter(const char *name, int64_t value) {
+	record(name, 'C', value);
+}
+
+void trace_thread_name(const char *name) {
+	if (!__atomic_load_n(&trace.active, __ATOMIC_RELAXED))
+		return;
+
+	struct trace_buffer *buffer = thread_buffer();
+	if (buffer)
+		buffer->thread_name = name;
+}
+
+int trace_active() {
+	return __atomic_load_n(&trace.active, __ATOMIC_RELAXED);
+}
+
+int trace_start(const char *path) {
+	if (trace.active) {
+		printf("Trace Error: A trace is already being recorded\n");
+		return 1;
+	}
+
+	trace.path = strdup(path);
+	if (!trace.path) {
+		printf("Trace Error: Malloc failed\n");
+		return 1;
+	}
+
+	__atomic_add_fetch(&trace.generation, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&trace.active, 1, __ATOMIC_RELEASE);
+	printf("Tracing to %s\n", path);
+	return 0;
+}
+
+static void write_event(FILE *f, const struct trace_event *event, pid_t pid, pid_t tid, int *first) {
+	fprintf(f, "%s\n{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u", *first ? "" : ",", event->phase,
+			pid, tid, (unsigned long long)(event->ts / 1000), (unsigned int)(event->ts % 1000));
+	if (event->name)
+		fprintf(f, ",\"name\":\"%s\"", event->name);
+	if (event->phase == 'i')
+		fprintf(f, ",\"s\":\"t\"");
+	if (event->phase == 'C')
+		fprintf(f, ",\"args\":{\"value\":%lld}", (long long)event->value);
+	fprintf(f, "}");
+	*first = 0;
+}
+
+int trace_stop() {
+	if (!trace.active)
+		return 0;
+	__atomic_store_n(&trace.active, 0, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&trace.lock);
+	struct trace_buffer *buffers = trace.buffers;
+	trace.buffers = NULL;
+	pthread_mutex_unlock(&trace.lock);
+
+	int ret = 0;
+	FILE *f = fopen(trace.path, "w");
+	if (!f) {
+		printf("Trace Error: Failed to open %s\n", trace.path);
+		ret = 1;
+	}
+
+	pid_t pid = getpid();
+	int first = 1;
+	unsigned long total = 0;
+	if (f)
+		fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	while (buffers) {
+		struct trace_buffer *buffer = buffers;
+		buffers = buffer->next;
+
+		if (f && buffer->thread_name) {
+			fprintf(f, "%s\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+					first ? "" : ",", pid, buffer->tid, buffer->thread_name);
+			first = 0;
+		}
+
+		struct trace_chunk *chunk = buffer->first;
+		while (chunk) {
+			struct trace_chunk *next = chunk->next;
+			for (unsigned int i = 0; f && i < chunk->count; i++)
+				write_event(f, &chunk->events[i], pid, buffer->tid, &first);
+			total += chunk->count;
+			free(chunk);
+			chunk = next;
+		}
+		free(buffer);
+	}
+
+	if (f) {
+		fprintf(f, "\n]}\n");
+		fclose(f);
+		printf("Trace: wrote %lu events to %s\n", total, trace.path);
+	}
+
+	free(trace.path);
+	trace.path = NULL;
+	return ret;
+}
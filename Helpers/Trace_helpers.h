@@ -0,0 +1,41 @@
+#ifndef HELPERS_TRACE_HELPERS_H_
+#define HELPERS_TRACE_HELPERS_H_
+
+#include <stdint.h>
+
+// Chrome trace recording (chrome://tracing, ui.perfetto.dev). Events go into per-thread
+// buffers without locking and are written as JSON by trace_stop(). Setting SIMPLE_DRM_TRACE to
+// a file name starts a trace in init_renderer that is written by free_renderer.
+//
+// Use the macros, they compile to nothing when the build disables TRACE_ENABLED. Names must be
+// string literals (only the pointer is stored). Begin/end pairs must nest within a thread.
+
+#ifdef TRACE_ENABLED
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#define TRACE_INSTANT(name) trace_instant(name)
+#define TRACE_COUNTER(name, value) trace_counter(name, value)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+// Starts recording, the trace is written to path when it stops. Returns 1 on error.
+int trace_start(const char *path);
+
+// Writes the trace and frees the buffers. Other threads must not be emitting events.
+int trace_stop();
+
+int trace_active();
+
+void trace_begin(const char *name);
+void trace_end();
+void trace_instant(const char *name);
+void trace_counter(const char *name, int64_t value);
+void trace_thread_name(const char *name);
+
+#endif /* HELPERS_TRACE_HELPERS_H_ */
@@ -1,5 +1,5 @@
-precision mediump float;				
-uniform vec4 u_Color;					
-void main() {							
-    gl_FragColor = u_Color;				
-}			
\ No newline at end of file
+precision mediump float;
+varying vec4 v_Color;
+void main() {
+    gl_FragColor = v_Color;
+}
@@ -1,4 +1,12 @@
-attribute vec4 a_Position;			
-void main() {							
-    gl_Position = a_Position;			
-}
\ No newline at end of file
+attribute vec4 a_Position;
+attribute vec2 a_Offset;
+attribute vec2 a_ScaleRotation;
+attribute vec4 a_Color;
+varying vec4 v_Color;
+void main() {
+    float s = sin(a_ScaleRotation.y);
+    float c = cos(a_ScaleRotation.y);
+    vec2 p = a_Position.xy * a_ScaleRotation.x;
+    gl_Position = vec4(p.x * c - p.y * s + a_Offset.x, p.x * s + p.y * c + a_Offset.y, a_Position.z, 1.0);
+    v_Color = a_Color;
+}
@@ -1,17 +1,29 @@
 #include <stdio.h>
 #include <GLES2/gl2.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "Helpers/Renderer_helpers.h"
 #include "Helpers/GL_helpers.h"
 #include "Helpers/Input_helpers.h"
+#include "Helpers/Software_helpers.h"
+#include "Helpers/Profiler_helpers.h"
+#include "Helpers/Mesh_helpers.h"
 
 // Vertex shader source code
 static const char *vertexShaderSource =
 		"		\
 attribute vec4 a_Position;				\
+attribute vec2 a_Offset;				\
+attribute vec2 a_ScaleRotation;			\
+attribute vec4 a_Color;					\
+varying vec4 v_Color;					\
 void main() {							\
-    gl_Position = a_Position;			\
+    float s = sin(a_ScaleRotation.y);	\
+    float c = cos(a_ScaleRotation.y);	\
+    vec2 p = a_Position.xy * a_ScaleRotation.x;	\
+    gl_Position = vec4(p.x * c - p.y * s + a_Offset.x, p.x * s + p.y * c + a_Offset.y, a_Position.z, 1.0);	\
+    v_Color = a_Color;					\
 }										\
 ";
 
@@ -19,131 +31,136 @@ void main() {							\
 static const char *fragmentShaderSource =
 		" 	\
 precision mediump float;				\
-uniform vec4 u_Color;					\
+varying vec4 v_Color;					\
 void main() {							\
-    gl_FragColor = u_Color;				\
+    gl_FragColor = v_Color;				\
 }										\
 ";
 
-static GLfloat vertices[] = {
+// Uploaded once, moving and scaling only changes the instance transform
+static const GLfloat vertices[] = {
 		0.0f, 0.25f, 0.0f, // Top
 		-0.25f, -0.25f, 0.0f, // Bottom left
 		0.25f, -0.25f, 0.0f  // Bottom right
 	};
 
 static GLuint program;
-static GLint positionAttrib;
-static GLint colorUniform;
-static GLuint vbo = 0;
+static int program_watch = -1;
+static int triangle = -1;
 
 static float speed = 0.05;
 
+static void load_program(unsigned int new_program) {
+	program = new_program;
+}
+
 static void init() {
+	// Without a context (software renderer) the mesh only keeps the transform
+	triangle = create_mesh(vertices, 3, 3, 1);
+	if (triangle < 0 || mesh_add_instance(triangle) < 0)
+		exit(0);
+	mesh_set_color(triangle, 0, 0xFFFF0000); // Red
+
+	if (renderer_is_software())
+		return; // Drawn with the CPU kernels, no GL objects needed
+
 //	program = createProgram(vertexShaderSource, fragmentShaderSource);
-	program = createProgramFromFile("../Shaders/triangle.vert", "../Shaders/triangle.frag");
-	if(!program){
+	// Edits to the shader files are picked up while running
+	program_watch = watchProgramFromFile("../Shaders/triangle.vert", "../Shaders/triangle.frag", load_program);
+	if(program_watch < 0){
 		exit(0); // Error creating program
 	}
+	load_program(getWatchedProgram(program_watch));
+}
 
-	positionAttrib = glGetAttribLocation(program, "a_Position");
-	colorUniform = glGetUniformLocation(program, "u_Color");
+// Moves the triangle, keeping it on screen
+static void move_triangle(float dx, float dy) {
+	float x, y, scale;
+	mesh_get_transform(triangle, 0, &x, &y, &scale, NULL);
+
+	float extent = 0.25f * scale; // Vertices are within 0.25 of the center
+	if (x + dx + extent > 1.0f)
+		dx = 1.0f - extent - x;
+	if (x + dx - extent < -1.0f)
+		dx = -1.0f + extent - x;
+	if (y + dy + extent > 1.0f)
+		dy = 1.0f - extent - y;
+	if (y + dy - extent < -1.0f)
+		dy = -1.0f + extent - y;
+
+	mesh_move(triangle, 0, dx, dy);
+}
 
-	// Create VBO
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+static void update_transform() {
+	float dx = 0, dy = 0;
+	if (is_key_pressed(KEY_W))
+		dy += speed;
+	if (is_key_pressed(KEY_S))
+		dy -= speed;
+	if (is_key_pressed(KEY_A))
+		dx -= speed;
+	if (is_key_pressed(KEY_D))
+		dx += speed;
+
+	if (dx != 0 || dy != 0)
+		move_triangle(dx, dy);
 }
 
-static void update_vertices() {
-	float diff = 0;
-	bool modified = false;
-	if (is_key_pressed(KEY_W)) {
-		if (vertices[1] + speed < 1.0) {
-			diff = speed;
-		} else {
-			diff = 1.0 - vertices[1];
-		}
-		vertices[1] += diff;
-		vertices[4] += diff;
-		vertices[7] += diff;
-		modified = true;
-	}
-	if (is_key_pressed(KEY_S)) {
-		if (vertices[7] - speed > -1.0) {
-			diff = speed;
-		} else {
-			diff = vertices[7] + 1;
-		}
-		vertices[1] -= diff;
-		vertices[4] -= diff;
-		vertices[7] -= diff;
-		modified = true;
-	}
-	if (is_key_pressed(KEY_A)) {
-		if (vertices[3] - speed > -1.0) {
-			diff = speed;
-		} else {
-			diff = vertices[3] + 1;
-		}
-
-		vertices[0] -= diff;
-		vertices[3] -= diff;
-		vertices[6] -= diff;
-		modified = true;
-	}
-	if (is_key_pressed(KEY_D)) {
-		if (vertices[6] + speed < 1.0) {
-			diff = speed;
-		} else {
-			diff = 1 - vertices[6];
-		}
-		vertices[0] += diff;
-		vertices[3] += diff;
-		vertices[6] += diff;
-		modified = true;
-	}
+// Scanline fill of the triangle for the software renderer
+static void draw_software() {
+	struct sw_canvas *canvas = renderer_get_canvas();
+	float w = canvas->width, h = canvas->height;
+
+	sw_fill_rect(canvas, 0, 0, canvas->width, canvas->height, 0xFF00FF00); // Green
 
-	if(modified){
-		// Update vertex buffer data
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	float cx, cy, scale;
+	mesh_get_transform(triangle, 0, &cx, &cy, &scale, NULL);
+
+	// Triangle vertices in pixels, top vertex first
+	float tx = (vertices[0] * scale + cx + 1) * 0.5f * w, ty = (1 - (vertices[1] * scale + cy)) * 0.5f * h;
+	float lx = (vertices[3] * scale + cx + 1) * 0.5f * w;
+	float rx = (vertices[6] * scale + cx + 1) * 0.5f * w, by = (1 - (vertices[7] * scale + cy)) * 0.5f * h;
+
+	for (int y = (int)ty; y < (int)by; y++) {
+		float t = (y - ty) / (by - ty);
+		int x0 = (int)(tx + (lx - tx) * t);
+		int x1 = (int)(tx + (rx - tx) * t);
+		sw_fill_rect(canvas, x0, y, x1 - x0, 1, 0xFFFF0000); // Red
 	}
 }
 
 static void draw() {
+	if (renderer_is_software()) {
+		draw_software();
+		return;
+	}
+
+    gpu_pass_begin("triangle");
+
     glViewport(0, 0, renderer_get_width(), renderer_get_height());
     glClearColor(GREEN);
     glClear(GL_COLOR_BUFFER_BIT);
 
     glUseProgram(program);
+    draw_mesh(triangle, program);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnableVertexAttribArray(positionAttrib);
-
-    glUniform4f(colorUniform, 1.0, 0.0, 0.0, 1.0); // Red
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    glDisableVertexAttribArray(positionAttrib);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gpu_pass_end();
 }
 
 static void cleanup() {
-    if (vbo) {
-        glDeleteBuffers(1, &vbo);
-        vbo = 0;
+    free_mesh(triangle);
+    triangle = -1;
+    if (program_watch >= 0) {
+        unwatchProgram(program_watch);
+        program_watch = -1;
     }
-    glDeleteProgram(program);
 }
 
 static int keyboard_callback(){
 	if(is_key_pressed(KEY_ESC))
 		return 1;
 
-    update_vertices();
+    update_transform();
 	return 0;
 }
 
@@ -152,28 +169,41 @@ static void mouse_callback(int x_move, int y_move, int left, int right, int midd
 	(void)x_move;
 	(void)y_move;
 	(void)middle;
-	if (left) {
-		for (int i = 0; i < 9; i++)
-			vertices[i] *= 1.1;
-	}
-	if (right) {
-		for (int i = 0; i < 9; i++)
-			vertices[i] *= 0.9;
+	float x, y, scale;
+	mesh_get_transform(triangle, 0, &x, &y, &scale, NULL);
+	if (left)
+		scale *= 1.1;
+	if (right)
+		scale *= 0.9;
+	if (left || right) {
+		mesh_set_transform(triangle, 0, x, y, scale, 0.0f);
+		move_triangle(0, 0); // Grown past the edge
 	}
-
-	// Update vertex buffer data
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-int main() {
-	init_renderer(init, draw, cleanup);
-	if(init_input_handler(keyboard_callback, mouse_callback)){
+// Usage: SimpleDRMRenderer [--record file | --replay file [rate]]
+int main(int argc, char **argv) {
+	// Flat 2D scene, no depth buffer or MSAA needed
+	const struct surface_config surface = { SURFACE_XRGB8888, 0, 0, 0 };
+	if (init_renderer(init, draw, cleanup, &surface))
+		return 1;
+
+	int ret;
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+		ret = init_input_replay(argv[2], argc > 3 ? atof(argv[3]) : 1.0f, keyboard_callback, mouse_callback);
+	else
+		ret = init_input_handler(keyboard_callback, mouse_callback);
+	if(ret){
 		free_renderer();
 		return 1;
 	}
 
+	if (argc > 2 && strcmp(argv[1], "--record") == 0 && start_input_recording(argv[2])) {
+		free_renderer();
+		free_input_handler();
+		return 1;
+	}
+
 	if (render_loop()) {
 		// Error
 		free_renderer();